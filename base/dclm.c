@@ -49,9 +49,15 @@ dclmError(DCLEDMatrix *dclm, DCLEDMatrixError err, const char *template, ...)
  * LIBHIDAPI STUFF                                                          *
  ****************************************************************************/ 
 
+/* open the device
+ * path: the hidapi device path, NULL for the first matching device
+ * serial: the serial number, NULL for any
+ */
 static DCLEDMatrixError
-dclmOpenHID(DCLEDMatrix *dclm)
+dclmOpenHID(DCLEDMatrix *dclm, const char *path, const char *serial)
 {
+	wchar_t wserial[DCLM_MAX_OPTION_LEN];
+
 	if (!dclm) {
 		return dclmError(NULL, DCLM_NO_CONTEXT, "OpenUSB");
 	}
@@ -63,7 +69,17 @@ dclmOpenHID(DCLEDMatrix *dclm)
 		return dclmError(dclm, DCLM_FAILED_HIDAPI, "initialize libhidapi");
 	}
 
-	dclm->dev = hid_open(dclm->idVendor, dclm->idProduct, NULL);
+	if (path) {
+		dclm->dev = hid_open_path(path);
+	} else if (serial) {
+		if (mbstowcs(wserial, serial, DCLM_MAX_OPTION_LEN) >= DCLM_MAX_OPTION_LEN) {
+			hid_exit();
+			return dclmError(dclm, DCLM_HID_OPEN_FAILED, "serial number too long");
+		}
+		dclm->dev = hid_open(dclm->idVendor, dclm->idProduct, wserial);
+	} else {
+		dclm->dev = hid_open(dclm->idVendor, dclm->idProduct, NULL);
+	}
 	if (!dclm->dev) {
 		hid_exit();
 		return DCLM_HID_OPEN_FAILED;
@@ -78,6 +94,11 @@ static DCLEDMatrixError
 dclmCloseHIDInternal(DCLEDMatrix *dclm)
 {
 	DCLEDMatrixError err=DCLM_OK;
+	if (dclm->flags & DCLM_VIRTUAL) {
+		/* hidapi was never initialized */
+		dclm->flags &= ~(DCLM_OPEN | DCLM_VIRTUAL);
+		return err;
+	}
 	if (dclm->dev) {
 		hid_close(dclm->dev);
 		dclm->dev=NULL;
@@ -145,16 +166,22 @@ dclmSendScreenHID(DCLEDMatrix *dclm, const DCLEDMatrixScreen *scr)
  ****************************************************************************/ 
 
 static void
-dclmScrInit(DCLEDMatrixScreen *scr)
+scr_data_init(uint8_t data[DCLM_DATA_ROWS][DCLM_DATA_COLS])
 {
 	int i,j;
 
 	for (i=0; i<DCLM_DATA_ROWS; i++) {
-		scr->data[i][1]=(uint8_t)(i*2);
+		data[i][1]=(uint8_t)(i*2);
 		for (j=2; j<DCLM_DATA_COLS; j++) {
-			scr->data[i][j]=0xff;
+			data[i][j]=0xff;
 		}
 	}
+}
+
+static void
+dclmScrInit(DCLEDMatrixScreen *scr)
+{
+	scr_data_init(scr->data);
 	dclmScrSetBrightness(scr,0);
 }
 
@@ -251,9 +278,74 @@ dclmScrSetPixel(DCLEDMatrixScreen *scr, unsigned int x, unsigned int y, int valu
 		data[0] &= ~(1<<bit);
 	} else {
 		/* toggle LED */
+		data[0] ^= (1<<bit);
 	}
 }
 
+static void
+scr_apply_row_mask(uint8_t *data, uint32_t mask, int value)
+{
+	/* data[0] holds the columns 16-23, data[2] the columns 0-7 */
+	uint8_t b[3];
+	int i;
+
+	b[0]=(uint8_t)(mask >> 16);
+	b[1]=(uint8_t)(mask >> 8);
+	b[2]=(uint8_t)mask;
+
+	for (i=0; i<3; i++) {
+		if (value == 0) {
+			/* clear LEDs */
+			data[i] |= b[i];
+		} else if (value == 1) {
+			/* set LEDs */
+			data[i] &= ~b[i];
+		} else {
+			/* toggle LEDs */
+			data[i] ^= b[i];
+		}
+	}
+}
+
+extern void
+dclmScrFillRect(DCLEDMatrixScreen *scr, int x, int y, int w, int h, int value)
+{
+	uint32_t mask;
+	int row;
+
+	/* clip it */
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	if (x + w > scr->dclm->cols) {
+		w = scr->dclm->cols - x;
+	}
+	if (y + h > scr->dclm->rows) {
+		h = scr->dclm->rows - y;
+	}
+	if (w < 1 || h < 1) {
+		return;
+	}
+
+	/* bit x of the mask is column x */
+	mask=((1U<<w)-1U)<<x;
+	for (row=y; row < y+h; row++) {
+		scr_apply_row_mask(&scr->data[row>>1][2] + 3*(row & 1), mask, value);
+	}
+}
+
+extern void
+dclmScrCopy(DCLEDMatrixScreen *dst, const DCLEDMatrixScreen *src)
+{
+	assert(dst && src && dst->dclm == src->dclm);
+	memcpy(dst->data, src->data, sizeof(dst->data));
+}
+
 extern DCLMImage *
 dclmImageCreateFit(const DCLEDMatrix *dclm)
 {
@@ -318,6 +410,49 @@ scr_get_row(const uint8_t *scrdata, uint8_t *imgdata)
 	}
 }
 
+extern void
+dclmScrGetData(const DCLEDMatrixScreen *scr, uint8_t *data)
+{
+	assert(scr && data);
+	memcpy(data, scr->data, DCLM_SCR_DATA_SIZE);
+}
+
+extern void
+dclmScrSetData(DCLEDMatrixScreen *scr, const uint8_t *data)
+{
+	int i;
+
+	assert(scr && data);
+	/* only the pixels, the report headers stay ours */
+	for (i=0; i<DCLM_DATA_ROWS; i++) {
+		memcpy(&scr->data[i][2], data + i*DCLM_DATA_COLS + 2, DCLM_DATA_COLS - 2);
+	}
+}
+
+extern void
+dclmScrDataFromImg(uint8_t *data, const DCLMImage *img)
+{
+	uint8_t scrdata[DCLM_DATA_ROWS][DCLM_DATA_COLS];
+	const uint8_t *imgdata;
+	int row, i;
+
+	assert(data && img && img->data);
+	assert(img->dims[0] >= DCLM_COLS);
+	assert(img->dims[1] >= DCLM_ROWS);
+
+	scr_data_init(scrdata);
+	for (i=0; i<DCLM_DATA_ROWS; i++) {
+		/* see dclmScrSetBrightness() */
+		scrdata[i][0]=2;
+	}
+	imgdata=img->data;
+	for (row=0; row < DCLM_ROWS; row++) {
+		scr_set_row(&scrdata[row>>1][2] + 3*(row & 1), imgdata);
+		imgdata+=img->dims[0];
+	}
+	memcpy(data, scrdata, DCLM_SCR_DATA_SIZE);
+}
+
 extern void
 dclmScrToiImg(const DCLEDMatrixScreen *scr, DCLMImage *img)
 {
@@ -409,7 +544,7 @@ dclmScrFromImgBlit(DCLEDMatrixScreen *scr, const DCLMImage *img,
 	fx=from_x % img->dims[0];
 	fy=from_y % img->dims[1];
 	imgdata=DCLM_IMG_PIXEL(img, fx, fy);
-	wrap=dclm->cols-fx;
+	wrap=img->dims[0]-fx;
 	
 	for (row=0; row<h; row++) {
 		scr_set_row_wrap(scrdata, imgdata, to_x, w, imgdata + wrap, img->dims[0]);
@@ -423,6 +558,110 @@ dclmScrFromImgBlit(DCLEDMatrixScreen *scr, const DCLMImage *img,
 	}
 }
 
+/****************************************************************************
+ * SCREEN TRANSITIONS                                                       *
+ ****************************************************************************/
+
+/* get a row as bit mask of the lit LEDs, bit x is column x */
+static uint32_t
+scr_row_bits(const DCLEDMatrixScreen *scr, int row)
+{
+	const uint8_t *data=&scr->data[row>>1][2] + 3*(row & 1);
+
+	/* data[0] holds the columns 16-23, data[2] the columns 0-7 */
+	return ~((uint32_t)data[2] | ((uint32_t)data[1]<<8) | ((uint32_t)data[0]<<16)) & 0xffffffU;
+}
+
+static void
+scr_put_row_bits(DCLEDMatrixScreen *scr, int row, uint32_t lit)
+{
+	uint8_t *data=&scr->data[row>>1][2] + 3*(row & 1);
+
+	lit=~lit;
+	data[0]=(uint8_t)(lit >> 16);
+	data[1]=(uint8_t)(lit >> 8);
+	data[2]=(uint8_t)lit;
+}
+
+/* the pixels of row which already switched over at a dissolve
+ * of level 0 ... 255: every pixel gets a fixed pseudo-random
+ * threshold, so the pixels switch over in a scattered order */
+static uint32_t
+scr_dissolve_mask(int row, int cols, unsigned int level)
+{
+	uint32_t mask=0;
+	uint32_t hash;
+	int x;
+
+	for (x=0; x<cols; x++) {
+		hash=((uint32_t)(row*cols + x) + 1U) * 2654435761U;
+		if (((hash >> 24) & 0xff) < level) {
+			mask |= 1U<<x;
+		}
+	}
+	return mask;
+}
+
+extern void
+dclmScrTransition(DCLEDMatrixScreen *dst, const DCLEDMatrixScreen *from, const DCLEDMatrixScreen *to,
+		  int effect, unsigned int step, unsigned int steps)
+{
+	const DCLEDMatrix *dclm;
+	uint32_t all, a, b;
+	unsigned int n;
+	int cols, rows, row, src;
+
+	assert(dst && from && to && dst->dclm == from->dclm && dst->dclm == to->dclm);
+
+	dclm=dst->dclm;
+	cols=dclm->cols;
+	rows=dclm->rows;
+	all=(1U<<cols)-1U;
+
+	if (!steps || step >= steps || effect == DCLM_TRANS_CUT) {
+		dclmScrCopy(dst, (step)?to:from);
+		return;
+	}
+
+	for (row=0; row<rows; row++) {
+		a=scr_row_bits(from, row);
+		b=scr_row_bits(to, row);
+		switch (effect) {
+			case DCLM_TRANS_SLIDE_LEFT:
+				/* both move to the left, the new screen enters at the right */
+				n=step*(unsigned)cols/steps;
+				a=(a >> n) | ((n)?(b << (cols-(int)n)):0);
+				break;
+			case DCLM_TRANS_SLIDE_RIGHT:
+				n=step*(unsigned)cols/steps;
+				a=(a << n) | ((n)?(b >> (cols-(int)n)):0);
+				break;
+			case DCLM_TRANS_ROLL_UP:
+				/* both move up, the new screen enters at the bottom */
+				src=row + (int)(step*(unsigned)rows/steps);
+				a=(src < rows)?scr_row_bits(from, src):scr_row_bits(to, src-rows);
+				break;
+			case DCLM_TRANS_ROLL_DOWN:
+				src=row - (int)(step*(unsigned)rows/steps);
+				a=(src >= 0)?scr_row_bits(from, src):scr_row_bits(to, src+rows);
+				break;
+			case DCLM_TRANS_WIPE:
+				/* the new screen is revealed column by column, from the left */
+				n=step*(unsigned)cols/steps;
+				b &= (1U<<n)-1U;
+				a=(a & ~((1U<<n)-1U)) | b;
+				break;
+			case DCLM_TRANS_DISSOLVE:
+				n=scr_dissolve_mask(row, cols, step*256U/steps);
+				a=(a & ~n) | (b & n);
+				break;
+			default:
+				a=b;
+		}
+		scr_put_row_bits(dst, row, a & all);
+	}
+}
+
 /****************************************************************************
  * MANAGEMENT OF THE DCLEDMatrix struct                                     *
  ****************************************************************************/ 
@@ -478,6 +717,41 @@ dclmDestroy(DCLEDMatrix *dclm)
 	}
 }
 
+/****************************************************************************
+ * OPTIONS                                                                  *
+ ****************************************************************************/ 
+
+/* get the value of option "key=value" in the options string,
+ * options are separated by ',' or white space, unknown ones are ignored
+ * RETURN: value (copied to buf), NULL if not set
+ */
+static const char *
+dclmGetOption(const char *options, const char *key, char *buf, size_t size)
+{
+	size_t keylen = strlen(key);
+	size_t len;
+
+	if (!options) {
+		return NULL;
+	}
+
+	while (*options) {
+		len = strcspn(options, ", \t\n");
+		if (len > keylen && options[keylen] == '=' && !strncmp(options, key, keylen)) {
+			len -= keylen + 1;
+			if (len >= size) {
+				len = size - 1;
+			}
+			memcpy(buf, options + keylen + 1, len);
+			buf[len] = 0;
+			return buf;
+		}
+		options += len;
+		options += strspn(options, ", \t\n");
+	}
+	return NULL;
+}
+
 /****************************************************************************
  * EXTERNAL API                                                             *
  ****************************************************************************/ 
@@ -486,12 +760,17 @@ extern DCLEDMatrix *
 dclmOpen(const char *options)
 {
 	DCLEDMatrix *dclm;
-
-	(void)options;
+	char path[DCLM_MAX_OPTION_LEN];
+	char serial[DCLM_MAX_OPTION_LEN];
 
 	dclm=dclmCreate();
 	if (dclm) {
-		dclmOpenHID(dclm);
+		if (dclmGetOption(options, "virtual", path, sizeof(path)) && strcmp(path, "0")) {
+			dclm->flags |= DCLM_OPEN | DCLM_VIRTUAL;
+		} else {
+			dclmOpenHID(dclm, dclmGetOption(options, "path", path, sizeof(path)),
+					  dclmGetOption(options, "serial", serial, sizeof(serial)));
+		}
 		dclmScrDestroy(dclm->scr_off);
 		dclm->scr_off=dclmScrCreate(dclm);	
 	}
@@ -543,6 +822,9 @@ dclmSendScreen(DCLEDMatrixScreen *scr)
 		return dclmError(NULL, DCLM_NOT_OPEN, "SendScreen");
 	}
 
+	if (dclm->flags & DCLM_VIRTUAL) {
+		return DCLM_OK;
+	}
 	return dclmSendScreenHID(dclm, scr);
 }
 
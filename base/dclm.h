@@ -34,6 +34,19 @@ typedef enum {
 	DCLM_PARAM_COLUMNS
 } DCLEDMatrixParam;
 
+/* screen transitions, see dclmScrTransition() */
+#define DCLM_TRANS_CUT		0	/* no transition */
+#define DCLM_TRANS_SLIDE_LEFT	1
+#define DCLM_TRANS_SLIDE_RIGHT	2
+#define DCLM_TRANS_ROLL_UP	3
+#define DCLM_TRANS_ROLL_DOWN	4
+#define DCLM_TRANS_WIPE		5	/* column wipe from the left */
+#define DCLM_TRANS_DISSOLVE	6
+#define DCLM_TRANS_COUNT	7
+
+/* size of the packed data of a screen, see dclmScrGetData() */
+#define DCLM_SCR_DATA_SIZE	32
+
 /* abstract data types */
 typedef struct DCLEDMatrix_s DCLEDMatrix;
 typedef struct DCLEDMatrixScreen_s DCLEDMatrixScreen;
@@ -57,6 +70,13 @@ dclmScrClear(DCLEDMatrixScreen *scr, int value);
 extern void
 dclmScrSetPixel(DCLEDMatrixScreen *scr, unsigned int x, unsigned int y, int value);
 
+/* value: 0: off, 1: on, 2: toggle */
+extern void
+dclmScrFillRect(DCLEDMatrixScreen *scr, int x, int y, int w, int h, int value);
+
+extern void
+dclmScrCopy(DCLEDMatrixScreen *dst, const DCLEDMatrixScreen *src);
+
 extern DCLMImage *
 dclmImageCreateFit(const DCLEDMatrix *dclm);
 
@@ -66,15 +86,43 @@ dclmScrFromImg(DCLEDMatrixScreen *scr, const DCLMImage *img);
 extern void
 dclmScrToiImg(const DCLEDMatrixScreen *scr, DCLMImage *img);
 
+/* Get and set the packed data of a screen,
+ * data has DCLM_SCR_DATA_SIZE bytes */
+extern void
+dclmScrGetData(const DCLEDMatrixScreen *scr, uint8_t *data);
+
+extern void
+dclmScrSetData(DCLEDMatrixScreen *scr, const uint8_t *data);
+
+/* Pack an image into the data of a screen, without a device.
+ * The image must be at least as large as the LED matrix.
+ * data has DCLM_SCR_DATA_SIZE bytes */
+extern void
+dclmScrDataFromImg(uint8_t *data, const DCLMImage *img);
+
 extern void
 dclmScrFromImgBlit(DCLEDMatrixScreen *scr, const DCLMImage *img,
                    size_t from_x, size_t from_y,
                    int to_x, int to_y, int w, int h);
 
+/* Compute frame step of steps of a transition from one screen
+ * to another, step 0 is from, step steps is to.
+ * effect: DCLM_TRANS_*
+ */
+extern void
+dclmScrTransition(DCLEDMatrixScreen *dst, const DCLEDMatrixScreen *from, const DCLEDMatrixScreen *to,
+		  int effect, unsigned int step, unsigned int steps);
+
 /****************************************************************************
  * DCLM API                                                                 *
  ****************************************************************************/ 
 
+/* options: "key=value" pairs, separated by ',' or white space:
+ *   path=<hidapi device path>  open exactly this device
+ *   serial=<serial number>     open the device with this serial number
+ *   virtual=1                  do not open a device, screens are sent nowhere
+ * default is the first device found.
+ */
 extern DCLEDMatrix *
 dclmOpen(const char *options);
 
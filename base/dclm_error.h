@@ -43,6 +43,9 @@ typedef enum {
 	DCLMD_NOT_CONNECTED=0x1000,
 	DCLMD_COMMUNICATION_ERROR,
 	DCLMD_COMMUNICATION_TIMEOUT,
+	DCLMD_NOT_SUPPORTED,
+	DCLMD_IMAGE_TOO_LARGE,
+	DCLMD_COMMUNICATION_BUSY,
 } DCLEDMatrixError;
 
 #ifdef __cplusplus
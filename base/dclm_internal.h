@@ -31,6 +31,7 @@ extern "C" {
 #define DCLM_VENDOR_ID 0x1d34
 #define DCLM_PRODUCT_ID 0x0013
 #define DCLM_RETRY_DETACH 5
+#define DCLM_MAX_OPTION_LEN 256
 
 #define DCLM_REPORT_SEND 0x09
 #define DCLM_RT_OUTPUT 0x02
@@ -65,6 +66,7 @@ struct DCLEDMatrixScreen_s {
 
 /* flags */
 #define DCLM_OPEN	0x1 /* device is opened */
+#define DCLM_VIRTUAL	0x2 /* there is no device, frames go nowhere */
 #define DCLM_FLAGS_DEFAULT 0
 
 #ifdef __cplusplus
@@ -0,0 +1,428 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dclm_anim.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define ANIM_MAX_DURATION 0xffff
+
+/****************************************************************************
+ * INTERNAL: ENCODING                                                       *
+ ****************************************************************************/
+
+static unsigned int
+anim_get16(const uint8_t *ptr)
+{
+	return (unsigned int)ptr[0] | ((unsigned int)ptr[1] << 8);
+}
+
+static uint32_t
+anim_get32(const uint8_t *ptr)
+{
+	return (uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) | ((uint32_t)ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+}
+
+static uint8_t *
+anim_put16(uint8_t *ptr, unsigned int value)
+{
+	ptr[0] = (uint8_t)(value & 0xff);
+	ptr[1] = (uint8_t)((value >> 8) & 0xff);
+	return ptr + 2;
+}
+
+static uint8_t *
+anim_put32(uint8_t *ptr, uint32_t value)
+{
+	ptr = anim_put16(ptr, value & 0xffff);
+	return anim_put16(ptr, value >> 16);
+}
+
+/* run length encode DCLM_SCR_DATA_SIZE bytes into dst
+ * (at least 2*DCLM_SCR_DATA_SIZE bytes)
+ * RETURN: the encoded size
+ */
+static size_t
+anim_rle(uint8_t *dst, const uint8_t *src)
+{
+	size_t len = 0;
+	size_t i, run;
+
+	for (i = 0; i < DCLM_SCR_DATA_SIZE; i += run) {
+		for (run = 1; i + run < DCLM_SCR_DATA_SIZE && src[i+run] == src[i]; run++);
+		dst[len++] = (uint8_t)run;
+		dst[len++] = src[i];
+	}
+	return len;
+}
+
+/* decode a frame onto screen
+ * RETURN 0: OK
+ *       -1: malformed
+ */
+static int
+anim_decode(uint8_t *screen, const uint8_t *src, size_t size, unsigned int encoding)
+{
+	size_t pos = 0;
+	size_t i, j, n;
+
+	if (encoding == DCLM_ANIM_ENC_RAW) {
+		if (size != DCLM_SCR_DATA_SIZE) {
+			return -1;
+		}
+		memcpy(screen, src, DCLM_SCR_DATA_SIZE);
+		return 0;
+	}
+	if (encoding != DCLM_ANIM_ENC_RLE && encoding != DCLM_ANIM_ENC_DELTA) {
+		return -1;
+	}
+
+	for (i = 0; i + 1 < size; i += 2) {
+		n = src[i];
+		if (n > DCLM_SCR_DATA_SIZE - pos) {
+			return -1;
+		}
+		if (encoding == DCLM_ANIM_ENC_RLE) {
+			memset(screen + pos, src[i+1], n);
+		} else {
+			for (j = 0; j < n; j++) {
+				screen[pos + j] ^= src[i+1];
+			}
+		}
+		pos += n;
+	}
+	return (pos == DCLM_SCR_DATA_SIZE && i == size)?0:-1;
+}
+
+/****************************************************************************
+ * Playing animations                                                       *
+ ****************************************************************************/
+
+static const uint8_t *
+anim_entry(const DCLMAnim *anim, unsigned int frame)
+{
+	return anim->index + (size_t)frame * DCLM_ANIM_INDEX_SIZE;
+}
+
+/* decode frame onto anim->screen, which must hold the previous
+ * frame for a delta frame */
+static int
+anim_apply(DCLMAnim *anim, unsigned int frame)
+{
+	const uint8_t *entry = anim_entry(anim, frame);
+	uint32_t offset = anim_get32(entry);
+	unsigned int size = anim_get16(entry + 4);
+
+	if (offset > anim->data_size || size > anim->data_size - offset) {
+		return -1;
+	}
+	return anim_decode(anim->screen, anim->data + offset, size, entry[8]);
+}
+
+/* read the whole file fd of size bytes into buf
+ * RETURN: 0: OK
+ *        -1: error, or the file changed its size
+ */
+static int
+anim_read(int fd, uint8_t *buf, size_t size)
+{
+	size_t pos = 0;
+	ssize_t res;
+
+	while (pos < size) {
+		res = read(fd, buf + pos, size - pos);
+		if (res > 0) {
+			pos += (size_t)res;
+		} else if (res == 0 || errno != EINTR) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+extern DCLMAnim *
+dclmAnimOpen(const char *path)
+{
+	DCLMAnim *anim;
+	struct stat st;
+	const uint8_t *hdr;
+	uint32_t index_offset, data_offset, data_size;
+	int fd;
+
+	/* O_NONBLOCK: opening a FIFO must not wait for a writer */
+	fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+	    st.st_size < DCLM_ANIM_HEADER_SIZE || st.st_size > (off_t)DCLM_ANIM_MAX_SIZE) {
+		close(fd);
+		return NULL;
+	}
+
+	anim = malloc(sizeof(*anim));
+	if (!anim) {
+		close(fd);
+		return NULL;
+	}
+	anim->file_size = (size_t)st.st_size;
+	anim->file = malloc(anim->file_size);
+	if (!anim->file || anim_read(fd, anim->file, anim->file_size)) {
+		close(fd);
+		dclmAnimClose(anim);
+		return NULL;
+	}
+	close(fd);
+
+	hdr = anim->file;
+	anim->frame_count = anim_get32(hdr + 12);
+	index_offset = anim_get32(hdr + 16);
+	data_offset = anim_get32(hdr + 20);
+	data_size = anim_get32(hdr + 24);
+	if (memcmp(hdr, DCLM_ANIM_MAGIC, 8) || anim_get16(hdr + 8) != DCLM_ANIM_VERSION ||
+	    !anim->frame_count ||
+	    index_offset > anim->file_size ||
+	    anim->frame_count > (anim->file_size - index_offset) / DCLM_ANIM_INDEX_SIZE ||
+	    data_offset > anim->file_size || data_size > anim->file_size - data_offset) {
+		dclmAnimClose(anim);
+		return NULL;
+	}
+	anim->index = anim->file + index_offset;
+	anim->data = anim->file + data_offset;
+	anim->data_size = data_size;
+
+	/* decode the first frame, it is never a delta frame */
+	anim->frame = 0;
+	if (anim_entry(anim, 0)[8] == DCLM_ANIM_ENC_DELTA || anim_apply(anim, 0)) {
+		dclmAnimClose(anim);
+		return NULL;
+	}
+	return anim;
+}
+
+extern void
+dclmAnimClose(DCLMAnim *anim)
+{
+	if (anim) {
+		free(anim->file);
+		free(anim);
+	}
+}
+
+extern unsigned int
+dclmAnimDuration(const DCLMAnim *anim, unsigned int frame)
+{
+	return anim_get16(anim_entry(anim, frame) + 6);
+}
+
+extern int
+dclmAnimSeek(DCLMAnim *anim, unsigned int frame)
+{
+	unsigned int key;
+
+	if (frame >= anim->frame_count) {
+		return -1;
+	}
+	if (frame == anim->frame) {
+		return 0;
+	}
+
+	if (frame == anim->frame + 1) {
+		/* forward by one: a delta applies directly */
+		if (anim_apply(anim, frame)) {
+			return -1;
+		}
+	} else if (frame + 1 == anim->frame && anim_entry(anim, anim->frame)[8] == DCLM_ANIM_ENC_DELTA) {
+		/* backward by one: XOR deltas are their own inverse */
+		if (anim_apply(anim, anim->frame)) {
+			return -1;
+		}
+	} else {
+		/* start over at the last key frame */
+		for (key = frame; key > 0 && anim_entry(anim, key)[8] == DCLM_ANIM_ENC_DELTA; key--);
+		for (; key <= frame; key++) {
+			if (anim_apply(anim, key)) {
+				return -1;
+			}
+		}
+	}
+	anim->frame = frame;
+	return 0;
+}
+
+/****************************************************************************
+ * Writing animations                                                       *
+ ****************************************************************************/
+
+/* make room for n more bytes
+ * RETURN: 0: OK
+ *        -1: out of memory
+ */
+static int
+writer_reserve(uint8_t **buf, size_t *capacity, size_t used, size_t n)
+{
+	size_t cap = *capacity;
+	uint8_t *ptr;
+
+	if (used + n <= cap) {
+		return 0;
+	}
+	while (used + n > cap) {
+		cap = (cap)?2*cap:1024;
+	}
+	ptr = realloc(*buf, cap);
+	if (!ptr) {
+		return -1;
+	}
+	*buf = ptr;
+	*capacity = cap;
+	return 0;
+}
+
+extern void
+dclmAnimWriterInit(DCLMAnimWriter *w)
+{
+	w->index = NULL;
+	w->data = NULL;
+	w->index_capacity = 0;
+	w->data_size = 0;
+	w->data_capacity = 0;
+	w->frame_count = 0;
+	w->since_key = 0;
+}
+
+extern void
+dclmAnimWriterCleanup(DCLMAnimWriter *w)
+{
+	free(w->index);
+	free(w->data);
+	dclmAnimWriterInit(w);
+}
+
+extern int
+dclmAnimWriterAdd(DCLMAnimWriter *w, const uint8_t *screen, unsigned int duration_ms)
+{
+	uint8_t rle[2*DCLM_SCR_DATA_SIZE];
+	uint8_t delta[2*DCLM_SCR_DATA_SIZE];
+	uint8_t diff[DCLM_SCR_DATA_SIZE];
+	const uint8_t *enc;
+	uint8_t *entry;
+	size_t size, delta_size = 0;
+	unsigned int encoding, d;
+	int i;
+
+	if (w->frame_count && !memcmp(screen, w->prev, DCLM_SCR_DATA_SIZE)) {
+		/* same as before: just extend the previous frame */
+		entry = w->index + (size_t)(w->frame_count - 1) * DCLM_ANIM_INDEX_SIZE;
+		d = anim_get16(entry + 6);
+		if (d + duration_ms <= ANIM_MAX_DURATION) {
+			anim_put16(entry + 6, d + duration_ms);
+			return 0;
+		}
+	}
+	while (duration_ms > ANIM_MAX_DURATION) {
+		if (dclmAnimWriterAdd(w, screen, ANIM_MAX_DURATION)) {
+			return -1;
+		}
+		duration_ms -= ANIM_MAX_DURATION;
+	}
+
+	/* pick the smallest encoding */
+	enc = screen;
+	size = DCLM_SCR_DATA_SIZE;
+	encoding = DCLM_ANIM_ENC_RAW;
+	d = (unsigned int)anim_rle(rle, screen);
+	if (d < size) {
+		enc = rle;
+		size = d;
+		encoding = DCLM_ANIM_ENC_RLE;
+	}
+	if (w->frame_count && w->since_key + 1 < DCLM_ANIM_KEY_INTERVAL) {
+		for (i = 0; i < DCLM_SCR_DATA_SIZE; i++) {
+			diff[i] = screen[i] ^ w->prev[i];
+		}
+		delta_size = anim_rle(delta, diff);
+		if (delta_size < size) {
+			enc = delta;
+			size = delta_size;
+			encoding = DCLM_ANIM_ENC_DELTA;
+		}
+	}
+
+	if (writer_reserve(&w->data, &w->data_capacity, w->data_size, size) ||
+	    writer_reserve(&w->index, &w->index_capacity, (size_t)w->frame_count * DCLM_ANIM_INDEX_SIZE, DCLM_ANIM_INDEX_SIZE)) {
+		return -1;
+	}
+
+	entry = w->index + (size_t)w->frame_count * DCLM_ANIM_INDEX_SIZE;
+	memset(entry, 0, DCLM_ANIM_INDEX_SIZE);
+	anim_put16(anim_put16(anim_put32(entry, (uint32_t)w->data_size), (unsigned int)size), duration_ms);
+	entry[8] = (uint8_t)encoding;
+	memcpy(w->data + w->data_size, enc, size);
+	w->data_size += size;
+	w->frame_count++;
+	w->since_key = (encoding == DCLM_ANIM_ENC_DELTA)?w->since_key + 1:0;
+	memcpy(w->prev, screen, DCLM_SCR_DATA_SIZE);
+	return 0;
+}
+
+extern int
+dclmAnimWriterAddImage(DCLMAnimWriter *w, const DCLMImage *img, unsigned int duration_ms)
+{
+	uint8_t screen[DCLM_SCR_DATA_SIZE];
+
+	dclmScrDataFromImg(screen, img);
+	return dclmAnimWriterAdd(w, screen, duration_ms);
+}
+
+extern int
+dclmAnimWriterSave(const DCLMAnimWriter *w, const char *path)
+{
+	uint8_t hdr[DCLM_ANIM_HEADER_SIZE];
+	size_t index_size = (size_t)w->frame_count * DCLM_ANIM_INDEX_SIZE;
+	uint8_t *ptr;
+	FILE *file;
+	int res = 0;
+
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, DCLM_ANIM_MAGIC, 8);
+	ptr = anim_put16(hdr + 8, DCLM_ANIM_VERSION);
+	ptr = anim_put16(ptr, 0);
+	ptr = anim_put32(ptr, w->frame_count);
+	ptr = anim_put32(ptr, DCLM_ANIM_HEADER_SIZE);
+	ptr = anim_put32(ptr, (uint32_t)(DCLM_ANIM_HEADER_SIZE + index_size));
+	anim_put32(ptr, (uint32_t)w->data_size);
+
+	file = fopen(path, "wb");
+	if (!file) {
+		return -1;
+	}
+	if (fwrite(hdr, sizeof(hdr), 1, file) != 1 ||
+	    (index_size && fwrite(w->index, index_size, 1, file) != 1) ||
+	    (w->data_size && fwrite(w->data, w->data_size, 1, file) != 1)) {
+		res = -1;
+	}
+	if (fclose(file)) {
+		res = -1;
+	}
+	return res;
+}
+
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DCLM_ANIM_H
+#define DCLM_ANIM_H
+
+#include "dclm.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************
+ * FILE FORMAT                                                              *
+ ****************************************************************************/
+
+/* An animation file is a sequence of packed screens (see
+ * dclmScrGetData()), each with its own duration.
+ * All values are little endian.
+ *
+ * header (DCLM_ANIM_HEADER_SIZE bytes):
+ *   magic[8]        DCLM_ANIM_MAGIC
+ *   u16 version     DCLM_ANIM_VERSION
+ *   u16 flags       0
+ *   u32 frame_count
+ *   u32 index_offset
+ *   u32 data_offset
+ *   u32 data_size
+ *   u32 reserved    0
+ * index (frame_count entries of DCLM_ANIM_INDEX_SIZE bytes):
+ *   u32 offset      of the frame data, relative to data_offset
+ *   u16 size        of the frame data in bytes
+ *   u16 duration_ms
+ *   u8  encoding    DCLM_ANIM_ENC_*
+ *   u8  reserved[3]
+ * data: the encoded frames
+ *
+ * The first frame is never a delta frame.
+ */
+#define DCLM_ANIM_MAGIC		"DCLMANIM"
+#define DCLM_ANIM_VERSION	1
+#define DCLM_ANIM_HEADER_SIZE	32
+#define DCLM_ANIM_INDEX_SIZE	12
+#define DCLM_ANIM_MAX_SIZE	(4u<<20)	/* larger files are rejected */
+
+#define DCLM_ANIM_ENC_RAW	0	/* the DCLM_SCR_DATA_SIZE bytes as is */
+#define DCLM_ANIM_ENC_RLE	1	/* (count, byte) pairs */
+#define DCLM_ANIM_ENC_DELTA	2	/* (count, byte) pairs, XOR with the previous frame */
+
+#define DCLM_ANIM_KEY_INTERVAL	64	/* maximum distance between non-delta frames */
+
+/****************************************************************************
+ * DATA TYPES                                                               *
+ ****************************************************************************/
+
+/* an animation file read into memory */
+typedef struct {
+	uint8_t *file;
+	size_t file_size;
+	const uint8_t *index;
+	const uint8_t *data;
+	size_t data_size;
+	unsigned int frame_count;
+	unsigned int frame; /* frame decoded into screen */
+	uint8_t screen[DCLM_SCR_DATA_SIZE];
+} DCLMAnim;
+
+/* an animation under construction */
+typedef struct {
+	uint8_t *index;
+	uint8_t *data;
+	size_t index_capacity;
+	size_t data_size;
+	size_t data_capacity;
+	unsigned int frame_count;
+	unsigned int since_key; /* frames since the last non-delta frame */
+	uint8_t prev[DCLM_SCR_DATA_SIZE];
+} DCLMAnimWriter;
+
+/****************************************************************************
+ * Playing animations                                                       *
+ ****************************************************************************/
+
+/* Read an animation file into memory. Only regular files are opened,
+ * and nothing that would block, so the file can't stall or later crash
+ * the caller whatever it is replaced with.
+ * RETURN: the animation, NULL if it can't be read or is malformed
+ */
+extern DCLMAnim *
+dclmAnimOpen(const char *path);
+
+extern void
+dclmAnimClose(DCLMAnim *anim);
+
+/* Get the duration of frame in ms */
+extern unsigned int
+dclmAnimDuration(const DCLMAnim *anim, unsigned int frame);
+
+/* Decode frame into anim->screen. Stepping to the next or
+ * the previous frame only applies the delta.
+ * RETURN: 0: OK
+ *        -1: malformed frame
+ */
+extern int
+dclmAnimSeek(DCLMAnim *anim, unsigned int frame);
+
+/****************************************************************************
+ * Writing animations                                                       *
+ ****************************************************************************/
+
+extern void
+dclmAnimWriterInit(DCLMAnimWriter *w);
+
+extern void
+dclmAnimWriterCleanup(DCLMAnimWriter *w);
+
+/* Append a frame of packed screen data (DCLM_SCR_DATA_SIZE bytes),
+ * a frame equal to the previous one just extends its duration.
+ * RETURN: 0: OK
+ *        -1: out of memory
+ */
+extern int
+dclmAnimWriterAdd(DCLMAnimWriter *w, const uint8_t *screen, unsigned int duration_ms);
+
+/* Append an image, see dclmScrDataFromImg() */
+extern int
+dclmAnimWriterAddImage(DCLMAnimWriter *w, const DCLMImage *img, unsigned int duration_ms);
+
+/* Write the animation to a file
+ * RETURN: 0: OK
+ *        -1: error, see errno
+ */
+extern int
+dclmAnimWriterSave(const DCLMAnimWriter *w, const char *path);
+
+#ifdef __cplusplus
+}	/* extern "C" */
+#endif
+
+#endif /* !DCLM_ANIM_H */
+
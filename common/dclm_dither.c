@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dclm_dither.h"
+
+#include <string.h>
+
+/* Every mode works row by row: a row of the source is turned into a row
+ * of 0 and 0xff, which either is the row of the destination image or
+ * gets packed into bits. Nothing but the state of the mode is kept. */
+
+/****************************************************************************
+ * THRESHOLD MATRICES                                                       *
+ ****************************************************************************/
+
+/* The matrices hold thresholds from 1 to 255, so 0 is always dark and
+ * 255 always lit, and the average of a flat area is kept. */
+
+/* 8x8 Bayer: 4*index + 2 */
+static const uint8_t bayer8[8][8] = {
+	{  2, 130,  34, 162,  10, 138,  42, 170},
+	{194,  66, 226,  98, 202,  74, 234, 106},
+	{ 50, 178,  18, 146,  58, 186,  26, 154},
+	{242, 114, 210,  82, 250, 122, 218,  90},
+	{ 14, 142,  46, 174,   6, 134,  38, 166},
+	{206,  78, 238, 110, 198,  70, 230, 102},
+	{ 62, 190,  30, 158,  54, 182,  22, 150},
+	{254, 126, 222,  94, 246, 118, 214,  86}
+};
+
+/* 16x16 blue noise: the ranks of a void-and-cluster pattern
+ * (gaussian sigma 1.5, tiling), scaled to 1 + rank*254/255 */
+static const uint8_t blue16[16][16] = {
+	{234,  50, 188,  19,  58, 171, 121,  47, 163,   2, 247, 104,  22, 132,  14,  65},
+	{209,   8, 118,  97, 240, 205,  23, 228, 138,  64, 123, 170,  72, 224,  99, 149},
+	{ 85, 139, 229, 165,  78, 146, 111,  84, 176, 216,  30, 231, 153, 201,  42, 180},
+	{ 25,  62, 195,  29,  43, 185,   7, 249,  41, 100, 191,  48,  87,   5, 128, 243},
+	{221, 152, 101, 253, 130, 220,  59, 200, 156,  12, 136, 112, 255, 174,  69, 109},
+	{ 46, 189,   3,  73, 172,  90, 142, 116,  80, 237, 210,  61, 147,  33, 206, 160},
+	{ 81, 124, 217, 113, 208,  15, 241,  27, 168,  45, 178,  20, 193,  96, 225,  18},
+	{242, 164,  60,  35, 157,  53, 181,  68, 223, 105, 125,  83, 236, 131,  55, 141},
+	{197,  10, 227, 134, 246,  95, 126, 198, 148,   1, 244, 161,  71,   9, 182, 106},
+	{ 40,  93, 179,  75, 192,   6, 218,  36,  91,  57, 202,  34, 215, 155, 233,  74},
+	{252, 120, 150,  24, 110,  63, 166, 119, 232, 183, 133, 103,  49, 117,  31, 167},
+	{ 16, 212,  51, 238, 207, 137, 254,  21,  76, 151,  13, 250, 190,  88, 203, 135},
+	{102, 184,  82, 169,  38,  89, 187,  52, 204,  98, 173,  67, 129,   4, 222,  56},
+	{230, 144,   1, 127, 226,  11, 154, 114, 239,  39, 219,  28, 235, 145, 175,  77},
+	{196,  37, 248,  70, 107, 199,  66, 177,  17, 143, 115, 159,  86,  44, 108,  26},
+	{122,  92, 158, 214, 140,  32, 245,  94, 213,  79, 194,  54, 211, 186, 251, 162}
+};
+
+/****************************************************************************
+ * BUFFERS                                                                  *
+ ****************************************************************************/
+
+static void
+dither_free(DCLMDither *d)
+{
+	free(d->error);
+	free(d->prev);
+	free(d->row);
+	d->error = NULL;
+	d->prev = NULL;
+	d->row = NULL;
+	d->dims[0] = d->dims[1] = 0;
+	d->prev_valid = 0;
+}
+
+/* make sure the buffers of the mode fit images of the size of src
+ * RETURN: 0: OK
+ *        -1: out of memory
+ */
+static int
+dither_setup(DCLMDither *d, const DCLMImage *src, int need_row)
+{
+	size_t w = src->dims[0];
+	size_t h = src->dims[1];
+
+	if (d->dims[0] != w || d->dims[1] != h) {
+		dither_free(d);
+		d->dims[0] = w;
+		d->dims[1] = h;
+	}
+	if (d->mode == DCLM_DITHER_FLOYD && !d->error) {
+		/* a guard entry on each side */
+		d->error = malloc(2 * (w + 2) * sizeof(*d->error));
+		if (!d->error) {
+			return -1;
+		}
+	}
+	if (d->mode == DCLM_DITHER_TEMPORAL && !d->prev) {
+		d->prev = malloc(w * h);
+		d->prev_valid = 0;
+		if (!d->prev) {
+			return -1;
+		}
+	}
+	if (need_row && !d->row) {
+		d->row = malloc(w);
+		if (!d->row) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/****************************************************************************
+ * MODES                                                                    *
+ ****************************************************************************/
+
+static int
+clamp_level(int value)
+{
+	return (value < 0)?0:((value > 255)?255:value);
+}
+
+/* the shift of the ordered matrices by the threshold */
+static int
+dither_bias(const DCLMDither *d)
+{
+	return clamp_level(d->threshold) - 128;
+}
+
+static void
+row_threshold(const DCLMDither *d, const uint8_t *in, uint8_t *out, size_t w)
+{
+	int t = clamp_level(d->threshold);
+	size_t x;
+
+	/* 0 stays dark */
+	if (!t) {
+		t = 1;
+	}
+	for (x = 0; x < w; x++) {
+		out[x] = (in[x] >= t)?0xff:0;
+	}
+}
+
+static void
+row_bayer(const DCLMDither *d, const uint8_t *in, uint8_t *out, size_t w, size_t y)
+{
+	const uint8_t *m = bayer8[y & 7];
+	int bias = dither_bias(d);
+	size_t x;
+
+	for (x = 0; x < w; x++) {
+		out[x] = ((int)in[x] >= m[x & 7] + bias)?0xff:0;
+	}
+}
+
+static void
+row_blue_noise(const DCLMDither *d, const uint8_t *in, uint8_t *out, size_t w, size_t y)
+{
+	const uint8_t *m = blue16[y & 15];
+	int bias = dither_bias(d);
+	size_t x;
+
+	for (x = 0; x < w; x++) {
+		out[x] = ((int)in[x] >= m[x & 15] + bias)?0xff:0;
+	}
+}
+
+/* blue noise, but each pixel must be hysteresis beyond its threshold
+ * to change the state it had in the last frame */
+static void
+row_temporal(DCLMDither *d, const uint8_t *in, uint8_t *out, size_t w, size_t y)
+{
+	const uint8_t *m = blue16[y & 15];
+	uint8_t *prev = d->prev + y * w;
+	int bias = dither_bias(d);
+	int h = (d->prev_valid)?d->hysteresis:0;
+	size_t x;
+	int t;
+
+	for (x = 0; x < w; x++) {
+		t = m[x & 15] + bias;
+		t += (prev[x])?-h:h;
+		out[x] = prev[x] = ((int)in[x] >= t)?0xff:0;
+	}
+}
+
+/* Floyd-Steinberg, the errors are in 1/16 levels, rows alternate
+ * their direction, so the errors do not drift to one side */
+static void
+row_floyd(DCLMDither *d, const uint8_t *in, uint8_t *out, size_t w, size_t y)
+{
+	int *cur = d->error + ((y & 1) ? (w + 2) : 0) + 1;
+	int *next = d->error + ((y & 1) ? 0 : (w + 2)) + 1;
+	int t = 16 * clamp_level(d->threshold);
+	int dir = (y & 1)?-1:1;
+	int value, err;
+	size_t i, x;
+
+	if (!y) {
+		memset(d->error, 0, 2 * (w + 2) * sizeof(*d->error));
+	}
+	memset(next - 1, 0, (w + 2) * sizeof(*next));
+	for (i = 0; i < w; i++) {
+		x = (dir > 0)?i:w-1-i;
+		value = 16 * in[x] + cur[x];
+		if (value >= t && in[x]) {
+			out[x] = 0xff;
+			err = value - 16*255;
+		} else {
+			out[x] = 0;
+			err = value;
+		}
+		/* 7/16 ahead, 3/16, 5/16, 1/16 below */
+		cur[(long)x + dir] += (err * 7) / 16;
+		next[(long)x - dir] += (err * 3) / 16;
+		next[x] += (err * 5) / 16;
+		next[(long)x + dir] += err / 16;
+	}
+}
+
+static void
+dither_row(DCLMDither *d, const uint8_t *in, uint8_t *out, size_t w, size_t y)
+{
+	switch (d->mode) {
+		case DCLM_DITHER_BAYER:
+			row_bayer(d, in, out, w, y);
+			break;
+		case DCLM_DITHER_FLOYD:
+			row_floyd(d, in, out, w, y);
+			break;
+		case DCLM_DITHER_BLUE_NOISE:
+			row_blue_noise(d, in, out, w, y);
+			break;
+		case DCLM_DITHER_TEMPORAL:
+			row_temporal(d, in, out, w, y);
+			break;
+		default:
+			row_threshold(d, in, out, w);
+	}
+}
+
+/****************************************************************************
+ * Dithering                                                                *
+ ****************************************************************************/
+
+extern void
+dclmDitherInit(DCLMDither *d, int mode)
+{
+	memset(d, 0, sizeof(*d));
+	d->mode = mode;
+	d->threshold = DCLM_DITHER_DEFAULT_THRESHOLD;
+	d->hysteresis = DCLM_DITHER_DEFAULT_HYSTERESIS;
+}
+
+extern void
+dclmDitherCleanup(DCLMDither *d)
+{
+	dither_free(d);
+}
+
+extern void
+dclmDitherReset(DCLMDither *d)
+{
+	d->prev_valid = 0;
+}
+
+extern int
+dclmDither(DCLMDither *d, const DCLMImage *src, DCLMImage *dst)
+{
+	size_t y;
+
+	if (dst->dims[0] < src->dims[0] || dst->dims[1] < src->dims[1]) {
+		return -1;
+	}
+	if (dither_setup(d, src, 0)) {
+		return -1;
+	}
+	for (y = 0; y < src->dims[1]; y++) {
+		dither_row(d, DCLM_IMG_PIXEL(src, 0, y), DCLM_IMG_PIXEL(dst, 0, y), src->dims[0], y);
+	}
+	d->prev_valid = (d->mode == DCLM_DITHER_TEMPORAL);
+	return 0;
+}
+
+extern int
+dclmDitherBits(DCLMDither *d, const DCLMImage *src, uint8_t *bits, size_t stride)
+{
+	size_t x, y;
+	uint8_t byte;
+
+	if (dither_setup(d, src, 1)) {
+		return -1;
+	}
+	for (y = 0; y < src->dims[1]; y++) {
+		dither_row(d, DCLM_IMG_PIXEL(src, 0, y), d->row, src->dims[0], y);
+		byte = 0;
+		for (x = 0; x < src->dims[0]; x++) {
+			byte |= (uint8_t)(d->row[x] & (0x80 >> (x & 7)));
+			if ((x & 7) == 7) {
+				bits[x >> 3] = byte;
+				byte = 0;
+			}
+		}
+		if (x & 7) {
+			bits[x >> 3] = byte;
+		}
+		bits += stride;
+	}
+	d->prev_valid = (d->mode == DCLM_DITHER_TEMPORAL);
+	return 0;
+}
+
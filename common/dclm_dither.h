@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DCLM_DITHER_H
+#define DCLM_DITHER_H
+
+#include "dclm_image.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************
+ * DATA TYPES                                                               *
+ ****************************************************************************/
+
+/* dithering modes */
+#define DCLM_DITHER_THRESHOLD	0	/* lit where the pixel reaches the threshold */
+#define DCLM_DITHER_BAYER	1	/* ordered, 8x8 Bayer matrix */
+#define DCLM_DITHER_FLOYD	2	/* Floyd-Steinberg error diffusion, serpentine */
+#define DCLM_DITHER_BLUE_NOISE	3	/* ordered, 16x16 blue noise matrix */
+#define DCLM_DITHER_TEMPORAL	4	/* blue noise, a LED only toggles if the pixel
+					   moved past its threshold by the hysteresis */
+#define DCLM_DITHER_COUNT	5
+
+#define DCLM_DITHER_DEFAULT_THRESHOLD	128
+#define DCLM_DITHER_DEFAULT_HYSTERESIS	24
+
+/* The state of the dithering: the settings, and the buffers for the
+ * size of the last image, which are kept, so dithering frames of the
+ * same size again allocates nothing. */
+typedef struct {
+	int mode; /* DCLM_DITHER_* */
+	int threshold; /* 0 to 255: brightness at which LEDs turn on, for
+			  the ordered modes a shift of the matrix from 128 */
+	int hysteresis; /* DCLM_DITHER_TEMPORAL only */
+
+	size_t dims[2]; /* of the buffers */
+	int *error; /* DCLM_DITHER_FLOYD: two rows of errors */
+	uint8_t *prev; /* DCLM_DITHER_TEMPORAL: the last output */
+	int prev_valid;
+	uint8_t *row; /* output row for dclmDitherBits() */
+} DCLMDither;
+
+/****************************************************************************
+ * Dithering                                                                *
+ ****************************************************************************/
+
+/* mode: DCLM_DITHER_*, the threshold and the hysteresis get their
+ * defaults and may be changed in the structure at any time */
+extern void
+dclmDitherInit(DCLMDither *d, int mode);
+
+extern void
+dclmDitherCleanup(DCLMDither *d);
+
+/* Forget the last frame of DCLM_DITHER_TEMPORAL, e.g. on a cut */
+extern void
+dclmDitherReset(DCLMDither *d);
+
+/* Dither a gray image (0 to 255) to lit (0xff) and dark (0) pixels
+ * dst: at least the size of src, may be src itself
+ * RETURN: 0: OK
+ *        -1: out of memory, or dst too small
+ */
+extern int
+dclmDither(DCLMDither *d, const DCLMImage *src, DCLMImage *dst);
+
+/* Dither a gray image into a bitmap: one bit per pixel, the leftmost
+ * pixel in the most significant bit, set for lit pixels (as PBM P4).
+ * stride: bytes from one row of bits to the next
+ * RETURN: 0: OK
+ *        -1: out of memory
+ */
+extern int
+dclmDitherBits(DCLMDither *d, const DCLMImage *src, uint8_t *bits, size_t stride);
+
+#ifdef __cplusplus
+}	/* extern "C" */
+#endif
+
+#endif /* !DCLM_DITHER_H */
+
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dclm_dlist.h"
+
+#include <string.h>
+
+/****************************************************************************
+ * INTERNAL: ENCODING                                                       *
+ ****************************************************************************/
+
+/* reserve n bytes at the end of the list
+ * RETURN: pointer to the reserved bytes, NULL if full
+ */
+static uint8_t *
+dlist_reserve(DCLMDisplayList *dl, size_t n)
+{
+	uint8_t *ptr;
+
+	if (n > dl->size - dl->len) {
+		return NULL;
+	}
+	ptr = dl->data + dl->len;
+	dl->len += n;
+	return ptr;
+}
+
+static uint8_t *
+dlist_put16(uint8_t *ptr, int value)
+{
+	ptr[0] = (uint8_t)(value & 0xff);
+	ptr[1] = (uint8_t)((value >> 8) & 0xff);
+	return ptr + 2;
+}
+
+static int
+dlist_get16(const uint8_t *ptr)
+{
+	return (int)(int16_t)(uint16_t)(ptr[0] | (ptr[1] << 8));
+}
+
+/****************************************************************************
+ * Building display lists                                                   *
+ ****************************************************************************/
+
+extern void
+dclmDListInit(DCLMDisplayList *dl, uint8_t *buf, size_t size)
+{
+	dl->data = buf;
+	dl->size = size;
+	dl->len = 0;
+}
+
+extern int
+dclmDListClear(DCLMDisplayList *dl, unsigned int value)
+{
+	uint8_t *ptr = dlist_reserve(dl, 2);
+
+	if (!ptr) {
+		return -1;
+	}
+	ptr[0] = DCLM_DL_CLEAR;
+	ptr[1] = (uint8_t)value;
+	return 0;
+}
+
+extern int
+dclmDListText(DCLMDisplayList *dl, int x, unsigned int font, const char *str, size_t len)
+{
+	uint8_t *ptr;
+
+	if (!len) {
+		len = strlen(str);
+	}
+	if (len > 255) {
+		len = 255;
+	}
+
+	ptr = dlist_reserve(dl, 5 + len);
+	if (!ptr) {
+		return -1;
+	}
+	ptr[0] = DCLM_DL_TEXT;
+	ptr = dlist_put16(ptr + 1, x);
+	ptr[0] = (uint8_t)font;
+	ptr[1] = (uint8_t)len;
+	memcpy(ptr + 2, str, len);
+	return 0;
+}
+
+extern int
+dclmDListBlit(DCLMDisplayList *dl, int from_x, int from_y, int to_x, int to_y, int w, int h)
+{
+	uint8_t *ptr = dlist_reserve(dl, 13);
+
+	if (!ptr) {
+		return -1;
+	}
+	ptr[0] = DCLM_DL_BLIT;
+	ptr = dlist_put16(ptr + 1, from_x);
+	ptr = dlist_put16(ptr, from_y);
+	ptr = dlist_put16(ptr, to_x);
+	ptr = dlist_put16(ptr, to_y);
+	ptr = dlist_put16(ptr, w);
+	dlist_put16(ptr, h);
+	return 0;
+}
+
+extern int
+dclmDListSpan(DCLMDisplayList *dl, int x, int y, int w, unsigned int value)
+{
+	uint8_t *ptr = dlist_reserve(dl, 8);
+
+	if (!ptr) {
+		return -1;
+	}
+	ptr[0] = DCLM_DL_SPAN;
+	ptr = dlist_put16(ptr + 1, x);
+	ptr = dlist_put16(ptr, y);
+	ptr = dlist_put16(ptr, w);
+	ptr[0] = (uint8_t)value;
+	return 0;
+}
+
+extern int
+dclmDListRect(DCLMDisplayList *dl, int x, int y, int w, int h, unsigned int value)
+{
+	uint8_t *ptr = dlist_reserve(dl, 10);
+
+	if (!ptr) {
+		return -1;
+	}
+	ptr[0] = DCLM_DL_RECT;
+	ptr = dlist_put16(ptr + 1, x);
+	ptr = dlist_put16(ptr, y);
+	ptr = dlist_put16(ptr, w);
+	ptr = dlist_put16(ptr, h);
+	ptr[0] = (uint8_t)value;
+	return 0;
+}
+
+extern int
+dclmDListPixel(DCLMDisplayList *dl, int x, int y, unsigned int value)
+{
+	uint8_t *ptr = dlist_reserve(dl, 6);
+
+	if (!ptr) {
+		return -1;
+	}
+	ptr[0] = DCLM_DL_PIXEL;
+	ptr = dlist_put16(ptr + 1, x);
+	ptr = dlist_put16(ptr, y);
+	ptr[0] = (uint8_t)value;
+	return 0;
+}
+
+/****************************************************************************
+ * Decoding display lists                                                   *
+ ****************************************************************************/
+
+/* Decode the operation at *pos and advance *pos
+ * RETURN: 1: got an operation
+ *         0: end of the list
+ *        -1: malformed list
+ */
+extern int
+dclmDListNext(const uint8_t *data, size_t len, size_t *pos, DCLMDListOp *op)
+{
+	const uint8_t *ptr;
+	size_t avail, text_len;
+
+	if (*pos >= len) {
+		return 0;
+	}
+
+	/* the data may be changed by the client while it is decoded, so
+	 * every byte is read only once */
+	ptr = data + *pos;
+	avail = len - *pos;
+	op->op = ptr[0];
+
+	switch (op->op) {
+		case DCLM_DL_END:
+			*pos = len;
+			return 0;
+		case DCLM_DL_CLEAR:
+			if (avail < 2) {
+				return -1;
+			}
+			op->value = ptr[1];
+			*pos += 2;
+			break;
+		case DCLM_DL_TEXT:
+			if (avail < 5) {
+				return -1;
+			}
+			/* volatile: the compiler must not load it again */
+			text_len = ((const volatile uint8_t*)ptr)[4];
+			if (avail < 5 + text_len) {
+				return -1;
+			}
+			op->x = dlist_get16(ptr + 1);
+			op->value = ptr[3];
+			op->len = text_len;
+			op->text = (const char*)(ptr + 5);
+			*pos += 5 + op->len;
+			break;
+		case DCLM_DL_BLIT:
+			if (avail < 13) {
+				return -1;
+			}
+			op->from_x = dlist_get16(ptr + 1);
+			op->from_y = dlist_get16(ptr + 3);
+			op->x = dlist_get16(ptr + 5);
+			op->y = dlist_get16(ptr + 7);
+			op->w = dlist_get16(ptr + 9);
+			op->h = dlist_get16(ptr + 11);
+			*pos += 13;
+			break;
+		case DCLM_DL_SPAN:
+			if (avail < 8) {
+				return -1;
+			}
+			op->x = dlist_get16(ptr + 1);
+			op->y = dlist_get16(ptr + 3);
+			op->w = dlist_get16(ptr + 5);
+			op->h = 1;
+			op->value = ptr[7];
+			*pos += 8;
+			break;
+		case DCLM_DL_RECT:
+			if (avail < 10) {
+				return -1;
+			}
+			op->x = dlist_get16(ptr + 1);
+			op->y = dlist_get16(ptr + 3);
+			op->w = dlist_get16(ptr + 5);
+			op->h = dlist_get16(ptr + 7);
+			op->value = ptr[9];
+			*pos += 10;
+			break;
+		case DCLM_DL_PIXEL:
+			if (avail < 6) {
+				return -1;
+			}
+			op->x = dlist_get16(ptr + 1);
+			op->y = dlist_get16(ptr + 3);
+			op->value = ptr[5];
+			*pos += 6;
+			break;
+		default:
+			return -1;
+	}
+
+	return 1;
+}
+
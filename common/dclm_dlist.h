@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DCLM_DLIST_H
+#define DCLM_DLIST_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************
+ * DATA TYPES                                                               *
+ ****************************************************************************/
+
+/* A display list is a compact byte stream of drawing operations.
+ * Every operation starts with its opcode byte, followed by its
+ * parameters. Coordinates are signed 16 bit little endian values,
+ * pixel values are single bytes (0: off, 1: on, 2: toggle).
+ * The list ends with DCLM_DL_END or at the end of the data.
+ */
+#define DCLM_DL_END	0x00	/* */
+#define DCLM_DL_CLEAR	0x01	/* value */
+#define DCLM_DL_TEXT	0x02	/* x, font, len, len characters */
+#define DCLM_DL_BLIT	0x03	/* from_x, from_y, to_x, to_y, w, h: from the image */
+#define DCLM_DL_SPAN	0x04	/* x, y, w, value */
+#define DCLM_DL_RECT	0x05	/* x, y, w, h, value */
+#define DCLM_DL_PIXEL	0x06	/* x, y, value */
+
+/* the fonts */
+#define DCLM_DL_FONT_BASE 0
+
+/* a decoded operation */
+typedef struct {
+	unsigned int op;
+	int x,y,w,h;
+	int from_x, from_y;
+	unsigned int value;	/* pixel value or font */
+	const char *text;	/* not 0-terminated */
+	size_t len;
+} DCLMDListOp;
+
+/* a display list under construction */
+typedef struct {
+	uint8_t *data;
+	size_t size; /* capacity in bytes */
+	size_t len;  /* bytes used */
+} DCLMDisplayList;
+
+/****************************************************************************
+ * Building display lists                                                   *
+ ****************************************************************************/
+
+/* Start a new (empty) display list in buf of size bytes */
+extern void
+dclmDListInit(DCLMDisplayList *dl, uint8_t *buf, size_t size);
+
+/* All of the following append an operation
+ * RETURN: 0: OK
+ *        -1: display list is full, nothing appended
+ */
+extern int
+dclmDListClear(DCLMDisplayList *dl, unsigned int value);
+
+extern int
+dclmDListText(DCLMDisplayList *dl, int x, unsigned int font, const char *str, size_t len);
+
+extern int
+dclmDListBlit(DCLMDisplayList *dl, int from_x, int from_y, int to_x, int to_y, int w, int h);
+
+extern int
+dclmDListSpan(DCLMDisplayList *dl, int x, int y, int w, unsigned int value);
+
+extern int
+dclmDListRect(DCLMDisplayList *dl, int x, int y, int w, int h, unsigned int value);
+
+extern int
+dclmDListPixel(DCLMDisplayList *dl, int x, int y, unsigned int value);
+
+/****************************************************************************
+ * Decoding display lists                                                   *
+ ****************************************************************************/
+
+/* Decode the operation at *pos and advance *pos
+ * RETURN: 1: got an operation
+ *         0: end of the list
+ *        -1: malformed list
+ */
+extern int
+dclmDListNext(const uint8_t *data, size_t len, size_t *pos, DCLMDListOp *op);
+
+#ifdef __cplusplus
+}	/* extern "C" */
+#endif
+
+#endif /* !DCLM_DLIST_H */
+
@@ -16,6 +16,8 @@
 #include "dclm_font.h"
 #include "dclm_internal.h"
 
+#include <string.h>
+
 /****************************************************************************
  * FONTS                                                                    *
  ****************************************************************************/
@@ -357,3 +359,47 @@ dclmTextToScr(DCLEDMatrixScreen *scr, int x,  const char *str, size_t len, const
 	dclmScrClear(scr, 0);
 	dclmStringToScr(scr, x, str, len, font);
 }
+
+/****************************************************************************
+ * FONT TO IMAGE                                                            *
+ ****************************************************************************/
+
+extern size_t
+dclmStringWidth(const char *str, size_t len)
+{
+	if (!len) {
+		len=strlen(str);
+	}
+	return 5*len;
+}
+
+extern void
+dclmStringToImg(DCLMImage *img, int x, const char *str, size_t len, const uint8_t *font)
+{
+	const uint8_t *c;
+	size_t i;
+	int row, col, px;
+
+	if (!len) {
+		len=strlen(str);
+	}
+
+	for (i=0; i<len; i++, x+=5) {
+		if (x >= (int)img->dims[0]) {
+			break;
+		}
+		if (x <= -5) {
+			continue;
+		}
+		c=font + (unsigned char)str[i]*7;
+		for (row=0; row<7 && row<(int)img->dims[1]; row++) {
+			for (col=0; col<5; col++) {
+				px=x+col;
+				/* a cleared bit is a lit LED */
+				if (px >= 0 && px < (int)img->dims[0] && !(c[row] & (1<<col))) {
+					*DCLM_IMG_PIXEL(img, px, row)=0xff;
+				}
+			}
+		}
+	}
+}
@@ -18,6 +18,7 @@
 #define DCLM_FONT_H
 
 #include "dclm.h"
+#include "dclm_image.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,6 +52,24 @@ dclmStringToScr(DCLEDMatrixScreen *scr, int x, const char *str, size_t len, cons
 extern void 
 dclmTextToScr(DCLEDMatrixScreen *scr, int x, const char *str, size_t len, const uint8_t *font);
 
+/****************************************************************************
+ * FONT TO IMAGE                                                            *
+ ****************************************************************************/
+
+/* Get the width in pixels of a string
+ * If len is 0: use strlen
+ */
+extern size_t
+dclmStringWidth(const char *str, size_t len);
+
+/* Render a string into an image, at x and the top row,
+ * lit pixels are set to 0xff, the others are left unchanged.
+ * Anything outside of the image is clipped.
+ * If len is 0: use strlen
+ */
+extern void
+dclmStringToImg(DCLMImage *img, int x, const char *str, size_t len, const uint8_t *font);
+
 #ifdef __cplusplus
 }	/* extern "C" */
 #endif
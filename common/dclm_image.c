@@ -16,6 +16,8 @@
 
 #include "dclm_image.h"
 
+#include <ctype.h>
+
 /****************************************************************************
  * Creation, Destruction                                                    *
  ****************************************************************************/ 
@@ -97,3 +99,93 @@ dclmImageGetPixel(const DCLMImage *img, size_t x, size_t y)
 	return *DCLM_IMG_PIXEL(img,x,y);
 }
 
+/****************************************************************************
+ * File I/O                                                                 *
+ ****************************************************************************/ 
+
+/* read a number of the PBM header, skipping white space and comments
+ * RETURN: the number, -1 on error
+ */
+static long
+dclmImagePBMNumber(FILE *file)
+{
+	long value = 0;
+	int c;
+
+	do {
+		c = fgetc(file);
+		if (c == '#') {
+			while (c != EOF && c != '\n') {
+				c = fgetc(file);
+			}
+		}
+	} while (c != EOF && isspace(c));
+
+	if (!isdigit(c)) {
+		return -1;
+	}
+	while (isdigit(c)) {
+		value = 10*value + (c - '0');
+		if (value > 65535) {
+			return -1;
+		}
+		c = fgetc(file);
+	}
+	return value;
+}
+
+extern int
+dclmImageReadPBM(FILE *file, DCLMImage *img)
+{
+	long w, h, x, y;
+	int c, bit = 0;
+	int ascii;
+
+	do {
+		c = fgetc(file);
+	} while (c != EOF && isspace(c));
+	if (c == EOF) {
+		return 0;
+	}
+	if (c != 'P') {
+		return -1;
+	}
+	c = fgetc(file);
+	if (c != '1' && c != '4') {
+		return -1;
+	}
+	ascii = (c == '1');
+	w = dclmImagePBMNumber(file);
+	h = dclmImagePBMNumber(file);
+	if (w < 1 || h < 1) {
+		return -1;
+	}
+
+	dclmImageClear(img);
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			if (ascii) {
+				do {
+					c = fgetc(file);
+				} while (c != EOF && c != '0' && c != '1');
+				if (c == EOF) {
+					return -1;
+				}
+				bit = (c == '1');
+			} else {
+				if (!(x & 7)) {
+					c = fgetc(file);
+					if (c == EOF) {
+						return -1;
+					}
+				}
+				bit = (c >> (7 - (x & 7))) & 1;
+			}
+			if (bit && x < (long)img->dims[0] && y < (long)img->dims[1]) {
+				dclmImageSetPixel(img, (size_t)x, (size_t)y, 0xff);
+			}
+		}
+	}
+	return 1;
+}
+
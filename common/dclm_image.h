@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,6 +74,19 @@ dclmImageSetPixel(DCLMImage *img, size_t x, size_t y, uint8_t value);
 extern uint8_t
 dclmImageGetPixel(const DCLMImage *img, size_t x, size_t y);
 
+/****************************************************************************
+ * File I/O                                                                 *
+ ****************************************************************************/ 
+
+/* read the next image of a PBM file (P1 or P4) into img: larger images
+ * are cropped, smaller ones padded. Black pixels are lit LEDs.
+ * RETURN 1: got an image
+ *        0: end of file
+ *       -1: error
+ */
+extern int
+dclmImageReadPBM(FILE *file, DCLMImage *img);
+
 #ifdef __cplusplus
 }	/* extern "C" */
 #endif
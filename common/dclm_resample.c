@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dclm_resample.h"
+
+#include <string.h>
+
+/* The resampling is separable: for each destination row, the luma of
+ * the source rows it covers is weighted into a row accumulator, then
+ * each destination pixel is the weighted sum of the accumulator entries
+ * it covers. All loops over whole source rows are plain loops over
+ * restrict pointers without branches, which the compiler vectorizes;
+ * the horizontal pass only touches the few destination pixels.
+ *
+ * The weights of each destination pixel sum up to DCLM_RESAMPLE_ONE:
+ * the luma (* 256) times the weights of both axes fits into 64 bits,
+ * the accumulator of one axis into 32 bits.
+ */
+#define RESAMPLE_OUT_SHIFT	(2*DCLM_RESAMPLE_SHIFT + 8)
+
+/****************************************************************************
+ * COEFFICIENT TABLES                                                       *
+ ****************************************************************************/
+
+static void
+axis_cleanup(DCLMResampleAxis *ax)
+{
+	free(ax->first);
+	free(ax->count);
+	free(ax->weight);
+	ax->first = NULL;
+	ax->count = NULL;
+	ax->weight = NULL;
+	ax->max_taps = 0;
+}
+
+/* build the table to resample n source pixels to m destination pixels
+ * RETURN: 0: OK
+ *        -1: out of memory
+ */
+static int
+axis_init(DCLMResampleAxis *ax, size_t n, size_t m, int filter)
+{
+	uint16_t *w;
+	uint64_t lo, hi, overlap, sum;
+	size_t i, k, pos;
+
+	axis_cleanup(ax);
+	ax->max_taps = (n > m)?(unsigned int)((n + m - 1) / m + 1):2;
+	ax->first = malloc(m * sizeof(*ax->first));
+	ax->count = malloc(m * sizeof(*ax->count));
+	ax->weight = malloc(m * ax->max_taps * sizeof(*ax->weight));
+	if (!ax->first || !ax->count || !ax->weight) {
+		axis_cleanup(ax);
+		return -1;
+	}
+
+	for (i = 0; i < m; i++) {
+		w = ax->weight + i * ax->max_taps;
+		if (n > m) {
+			/* in units of 1/m source pixels, destination pixel i covers
+			 * [i*n, (i+1)*n), and source pixel k [k*m, (k+1)*m) */
+			ax->first[i] = i * n / m;
+			ax->count[i] = (unsigned int)(((i + 1) * n - 1) / m - ax->first[i] + 1);
+			sum = 0;
+			for (k = 0; k < ax->count[i]; k++) {
+				lo = (uint64_t)(ax->first[i] + k) * m;
+				hi = lo + m;
+				if (lo < (uint64_t)i * n) {
+					lo = (uint64_t)i * n;
+				}
+				if (hi > (uint64_t)(i + 1) * n) {
+					hi = (uint64_t)(i + 1) * n;
+				}
+				overlap = (hi - lo) * DCLM_RESAMPLE_ONE;
+				w[k] = (uint16_t)((overlap + n/2) / n);
+				sum += w[k];
+			}
+			/* rounding errors go to the last one, so the sum is exact */
+			w[k-1] = (uint16_t)(w[k-1] + DCLM_RESAMPLE_ONE - sum);
+		} else if (filter == DCLM_RESAMPLE_BILINEAR && n < m) {
+			/* the center of destination pixel i is at source
+			 * position ((2i+1)*n - m) / 2m */
+			pos = ((2*i + 1) * n > m)?((2*i + 1) * n - m):0;
+			ax->first[i] = pos / (2*m);
+			if (ax->first[i] + 1 < n) {
+				ax->count[i] = 2;
+				w[1] = (uint16_t)((pos % (2*m)) * DCLM_RESAMPLE_ONE / (2*m));
+				w[0] = (uint16_t)(DCLM_RESAMPLE_ONE - w[1]);
+			} else {
+				ax->first[i] = n - 1;
+				ax->count[i] = 1;
+				w[0] = DCLM_RESAMPLE_ONE;
+			}
+		} else {
+			ax->first[i] = (2*i + 1) * n / (2*m);
+			ax->count[i] = 1;
+			w[0] = DCLM_RESAMPLE_ONE;
+		}
+	}
+	return 0;
+}
+
+/* set up rs for the given sizes, if it is not already
+ * RETURN: 0: OK
+ *        -1: out of memory
+ */
+static int
+resample_setup(DCLMResampler *rs, size_t width, size_t height, const DCLMImage *dst, int filter)
+{
+	if (rs->luma && rs->src_dims[0] == width && rs->src_dims[1] == height &&
+	    rs->dst_dims[0] == dst->dims[0] && rs->dst_dims[1] == dst->dims[1] &&
+	    rs->filter == filter) {
+		return 0;
+	}
+
+	dclmResamplerCleanup(rs);
+	rs->luma = malloc(width * sizeof(*rs->luma));
+	rs->acc = malloc(width * sizeof(*rs->acc));
+	if (!rs->luma || !rs->acc ||
+	    axis_init(&rs->axis[0], width, dst->dims[0], filter) ||
+	    axis_init(&rs->axis[1], height, dst->dims[1], filter)) {
+		dclmResamplerCleanup(rs);
+		return -1;
+	}
+	rs->src_dims[0] = width;
+	rs->src_dims[1] = height;
+	rs->dst_dims[0] = dst->dims[0];
+	rs->dst_dims[1] = dst->dims[1];
+	rs->filter = filter;
+	return 0;
+}
+
+/****************************************************************************
+ * INNER LOOPS                                                              *
+ ****************************************************************************/
+
+static void
+luma_gray(uint16_t * restrict luma, const uint8_t * restrict src, size_t width)
+{
+	size_t x;
+
+	for (x = 0; x < width; x++) {
+		luma[x] = (uint16_t)(src[x] << 8);
+	}
+}
+
+/* luma * 256, BT.601 */
+static void
+luma_rgb(uint16_t * restrict luma, const uint8_t * restrict src, size_t width)
+{
+	size_t x;
+
+	for (x = 0; x < width; x++) {
+		luma[x] = (uint16_t)(77u*src[3*x] + 150u*src[3*x+1] + 29u*src[3*x+2]);
+	}
+}
+
+static void
+luma_rgba(uint16_t * restrict luma, const uint8_t * restrict src, size_t width)
+{
+	size_t x;
+
+	for (x = 0; x < width; x++) {
+		luma[x] = (uint16_t)(77u*src[4*x] + 150u*src[4*x+1] + 29u*src[4*x+2]);
+	}
+}
+
+static void
+acc_first(uint32_t * restrict acc, const uint16_t * restrict luma, uint32_t weight, size_t width)
+{
+	size_t x;
+
+	for (x = 0; x < width; x++) {
+		acc[x] = weight * luma[x];
+	}
+}
+
+static void
+acc_add(uint32_t * restrict acc, const uint16_t * restrict luma, uint32_t weight, size_t width)
+{
+	size_t x;
+
+	for (x = 0; x < width; x++) {
+		acc[x] += weight * luma[x];
+	}
+}
+
+/****************************************************************************
+ * Resampling                                                               *
+ ****************************************************************************/
+
+extern void
+dclmResamplerInit(DCLMResampler *rs)
+{
+	memset(rs, 0, sizeof(*rs));
+}
+
+extern void
+dclmResamplerCleanup(DCLMResampler *rs)
+{
+	axis_cleanup(&rs->axis[0]);
+	axis_cleanup(&rs->axis[1]);
+	free(rs->luma);
+	free(rs->acc);
+	rs->luma = NULL;
+	rs->acc = NULL;
+	rs->src_dims[0] = rs->src_dims[1] = 0;
+	rs->dst_dims[0] = rs->dst_dims[1] = 0;
+}
+
+extern int
+dclmResample(DCLMResampler *rs, const uint8_t *src, size_t width, size_t height, size_t stride,
+	     int format, int filter, DCLMImage *dst)
+{
+	void (*luma_row)(uint16_t * restrict, const uint8_t * restrict, size_t);
+	const DCLMResampleAxis *ax = &rs->axis[0];
+	const DCLMResampleAxis *ay = &rs->axis[1];
+	const uint16_t *w;
+	const uint32_t *a;
+	size_t x, y, row, luma_row_index;
+	unsigned int t;
+	uint64_t sum;
+	uint8_t *out;
+
+	switch (format) {
+		case DCLM_RESAMPLE_GRAY:
+			luma_row = luma_gray;
+			break;
+		case DCLM_RESAMPLE_RGB:
+			luma_row = luma_rgb;
+			break;
+		case DCLM_RESAMPLE_RGBA:
+			luma_row = luma_rgba;
+			break;
+		default:
+			return -1;
+	}
+	if (!width || !height || !dst->dims[0] || !dst->dims[1]) {
+		return -1;
+	}
+	if (resample_setup(rs, width, height, dst, filter)) {
+		return -1;
+	}
+
+	luma_row_index = (size_t)-1;
+	for (y = 0; y < dst->dims[1]; y++) {
+		w = ay->weight + y * ay->max_taps;
+		for (t = 0; t < ay->count[y]; t++) {
+			row = ay->first[y] + t;
+			/* neighbouring destination rows often share a source row */
+			if (row != luma_row_index) {
+				luma_row(rs->luma, src + row * stride, width);
+				luma_row_index = row;
+			}
+			if (t) {
+				acc_add(rs->acc, rs->luma, w[t], width);
+			} else {
+				acc_first(rs->acc, rs->luma, w[t], width);
+			}
+		}
+
+		out = DCLM_IMG_PIXEL(dst, 0, y);
+		for (x = 0; x < dst->dims[0]; x++) {
+			w = ax->weight + x * ax->max_taps;
+			a = rs->acc + ax->first[x];
+			sum = 0;
+			for (t = 0; t < ax->count[x]; t++) {
+				sum += (uint64_t)a[t] * w[t];
+			}
+			sum = (sum + (1ull << (RESAMPLE_OUT_SHIFT - 1))) >> RESAMPLE_OUT_SHIFT;
+			out[x] = (sum > 255)?255:(uint8_t)sum;
+		}
+	}
+	return 0;
+}
+
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DCLM_RESAMPLE_H
+#define DCLM_RESAMPLE_H
+
+#include "dclm_image.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************
+ * DATA TYPES                                                               *
+ ****************************************************************************/
+
+/* pixel formats of the source, the values are the bytes per pixel */
+#define DCLM_RESAMPLE_GRAY	1
+#define DCLM_RESAMPLE_RGB	3	/* packed R, G, B */
+#define DCLM_RESAMPLE_RGBA	4	/* packed R, G, B, A, alpha is ignored */
+
+/* filters for enlarging, shrinking always averages the covered area */
+#define DCLM_RESAMPLE_NEAREST	0
+#define DCLM_RESAMPLE_BILINEAR	1
+
+/* the weights are fixed point with DCLM_RESAMPLE_SHIFT fractional bits */
+#define DCLM_RESAMPLE_SHIFT	14
+#define DCLM_RESAMPLE_ONE	(1u<<DCLM_RESAMPLE_SHIFT)
+
+/* the source pixels contributing to each destination pixel of one axis */
+typedef struct {
+	size_t *first; /* the first source pixel */
+	unsigned int *count; /* the number of source pixels */
+	uint16_t *weight; /* max_taps per destination pixel, summing up to DCLM_RESAMPLE_ONE */
+	unsigned int max_taps;
+} DCLMResampleAxis;
+
+/* A resampler keeps the tables for the last source and destination
+ * size it was used with, so resampling frames of the same size again
+ * costs no setup, and allocates nothing. */
+typedef struct {
+	size_t src_dims[2];
+	size_t dst_dims[2];
+	int filter;
+	DCLMResampleAxis axis[2];
+	uint16_t *luma; /* one source row, luma * 256 */
+	uint32_t *acc; /* one source row, weighted sum of source rows */
+} DCLMResampler;
+
+/****************************************************************************
+ * Resampling                                                               *
+ ****************************************************************************/
+
+extern void
+dclmResamplerInit(DCLMResampler *rs);
+
+extern void
+dclmResamplerCleanup(DCLMResampler *rs);
+
+/* Resample an image to the size of dst: the luma of the source
+ * (BT.601 for RGB) goes into the pixels of dst, 0 to 255.
+ * src: the top left pixel of the source
+ * width, height: size of the source in pixels
+ * stride: bytes from one row of the source to the next
+ * format: DCLM_RESAMPLE_GRAY, _RGB or _RGBA
+ * filter: DCLM_RESAMPLE_NEAREST or _BILINEAR, for enlarging
+ * RETURN: 0: OK
+ *        -1: out of memory, or invalid size
+ */
+extern int
+dclmResample(DCLMResampler *rs, const uint8_t *src, size_t width, size_t height, size_t stride,
+	     int format, int filter, DCLMImage *dst);
+
+#ifdef __cplusplus
+}	/* extern "C" */
+#endif
+
+#endif /* !DCLM_RESAMPLE_H */
+
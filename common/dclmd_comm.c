@@ -14,36 +14,69 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE /* memfd_create, accept4 */
+
 #include "dclmd_comm.h"
 
 #include <stdio.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <signal.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <limits.h>
 #include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 /****************************************************************************
  * INTERNAL: SHARED OBJECT NAMES                                            *
  ****************************************************************************/
 
 #define DCLMD_COMM_SHARED_PREFIX "/dclmd"
-#define DCLMD_COMM_SHARED_NAME_LEN 32
+#define DCLMD_COMM_SHARED_NAME_LEN (32 + DCLMD_COMM_MAX_INSTANCE_LEN)
+
+#define DCLMD_COMM_ALIGN_SIZE(s) (((s) + DCLMD_COMM_ALIGN - 1) & ~((size_t)DCLMD_COMM_ALIGN - 1))
+
+/* the default instance keeps the names of the single instance days,
+ * named instances are "/dclmd.<instance>-..." */
+#define DCLMD_COMM_INSTANCE_SEP(comm) (((comm)->instance[0])?".":"")
 
 static void
-dclmdCommNameSem(char *str, size_t len, unsigned int idx)
+dclmdCommNameSem(const DCLMDComminucation *comm, char *str, size_t len, unsigned int idx)
 {
-	snprintf(str, len, "%s-sem%u", DCLMD_COMM_SHARED_PREFIX, idx);
+	snprintf(str, len, "%s%s%s-sem%u", DCLMD_COMM_SHARED_PREFIX, DCLMD_COMM_INSTANCE_SEP(comm), comm->instance, idx);
 }
 
 static void
-dclmdCommNameShm(char *str, size_t len)
+dclmdCommNameShm(const DCLMDComminucation *comm, char *str, size_t len)
+{
+	snprintf(str, len, "%s%s%s-shm", DCLMD_COMM_SHARED_PREFIX, DCLMD_COMM_INSTANCE_SEP(comm), comm->instance);
+}
+
+/* we use the abstract socket namespace, so the
+ * socket vanishes together with the daemon
+ * RETURN: size of the address
+ */
+static socklen_t
+dclmdCommNameSock(const DCLMDComminucation *comm, struct sockaddr_un *addr)
 {
-	snprintf(str, len, "%s-shm", DCLMD_COMM_SHARED_PREFIX);
+	int len;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	len = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "%s%s%s-sock", DCLMD_COMM_SHARED_PREFIX, DCLMD_COMM_INSTANCE_SEP(comm), comm->instance);
+	return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + len);
 }
 
 /****************************************************************************
@@ -97,33 +130,33 @@ dclmdCompareTime(const struct timespec *a, const struct timespec *b)
  ****************************************************************************/
 
 static sem_t *
-dclmdSemOpen(unsigned int idx)
+dclmdSemOpen(const DCLMDComminucation *comm, unsigned int idx)
 {
 	char name[DCLMD_COMM_SHARED_NAME_LEN];
 	sem_t *sem;
 
-	dclmdCommNameSem(name, sizeof(name), idx);
+	dclmdCommNameSem(comm, name, sizeof(name), idx);
 	sem = sem_open(name, O_RDWR);
 	return sem;
 }
 
 static sem_t *
-dclmdSemCreate(unsigned int idx, unsigned int initial)
+dclmdSemCreate(const DCLMDComminucation *comm, unsigned int idx, unsigned int initial)
 {
 	char name[DCLMD_COMM_SHARED_NAME_LEN];
 	sem_t *sem;
 
-	dclmdCommNameSem(name, sizeof(name), idx);
+	dclmdCommNameSem(comm, name, sizeof(name), idx);
 	sem = sem_open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, initial);
 	return sem;
 }
 
 static void
-dclmdSemUnlink(unsigned int idx)
+dclmdSemUnlink(const DCLMDComminucation *comm, unsigned int idx)
 {
 	char name[DCLMD_COMM_SHARED_NAME_LEN];
 
-	dclmdCommNameSem(name, sizeof(name), idx);
+	dclmdCommNameSem(comm, name, sizeof(name), idx);
 	sem_unlink(name);
 }
 
@@ -197,6 +230,32 @@ dclmdSemTimedWaitMS(sem_t *sem, unsigned int ms)
 	return dclmdSemTimedWait(sem, &ts);
 }
 
+/****************************************************************************
+ * FUTEX HELPERS                                                            *
+ ****************************************************************************/
+
+/* wait until *addr is not val any more, or the relative timeout expires
+ * rel: NULL means infinite
+ * RETURN 0: woken up (or value already changed)
+ *        1: timeout
+ */
+static int
+dclmdFutexWait(unsigned int *addr, unsigned int val, const struct timespec *rel)
+{
+	if (syscall(SYS_futex, addr, FUTEX_WAIT, val, rel, NULL, 0)) {
+		if (errno == ETIMEDOUT) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void
+dclmdFutexWake(unsigned int *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
 /****************************************************************************
  * INTERNAL: THE COMMUNICATION INTERFACE                                    *
  ****************************************************************************/
@@ -208,16 +267,47 @@ dclmdCommInit(DCLMDComminucation *comm)
 	comm->sem_mutex = NULL;
 	comm->sem_command = NULL;
 	comm->shm_fd = -1;
+	comm->sock_fd = -1;
+	comm->poll_fd = -1;
+	comm->event_fd = -1;
+	comm->bridge_run = 0;
 	comm->shm_size = 0;
 	comm->work = NULL;
+	comm->ext = NULL;
 	comm->flags = 0;
 	comm->img.dims[0] = 0;
 	comm->img.dims[1] = 0;
 	comm->img.size = 0;
 	comm->img.data = NULL;
+	comm->slot.dims[0] = 0;
+	comm->slot.dims[1] = 0;
+	comm->slot.size = 0;
+	comm->slot.data = NULL;
+	memset(comm->clients, 0, sizeof(comm->clients));
 
 	comm->clientTimeout = 200;
 	comm->recreateTimeout = 1000;
+	comm->fence = 0;
+	comm->caps = 0;
+	comm->close_handler = NULL;
+	comm->close_data = NULL;
+	comm->layer_ttl_ms = 0;
+	comm->instance[0] = 0;
+}
+
+/* set the instance name of a DCLMDComminucation structure
+ * RETURN 0: OK
+ *       -1: invalid instance name
+ */
+static int
+dclmdCommSetInstance(DCLMDComminucation *comm, const char *instance)
+{
+	instance = dclmdCommResolveInstance(instance);
+	if (!instance) {
+		return -1;
+	}
+	strcpy(comm->instance, instance);
+	return 0;
 }
 
 /* get the communication image pointer from the shm
@@ -239,14 +329,108 @@ dclmdCommGetImg(DCLMDComminucation *comm)
 	return 0;
 }
 
-/* Initialize the daemon end of the communication interface
+/* end of a field of DCLMDWorkExt */
+#define DCLMD_COMM_EXT_END(field) (offsetof(DCLMDWorkExt, field) + sizeof(((DCLMDWorkExt*)0)->field))
+
+/* the fields every extension has, up to the display list */
+#define DCLMD_COMM_EXT_BASE_SIZE DCLMD_COMM_EXT_END(dlist)
+
+/* the fields appended for each capability */
+static const struct {
+	unsigned int cap;
+	size_t end;
+} dclmdCommCapFields[] = {
+	{DCLMD_CAP_SCHEDULE,	DCLMD_COMM_EXT_END(sched_duration_ms)},
+	{DCLMD_CAP_SCROLL_TEXT,	DCLMD_COMM_EXT_END(scroll_loops)},
+	{DCLMD_CAP_TRANSITION,	DCLMD_COMM_EXT_END(trans_duration_ms)},
+	{DCLMD_CAP_ANIMATION,	DCLMD_COMM_EXT_END(anim_loops)},
+	{DCLMD_CAP_FRAME_STORE,	DCLMD_COMM_EXT_END(store_name)},
+	{DCLMD_CAP_LAYERS,	DCLMD_COMM_EXT_END(layer_flags)},
+	{DCLMD_CAP_WIDGETS,	DCLMD_COMM_EXT_END(widget_max)},
+	{DCLMD_CAP_FRAME_QUEUE,	DCLMD_COMM_EXT_END(batch_pending)},
+	{DCLMD_CAP_MIRROR,	DCLMD_COMM_EXT_END(mirror)},
+	{DCLMD_CAP_LAYER_TTL,	DCLMD_COMM_EXT_END(layer_ttl_ms)}
+};
+
+/* the capabilities whose fields fit into an extension of ext_size
+ * bytes, so we never touch what a daemon older than us does not have */
+static unsigned int
+dclmdCommCapsFitting(size_t ext_size)
+{
+	unsigned int caps = DCLMD_CAP_ALL;
+	size_t i;
+
+	for (i = 0; i < sizeof(dclmdCommCapFields)/sizeof(dclmdCommCapFields[0]); i++) {
+		if (dclmdCommCapFields[i].end > ext_size) {
+			caps &= ~dclmdCommCapFields[i].cap;
+		}
+	}
+	return caps;
+}
+
+/* get the extension and the image slot from the shm
+ * comm->ext stays NULL if the daemon does not provide
+ * a (compatible) extension
+ */
+static void
+dclmdCommGetExt(DCLMDComminucation *comm)
+{
+	size_t offset = dclmdCommExtOffset(comm->img.size);
+	size_t slot_offset;
+	DCLMDWorkExt *ext;
+
+	comm->ext = NULL;
+	comm->caps = 0;
+	if (offset + DCLMD_COMM_EXT_BASE_SIZE > comm->shm_size) {
+		/* legacy daemon */
+		return;
+	}
+
+	/* the extension of a newer daemon is larger, of an older one
+	 * smaller than ours: only the first min(ext_size, sizeof(*ext))
+	 * bytes are used, the capabilities tell which */
+	ext = (DCLMDWorkExt*)(((uint8_t*)comm->work) + offset);
+	if (ext->ext_size < DCLMD_COMM_EXT_BASE_SIZE ||
+	    ext->version_min > DCLMD_COMM_EXT_VERSION ||
+	    ext->version_max < DCLMD_COMM_EXT_VERSION_MIN) {
+		/* incompatible version, use the legacy path */
+		return;
+	}
+	slot_offset = offset + DCLMD_COMM_ALIGN_SIZE(ext->ext_size);
+	if (slot_offset > comm->shm_size) {
+		return;
+	}
+	if (ext->img_capacity > comm->shm_size - slot_offset) {
+		return;
+	}
+
+	comm->ext = ext;
+	comm->caps = ext->caps & dclmdCommCapsFitting(ext->ext_size);
+	comm->slot.dims[0] = 0;
+	comm->slot.dims[1] = 0;
+	comm->slot.size = ext->img_capacity;
+	comm->slot.data = ((uint8_t*)comm->work) + slot_offset;
+}
+
+/* size of the shm for a LED matrix of dims_x * dims_y
+ * and an image slot of img_capacity bytes */
+static size_t
+dclmdCommShmSize(int dims_x, int dims_y, size_t img_capacity)
+{
+	return dclmdCommExtOffset((size_t)(dims_x * dims_y))
+	       + DCLMD_COMM_ALIGN_SIZE(sizeof(DCLMDWorkExt))
+	       + img_capacity;
+}
+
+/* Initialize the contents of a freshly created shm
  * RETURN 0: OK
  *       -1: error
  */
 static int
-dclmdCommInitDaemon(DCLMDComminucation *comm, int dims_x, int dims_y)
+dclmdCommInitShm(DCLMDComminucation *comm, int dims_x, int dims_y)
 {
-	int res;
+	DCLMDWorkExt *ext;
+	size_t offset, slot_offset;
 
 	comm->work->hdr_size = sizeof(*comm->work);
 	comm->work->hdr_version = DCLMD_COMM_VERSION;
@@ -263,6 +447,90 @@ dclmdCommInitDaemon(DCLMDComminucation *comm, int dims_x, int dims_y)
 		return -1;
 	}
 
+	offset = dclmdCommExtOffset(comm->img.size);
+	slot_offset = offset + DCLMD_COMM_ALIGN_SIZE(sizeof(*ext));
+	if (slot_offset > comm->shm_size) {
+		return -1;
+	}
+	ext = (DCLMDWorkExt*)(((uint8_t*)comm->work) + offset);
+	ext->ext_size = sizeof(*ext);
+	ext->version_min = DCLMD_COMM_EXT_VERSION_MIN;
+	ext->version_max = DCLMD_COMM_EXT_VERSION;
+	ext->caps = DCLMD_CAP_ALL & ~DCLMD_CAP_PRIVATE;
+	ext->img_capacity = comm->shm_size - slot_offset;
+	ext->img_dims[0] = 0;
+	ext->img_dims[1] = 0;
+	ext->img_step_x = 0;
+	ext->img_step_y = 0;
+	ext->img_step_ms = 0;
+	ext->submit_seq = 0;
+	ext->done_seq = 0;
+	ext->done_err = DCLM_OK;
+	ext->dlist_len = 0;
+	ext->sched_id = 0;
+	ext->sched_priority = 0;
+	ext->sched_start_ms = 0;
+	ext->sched_duration_ms = 0;
+	ext->scroll_pps = 0;
+	ext->scroll_dir = DCLMD_SCROLL_LEFT;
+	ext->scroll_loops = 0;
+	ext->trans_effect = 0;
+	ext->trans_duration_ms = 0;
+	ext->anim_mode = DCLMD_ANIM_LOOP;
+	ext->anim_loops = 0;
+	ext->store_id = 0;
+	memset(ext->store_name, 0, sizeof(ext->store_name));
+	ext->layer_id = 0;
+	ext->layer_z = 0;
+	ext->layer_x = 0;
+	ext->layer_y = 0;
+	ext->layer_w = 0;
+	ext->layer_h = 0;
+	ext->layer_flags = 0;
+	ext->widget_id = 0;
+	ext->widget_type = 0;
+	ext->widget_x = 0;
+	ext->widget_y = 0;
+	ext->widget_w = 0;
+	ext->widget_h = 0;
+	ext->widget_flags = 0;
+	ext->widget_value = 0;
+	ext->widget_max = 0;
+	ext->batch_count = 0;
+	ext->batch_flags = 0;
+	memset(ext->batch_time_ns, 0, sizeof(ext->batch_time_ns));
+	ext->batch_presented = 0;
+	ext->batch_dropped = 0;
+	ext->batch_pending = 0;
+	ext->mirror_seq = 0;
+	ext->mirror_dims[0] = 0;
+	ext->mirror_dims[1] = 0;
+	ext->layer_ttl_ms = 0;
+	if (sem_init(&ext->lock, 1, 1)) {
+		return -1;
+	}
+
+	dclmdCommGetExt(comm);
+	if (!comm->ext) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Initialize the daemon end of the communication interface
+ * RETURN 0: OK
+ *       -1: error
+ */
+static int
+dclmdCommInitDaemon(DCLMDComminucation *comm, int dims_x, int dims_y)
+{
+	int res;
+
+	if (dclmdCommInitShm(comm, dims_x, dims_y)) {
+		return -1;
+	}
+
 	/* lock semaphore: make sure we count to 0 */
 	do {
 		res = dclmdSemTryWait(comm->sem_command);
@@ -279,18 +547,13 @@ dclmdCommInitDaemon(DCLMDComminucation *comm, int dims_x, int dims_y)
 	return 0;
 }
 
-/* Initialize the client end of the communication interface
+/* Check the header of the shm on the client side
  * RETURN 0: OK
- *       -1: error
+ *       -1: incompatible
  */
 static int
-dclmdCommInitClient(DCLMDComminucation *comm)
+dclmdCommCheckHeader(DCLMDComminucation *comm)
 {
-	int res = dclmdSemTimedWaitMS(comm->sem_mutex, comm->clientTimeout);
-	if (res) {
-		return -1;
-	}
-
 	if (comm->work->hdr_size != sizeof(*comm->work)) {
 		/* incompatible version */
 		return -1;
@@ -301,8 +564,28 @@ dclmdCommInitClient(DCLMDComminucation *comm)
 		return -1;
 	}
 
-	res = dclmdCommGetImg(comm);
+	return 0;
+}
+
+/* Initialize the client end of the communication interface
+ * RETURN 0: OK
+ *       -1: error
+ */
+static int
+dclmdCommInitClient(DCLMDComminucation *comm)
+{
+	int res = dclmdSemTimedWaitMS(comm->sem_mutex, comm->clientTimeout);
+	if (res) {
+		return -1;
+	}
 
+	res = dclmdCommCheckHeader(comm);
+	if (!res) {
+		res = dclmdCommGetImg(comm);
+	}
+	if (!res) {
+		dclmdCommGetExt(comm);
+	}
 
 	/* unlock the semaphore */
 	if (sem_post(comm->sem_mutex)) {
@@ -312,146 +595,613 @@ dclmdCommInitClient(DCLMDComminucation *comm)
 	return res;
 }
 
-/* open shared communication interface
- * RETURN: 0: OK
- *        -1: semaphore error
- *        -2: shm error
+/****************************************************************************
+ * INTERNAL: PRIVATE CONNECTIONS                                            *
+ ****************************************************************************/
+
+/* request sent by a client connecting via the socket */
+typedef struct {
+	size_t hdr_size;
+	unsigned int hdr_version;
+	unsigned int ext_version;
+	size_t img_capacity;
+} DCLMDConnectRequest;
+
+/* reply of the daemon, on success the memfd is attached */
+typedef struct {
+	int status; /* 0: OK */
+	size_t shm_size;
+} DCLMDConnectReply;
+
+/* create the listening socket for private connections
+ * RETURN 0: OK
+ *       -1: error
  */
 static int
-dclmdCommOpen(DCLMDComminucation *comm, int as_daemon, int dims_x, int dims_y)
+dclmdCommListen(DCLMDComminucation *comm)
 {
-	char name[DCLMD_COMM_SHARED_NAME_LEN];
-	int res;
-	dclmdCommNameShm(name, sizeof(name));
+	struct sockaddr_un addr;
+	socklen_t len = dclmdCommNameSock(comm, &addr);
 
-	if (as_daemon) {
-		comm->flags |= DCLMD_FLAG_DAEMON;
+	comm->sock_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (comm->sock_fd < 0) {
+		return -1;
+	}
+	if (bind(comm->sock_fd, (struct sockaddr*)&addr, len) || listen(comm->sock_fd, DCLMD_COMM_MAX_CLIENTS)) {
+		close(comm->sock_fd);
+		comm->sock_fd = -1;
+		return -1;
+	}
+	return 0;
+}
 
-		if (dims_x < 1 || dims_y < 1) {
-			return -1;
-		}
+/* set the receive timeout of a socket */
+static void
+dclmdCommSockTimeout(int fd, unsigned int ms)
+{
+	struct timeval tv;
 
-		comm->shm_size = sizeof(*comm->work) + dims_x * dims_y;
-		comm->sem_mutex = dclmdSemCreate(0, 1);
-		comm->sem_command = dclmdSemCreate(1, 0);
-		if (!comm->sem_mutex || !comm->sem_command) {
-			return -1;
-		}
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
 
-		/* lock semaphore,
-		 * it the timeout expires, we consider the client to be dead
-		 * and ignore its lock! */
-		res = dclmdSemTimedWaitMS(comm->sem_mutex, comm->recreateTimeout);
-		if (res < 0) {
-			return -1;
-		}
+/* send the reply to a connecting client, with fd attached if fd >= 0 */
+static int
+dclmdCommSendReply(int sock, const DCLMDConnectReply *reply, int fd)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} ctrl;
+	struct msghdr msg;
+	struct iovec iov;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (void*)reply;
+	iov.iov_len = sizeof(*reply);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (fd >= 0) {
+		struct cmsghdr *cmsg;
+		memset(&ctrl, 0, sizeof(ctrl));
+		msg.msg_control = ctrl.buf;
+		msg.msg_controllen = sizeof(ctrl.buf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
 
-		/* lock semaphore: make sure we count to 0 */
-		do {
-			res = dclmdSemTryWait(comm->sem_mutex);
-		} while (res == 0);
-		if (res < 0) {
-			return -1;
-		}
+	return (sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(*reply))?0:-1;
+}
 
-		comm->shm_fd = shm_open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-		if (comm->shm_fd >= 0) {
-			if (ftruncate(comm->shm_fd, (off_t)comm->shm_size) < 0) {
-				comm->shm_size = 0;
-			}
-		}
-	} else {
-		comm->shm_fd = shm_open(name, O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-		if (comm->shm_fd >= 0) {
-			struct stat s;
-			if (fstat(comm->shm_fd,&s) >= 0) {
-				comm->shm_size = (size_t)s.st_size;
-			}
-		}
-		comm->sem_mutex = dclmdSemOpen(0);
-		comm->sem_command = dclmdSemOpen(1);
+/* receive the reply from the daemon, *fd is -1 if no fd was attached */
+static int
+dclmdCommRecvReply(int sock, DCLMDConnectReply *reply, int *fd)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} ctrl;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	ssize_t res;
+
+	*fd = -1;
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = reply;
+	iov.iov_len = sizeof(*reply);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof(ctrl.buf);
 
-		if (!comm->sem_mutex || !comm->sem_command) {
-			return -1;
+	do {
+		res = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	} while (res < 0 && errno == EINTR);
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
 		}
 	}
 
-	if (comm->shm_fd < 0 || !comm->shm_size) {
-		return -2;
+	if (res != (ssize_t)sizeof(*reply) || reply->status) {
+		if (*fd >= 0) {
+			close(*fd);
+			*fd = -1;
+		}
+		return -1;
 	}
+	return 0;
+}
 
-	comm->work = mmap(NULL, (off_t)comm->shm_size, PROT_READ|PROT_WRITE, MAP_SHARED, comm->shm_fd,0);
-	if (comm->work == MAP_FAILED) {
-		comm->work = NULL;
-	}
-	if (!comm->work) {
-		return -2;
-	}
+/* add fd to the epoll set of the daemon
+ * RETURN 0: OK
+ *       -1: error
+ */
+static int
+dclmdCommPollAdd(DCLMDComminucation *comm, int fd)
+{
+	struct epoll_event ev;
 
-	if (as_daemon) {
-		return dclmdCommInitDaemon(comm, dims_x, dims_y);
-	} else {
-		return dclmdCommInitClient(comm);
-	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	return epoll_ctl(comm->poll_fd, EPOLL_CTL_ADD, fd, &ev);
 }
 
-/****************************************************************************
- * EXTERNAL API: THE COMMUNICATION INTERFACE (client and daemon)            *
- ****************************************************************************/
-
-/* Create the communication interface.
- * If as_daemon is true: create the daemon side,
- * otherwise create the client side.
- * RETURN: pointer to newly alloced structure,
- *         NULL on error
- */ 
-extern DCLMDComminucation *
-dclmdCommunicationCreate(int as_daemon, int dims_x, int dims_y)
+/* create the private shm for a client on the daemon side
+ * RETURN 0: OK
+ *       -1: error
+ */
+static int
+dclmdCommCreatePrivate(DCLMDComminucation *client, const DCLMDComminucation *comm, size_t img_capacity)
 {
-	DCLMDComminucation *comm = malloc(sizeof(*comm));
-	if (!comm) {
-		return NULL;
+	int dims_x = (int)comm->work->dims[0];
+	int dims_y = (int)comm->work->dims[1];
+
+	if (!img_capacity) {
+		img_capacity = DCLMD_COMM_IMAGE_CAPACITY;
+	} else if (img_capacity > DCLMD_COMM_MAX_IMAGE_CAPACITY) {
+		img_capacity = DCLMD_COMM_MAX_IMAGE_CAPACITY;
 	}
 
-	dclmdCommInit(comm);
+	client->shm_size = dclmdCommShmSize(dims_x, dims_y, img_capacity);
+	client->shm_fd = memfd_create("dclmd-client", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (client->shm_fd < 0) {
+		return -1;
+	}
 
-	if (dclmdCommOpen(comm, as_daemon, dims_x, dims_y)) {
-		dclmdCommunicationDestroy(comm);
-		comm=NULL;
+	/* the client must not be able to resize it under our feet */
+	if (ftruncate(client->shm_fd, (off_t)client->shm_size) < 0 ||
+	    fcntl(client->shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+		return -1;
 	}
 
-	return comm;
+	client->work = mmap(NULL, client->shm_size, PROT_READ|PROT_WRITE, MAP_SHARED, client->shm_fd, 0);
+	if (client->work == MAP_FAILED) {
+		client->work = NULL;
+		return -1;
+	}
+
+	if (dclmdCommInitShm(client, dims_x, dims_y)) {
+		return -1;
+	}
+	client->sem_mutex = &client->ext->lock;
+	return 0;
 }
 
-/* Destroy the communication interface */
-extern void
-dclmdCommunicationDestroy(DCLMDComminucation *comm)
+/* accept a single private connection, the handshake is done by
+ * dclmdCommHandshake() once the request of the client arrived
+ * RETURN 1: accepted a connection
+ *        0: no connection pending
+ *       -1: error
+ */
+static int
+dclmdCommAcceptClient(DCLMDComminucation *comm)
 {
-	if (!comm) {
-		return;
+	DCLMDConnectReply reply;
+	DCLMDComminucation *client;
+	unsigned int idx;
+	int fd;
+
+	fd = accept4(comm->sock_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+			return 0;
+		}
+		return -1;
 	}
 
-	if (comm->flags & DCLMD_FLAG_DAEMON) {
-		if (comm->shm_fd) {
-			char name[DCLMD_COMM_SHARED_NAME_LEN];
-			dclmdCommNameShm(name, sizeof(name));
-			shm_unlink(name);
-		}
-		if (comm->sem_mutex) {
-			dclmdSemUnlink(0);
-		}
-		if (comm->sem_command) {
-			dclmdSemUnlink(1);
+	for (idx = 0; idx < DCLMD_COMM_MAX_CLIENTS; idx++) {
+		if (!comm->clients[idx]) {
+			break;
 		}
 	}
 
-	if (comm->sem_mutex) {
-		sem_close(comm->sem_mutex);
-		comm->sem_mutex = NULL;
+	client = (idx < DCLMD_COMM_MAX_CLIENTS)?malloc(sizeof(*client)):NULL;
+	if (!client) {
+		/* no room */
+		reply.status = -1;
+		reply.shm_size = 0;
+		dclmdCommSendReply(fd, &reply, -1);
+		close(fd);
+		return 1;
 	}
-	if (comm->sem_command) {
-		sem_close(comm->sem_command);
-		comm->sem_command = NULL;
+
+	dclmdCommInit(client);
+	client->flags |= DCLMD_FLAG_DAEMON | DCLMD_FLAG_PRIVATE | DCLMD_FLAG_HANDSHAKE;
+	client->clientTimeout = comm->clientTimeout;
+	client->sock_fd = fd;
+	dclmdCalcWaitTimeMS(&client->deadline, NULL, comm->clientTimeout);
+
+	/* the request of the client wakes us up */
+	if (comm->poll_fd >= 0 && dclmdCommPollAdd(comm, fd)) {
+		dclmdCommunicationDestroy(client);
+		return 1;
+	}
+
+	comm->clients[idx] = client;
+	return 1;
+}
+
+/* complete the handshake of a private connection: never waits,
+ * a client which did not send its request yet is asked again on the
+ * next call, until its deadline passed
+ * RETURN 1: done, the connection can be used
+ *        0: still waiting for the request
+ *       -1: failed, the connection must be dropped
+ */
+static int
+dclmdCommHandshake(DCLMDComminucation *comm, DCLMDComminucation *client)
+{
+	DCLMDConnectRequest req;
+	DCLMDConnectReply reply;
+	struct timespec now;
+	ssize_t res;
+
+	do {
+		res = recv(client->sock_fd, &req, sizeof(req), MSG_DONTWAIT);
+	} while (res < 0 && errno == EINTR);
+
+	if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		clock_gettime(CLOCK_REALTIME, &now);
+		return (dclmdCompareTime(&now, &client->deadline) < 0)?0:-1;
+	}
+
+	reply.status = -1;
+	reply.shm_size = 0;
+	if (res != (ssize_t)sizeof(req) ||
+	    req.hdr_size != sizeof(DCLMDWorkEntry) ||
+	    req.hdr_version != DCLMD_COMM_VERSION ||
+	    req.ext_version < DCLMD_COMM_EXT_VERSION_MIN) {
+		/* incompatible client, a newer client adapts
+		 * to our extension by its size and caps */
+		dclmdCommSendReply(client->sock_fd, &reply, -1);
+		return -1;
+	}
+
+	if (dclmdCommCreatePrivate(client, comm, req.img_capacity)) {
+		dclmdCommSendReply(client->sock_fd, &reply, -1);
+		return -1;
+	}
+	/* the mirror is only written when the screen changes */
+	client->ext->mirror_dims[0] = comm->ext->mirror_dims[0];
+	client->ext->mirror_dims[1] = comm->ext->mirror_dims[1];
+	memcpy(client->ext->mirror, comm->ext->mirror, sizeof(client->ext->mirror));
+	client->ext->mirror_seq = comm->ext->mirror_seq;
+
+	reply.status = 0;
+	reply.shm_size = client->shm_size;
+	if (dclmdCommSendReply(client->sock_fd, &reply, client->shm_fd)) {
+		return -1;
+	}
+
+	client->flags &= ~DCLMD_FLAG_HANDSHAKE;
+	return 1;
+}
+
+/* check if a private connection was closed by the client
+ * RETURN 1: closed
+ *        0: still open
+ */
+static int
+dclmdCommClientClosed(DCLMDComminucation *client)
+{
+	char buf[16];
+	ssize_t res;
+
+	do {
+		res = recv(client->sock_fd, buf, sizeof(buf), MSG_DONTWAIT);
+	} while (res > 0 || (res < 0 && errno == EINTR));
+
+	if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return 0;
+	}
+	return 1;
+}
+
+/* connect to the daemon via a private connection
+ * RETURN 0: OK
+ *       -1: error
+ */
+static int
+dclmdCommConnect(DCLMDComminucation *comm, size_t img_capacity)
+{
+	struct sockaddr_un addr;
+	socklen_t len = dclmdCommNameSock(comm, &addr);
+	DCLMDConnectRequest req;
+	DCLMDConnectReply reply;
+	struct stat s;
+
+	comm->flags |= DCLMD_FLAG_PRIVATE;
+
+	/* the command semaphore is the doorbell to wake up the daemon */
+	comm->sem_command = dclmdSemOpen(comm, 1);
+	if (!comm->sem_command) {
+		return -1;
+	}
+
+	comm->sock_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (comm->sock_fd < 0) {
+		return -1;
+	}
+	if (connect(comm->sock_fd, (struct sockaddr*)&addr, len)) {
+		return -1;
+	}
+
+	req.hdr_size = sizeof(DCLMDWorkEntry);
+	req.hdr_version = DCLMD_COMM_VERSION;
+	req.ext_version = DCLMD_COMM_EXT_VERSION;
+	req.img_capacity = img_capacity;
+	if (send(comm->sock_fd, &req, sizeof(req), MSG_NOSIGNAL) != (ssize_t)sizeof(req)) {
+		return -1;
+	}
+	if (sem_post(comm->sem_command)) {
+		return -1;
+	}
+
+	dclmdCommSockTimeout(comm->sock_fd, comm->recreateTimeout);
+	if (dclmdCommRecvReply(comm->sock_fd, &reply, &comm->shm_fd)) {
+		return -2;
+	}
+	if (fstat(comm->shm_fd, &s) || (size_t)s.st_size < reply.shm_size) {
+		return -2;
+	}
+
+	comm->shm_size = reply.shm_size;
+	comm->work = mmap(NULL, comm->shm_size, PROT_READ|PROT_WRITE, MAP_SHARED, comm->shm_fd, 0);
+	if (comm->work == MAP_FAILED) {
+		comm->work = NULL;
+		return -2;
+	}
+
+	if (dclmdCommCheckHeader(comm) || dclmdCommGetImg(comm)) {
+		return -2;
+	}
+	dclmdCommGetExt(comm);
+	if (!comm->ext) {
+		return -2;
+	}
+
+	comm->sem_mutex = &comm->ext->lock;
+	return 0;
+}
+
+/* open shared communication interface
+ * RETURN: 0: OK
+ *        -1: semaphore error
+ *        -2: shm error
+ */
+static int
+dclmdCommOpen(DCLMDComminucation *comm, int as_daemon, int dims_x, int dims_y)
+{
+	char name[DCLMD_COMM_SHARED_NAME_LEN];
+	int res;
+	dclmdCommNameShm(comm, name, sizeof(name));
+
+	if (as_daemon) {
+		comm->flags |= DCLMD_FLAG_DAEMON;
+
+		if (dims_x < 1 || dims_y < 1) {
+			return -1;
+		}
+
+		comm->shm_size = dclmdCommShmSize(dims_x, dims_y, DCLMD_COMM_IMAGE_CAPACITY);
+		comm->sem_mutex = dclmdSemCreate(comm, 0, 1);
+		comm->sem_command = dclmdSemCreate(comm, 1, 0);
+		if (!comm->sem_mutex || !comm->sem_command) {
+			return -1;
+		}
+
+		/* lock semaphore,
+		 * it the timeout expires, we consider the client to be dead
+		 * and ignore its lock! */
+		res = dclmdSemTimedWaitMS(comm->sem_mutex, comm->recreateTimeout);
+		if (res < 0) {
+			return -1;
+		}
+
+		/* lock semaphore: make sure we count to 0 */
+		do {
+			res = dclmdSemTryWait(comm->sem_mutex);
+		} while (res == 0);
+		if (res < 0) {
+			return -1;
+		}
+
+		comm->shm_fd = shm_open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (comm->shm_fd >= 0) {
+			if (ftruncate(comm->shm_fd, (off_t)comm->shm_size) < 0) {
+				comm->shm_size = 0;
+			}
+		}
+	} else {
+		comm->shm_fd = shm_open(name, O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (comm->shm_fd >= 0) {
+			struct stat s;
+			if (fstat(comm->shm_fd,&s) >= 0) {
+				comm->shm_size = (size_t)s.st_size;
+			}
+		}
+		comm->sem_mutex = dclmdSemOpen(comm, 0);
+		comm->sem_command = dclmdSemOpen(comm, 1);
+
+		if (!comm->sem_mutex || !comm->sem_command) {
+			return -1;
+		}
+	}
+
+	if (comm->shm_fd < 0 || !comm->shm_size) {
+		return -2;
+	}
+
+	comm->work = mmap(NULL, (off_t)comm->shm_size, PROT_READ|PROT_WRITE, MAP_SHARED, comm->shm_fd,0);
+	if (comm->work == MAP_FAILED) {
+		comm->work = NULL;
+	}
+	if (!comm->work) {
+		return -2;
+	}
+
+	if (as_daemon) {
+		res = dclmdCommInitDaemon(comm, dims_x, dims_y);
+		if (!res && !dclmdCommListen(comm)) {
+			/* private connections are optional */
+			comm->ext->caps |= DCLMD_CAP_PRIVATE;
+			comm->caps = comm->ext->caps;
+		}
+		return res;
+	} else {
+		return dclmdCommInitClient(comm);
+	}
+}
+
+/****************************************************************************
+ * EXTERNAL API: THE COMMUNICATION INTERFACE (client and daemon)            *
+ ****************************************************************************/
+
+/* Get the offset of the DCLMDWorkExt in the shm,
+ * for a legacy image of img_size bytes.
+ */
+extern size_t
+dclmdCommExtOffset(size_t img_size)
+{
+	return DCLMD_COMM_ALIGN_SIZE(sizeof(DCLMDWorkEntry) + img_size);
+}
+
+/* Get the name of a daemon instance.
+ * instance: NULL for the instance named in the environment
+ *           variable DCLMD_COMM_INSTANCE_ENV, "" for the default
+ * RETURN: the instance name, "" for the default instance,
+ *         NULL if the name is invalid
+ */
+extern const char *
+dclmdCommResolveInstance(const char *instance)
+{
+	size_t i;
+
+	if (!instance) {
+		instance = getenv(DCLMD_COMM_INSTANCE_ENV);
+		if (!instance) {
+			return "";
+		}
+	}
+
+	/* it ends up in shm, semaphore and socket names */
+	for (i = 0; instance[i]; i++) {
+		char c = instance[i];
+		if (i >= DCLMD_COMM_MAX_INSTANCE_LEN) {
+			return NULL;
+		}
+		if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-')) {
+			return NULL;
+		}
+	}
+	return instance;
+}
+
+/* Create the communication interface.
+ * If as_daemon is true: create the daemon side,
+ * otherwise create the client side.
+ * RETURN: pointer to newly alloced structure,
+ *         NULL on error
+ */ 
+extern DCLMDComminucation *
+dclmdCommunicationCreate(int as_daemon, int dims_x, int dims_y)
+{
+	return dclmdCommunicationCreateInstance(NULL, as_daemon, dims_x, dims_y);
+}
+
+/* Create the communication interface of a daemon instance.
+ * Same as dclmdCommunicationCreate(), see dclmdCommResolveInstance()
+ * for instance.
+ */
+extern DCLMDComminucation *
+dclmdCommunicationCreateInstance(const char *instance, int as_daemon, int dims_x, int dims_y)
+{
+	DCLMDComminucation *comm = malloc(sizeof(*comm));
+	if (!comm) {
+		return NULL;
+	}
+
+	dclmdCommInit(comm);
+
+	if (dclmdCommSetInstance(comm, instance) ||
+	    dclmdCommOpen(comm, as_daemon, dims_x, dims_y)) {
+		dclmdCommunicationDestroy(comm);
+		comm=NULL;
+	}
+
+	return comm;
+}
+
+/* Destroy the communication interface */
+extern void
+dclmdCommunicationDestroy(DCLMDComminucation *comm)
+{
+	unsigned int i;
+
+	if (!comm) {
+		return;
+	}
+
+	for (i = 0; i < DCLMD_COMM_MAX_CLIENTS; i++) {
+		dclmdCommunicationDestroy(comm->clients[i]);
+		comm->clients[i] = NULL;
+	}
+
+	if (comm->bridge_run) {
+		__atomic_store_n(&comm->bridge_run, 0, __ATOMIC_RELEASE);
+		sem_post(comm->sem_command);
+		pthread_join(comm->bridge, NULL);
+	}
+	if (comm->event_fd >= 0) {
+		close(comm->event_fd);
+		comm->event_fd = -1;
+	}
+	if (comm->poll_fd >= 0) {
+		close(comm->poll_fd);
+		comm->poll_fd = -1;
+	}
+
+	if (comm->sock_fd >= 0) {
+		close(comm->sock_fd);
+		comm->sock_fd = -1;
+		if ( (comm->flags & DCLMD_FLAG_PRIVATE) && !(comm->flags & DCLMD_FLAG_DAEMON) && comm->sem_command) {
+			/* wake up the daemon so it notices we are gone */
+			sem_post(comm->sem_command);
+		}
+	}
+
+	if (comm->flags & DCLMD_FLAG_PRIVATE) {
+		/* the mutex lives in the shm */
+		comm->sem_mutex = NULL;
+	} else if (comm->flags & DCLMD_FLAG_DAEMON) {
+		if (comm->shm_fd) {
+			char name[DCLMD_COMM_SHARED_NAME_LEN];
+			dclmdCommNameShm(comm, name, sizeof(name));
+			shm_unlink(name);
+		}
+		if (comm->sem_mutex) {
+			dclmdSemUnlink(comm, 0);
+		}
+		if (comm->sem_command) {
+			dclmdSemUnlink(comm, 1);
+		}
+	}
+
+	if (comm->sem_mutex) {
+		sem_close(comm->sem_mutex);
+		comm->sem_mutex = NULL;
+	}
+	if (comm->sem_command) {
+		sem_close(comm->sem_command);
+		comm->sem_command = NULL;
 	}
 	if (comm->work) {
 		munmap(comm->work, comm->shm_size);
@@ -465,111 +1215,945 @@ dclmdCommunicationDestroy(DCLMDComminucation *comm)
 	free(comm);
 }
 
-/****************************************************************************
- * EXTERNAL API: THE COMMUNICATION INTERFACE (client side)                  *
- ****************************************************************************/
-
-/* Create the communication interface as client.
- * RETURN: pointer to newly alloced structure,
- *         NULL on error
- */ 
-extern DCLMDComminucation *
-dclmdCommunicationClientCreate(void)
+/****************************************************************************
+ * EXTERNAL API: THE COMMUNICATION INTERFACE (client side)                  *
+ ****************************************************************************/
+
+/* Create the communication interface as client.
+ * RETURN: pointer to newly alloced structure,
+ *         NULL on error
+ */ 
+extern DCLMDComminucation *
+dclmdCommunicationClientCreate(void)
+{
+	return dclmdCommunicationCreateInstance(NULL,0,0,0);
+}
+
+/* Create the communication interface as client of a daemon instance.
+ * instance: see dclmdCommResolveInstance()
+ * RETURN: pointer to newly alloced structure,
+ *         NULL on error
+ */
+extern DCLMDComminucation *
+dclmdCommunicationClientCreateInstance(const char *instance)
+{
+	return dclmdCommunicationCreateInstance(instance,0,0,0);
+}
+
+/* Create a private connection to the daemon as client.
+ * The client gets its own shm (a memfd passed via a
+ * unix domain socket) and its own lock, so it is isolated
+ * from all other clients. The API is the same as for
+ * the shared interface.
+ * img_capacity: requested size of the image slot in bytes,
+ *               0 for the default
+ * RETURN: pointer to newly alloced structure,
+ *         NULL on error
+ */
+extern DCLMDComminucation *
+dclmdCommunicationClientCreatePrivate(size_t img_capacity)
+{
+	return dclmdCommunicationClientCreatePrivateInstance(NULL, img_capacity);
+}
+
+/* Create a private connection to a daemon instance as client.
+ * instance: see dclmdCommResolveInstance()
+ * RETURN: pointer to newly alloced structure,
+ *         NULL on error
+ */
+extern DCLMDComminucation *
+dclmdCommunicationClientCreatePrivateInstance(const char *instance, size_t img_capacity)
+{
+	DCLMDComminucation *comm = malloc(sizeof(*comm));
+	if (!comm) {
+		return NULL;
+	}
+
+	dclmdCommInit(comm);
+
+	if (dclmdCommSetInstance(comm, instance) ||
+	    dclmdCommConnect(comm, img_capacity)) {
+		dclmdCommunicationDestroy(comm);
+		comm=NULL;
+	}
+
+	return comm;
+}
+
+/* Get the capabilities negotiated with the daemon.
+ * RETURN: bitmask of DCLMD_CAP_*, 0 for a legacy daemon
+ */
+extern unsigned int
+dclmdClientGetCaps(const DCLMDComminucation *comm)
+{
+	return (comm)?comm->caps:0;
+}
+
+/* Lock the communication interface as client.
+ * If this returns successfully, you can write
+ * to the work entry and MUST call
+ * dclmdClientUnlock() afterwards as soon
+ * as possible!
+ * RETURN: DCLM_OK if successfull, error code otherwise
+ */
+extern DCLEDMatrixError
+dclmdClientLock(DCLMDComminucation *comm)
+{
+	int res;
+
+	if (!comm) {
+		return DCLMD_NOT_CONNECTED;
+	}
+
+	res = dclmdSemTimedWaitMS(comm->sem_mutex, comm->clientTimeout);
+	if (res < 0) {
+		return DCLMD_COMMUNICATION_ERROR;
+	} else if (res > 0) {
+		return DCLMD_COMMUNICATION_TIMEOUT;
+	}
+
+	return 0;
+}
+
+/* Try to lock the communication interface as client,
+ * without blocking. Same as dclmdClientLock() otherwise.
+ * RETURN: DCLM_OK if successfull,
+ *         DCLMD_COMMUNICATION_BUSY if currently locked
+ */
+extern DCLEDMatrixError
+dclmdClientTryLock(DCLMDComminucation *comm)
+{
+	int res;
+
+	if (!comm) {
+		return DCLMD_NOT_CONNECTED;
+	}
+
+	res = dclmdSemTryWait(comm->sem_mutex);
+	if (res < 0) {
+		return DCLMD_COMMUNICATION_ERROR;
+	} else if (res > 0) {
+		return DCLMD_COMMUNICATION_BUSY;
+	}
+
+	return 0;
+}
+
+/* Unlock the communication interface as client.
+ * If this returns successfully, the daemon should
+ * carry out the command. On error, the command
+ * is most likely ignored.
+ */
+extern DCLEDMatrixError
+dclmdClientUnlock(DCLMDComminucation *comm)
+{
+	return dclmdClientSubmit(comm, NULL);
+}
+
+/* Unlock the communication interface as client,
+ * same as dclmdClientUnlock(), but also get the
+ * sequence number of the submitted command, which can be
+ * used with dclmdClientSeqDone() and dclmdClientWaitSeq().
+ * seq is set to 0 if the daemon does not support this.
+ */
+extern DCLEDMatrixError
+dclmdClientSubmit(DCLMDComminucation *comm, unsigned int *seq)
+{
+	unsigned int s = 0;
+	int res;
+
+	if (!comm) {
+		return DCLMD_NOT_CONNECTED;
+	}
+
+	if (comm->ext) {
+		s = comm->ext->submit_seq + 1;
+		comm->ext->submit_seq = s;
+	}
+	if (seq) {
+		*seq = s;
+	}
+
+	res = sem_post(comm->sem_mutex);
+	if (res) {
+		return DCLMD_COMMUNICATION_ERROR;
+	}
+	res = sem_post(comm->sem_command);
+	if (res) {
+		return DCLMD_COMMUNICATION_ERROR;
+	}
+
+	return 0;
+}
+
+/* check if the daemon supports all capabilities in cap */
+static int
+dclmdCommHasCap(const DCLMDComminucation *comm, unsigned int cap)
+{
+	return (comm->ext && (comm->caps & cap) == cap);
+}
+
+/* Check if the command with sequence number seq was carried out
+ * RETURN 1: done
+ *        0: still pending
+ *       -1: not supported by the daemon
+ */
+extern int
+dclmdClientSeqDone(const DCLMDComminucation *comm, unsigned int seq)
+{
+	unsigned int done;
+
+	if (!comm || !dclmdCommHasCap(comm, DCLMD_CAP_FENCE)) {
+		return -1;
+	}
+
+	done = __atomic_load_n(&comm->ext->done_seq, __ATOMIC_ACQUIRE);
+	/* sequence numbers wrap around */
+	return ((int)(done - seq) >= 0)?1:0;
+}
+
+/* Wait until the command with sequence number seq was carried out
+ * timeout_ms: DCLMD_TIMEOUT_INFINITE means infinite
+ * RETURN: DCLM_OK if the frame was sent,
+ *         the error sending the frame,
+ *         or DCLMD_COMMUNICATION_TIMEOUT
+ */
+extern DCLEDMatrixError
+dclmdClientWaitSeq(DCLMDComminucation *comm, unsigned int seq, unsigned int timeout_ms)
+{
+	struct timespec until, now, rel;
+	unsigned int done;
+
+	if (!comm) {
+		return DCLMD_NOT_CONNECTED;
+	}
+	if (!dclmdCommHasCap(comm, DCLMD_CAP_FENCE)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if (timeout_ms != DCLMD_TIMEOUT_INFINITE) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		dclmdCalcWaitTimeMS(&until, &now, timeout_ms);
+	}
+
+	while (1) {
+		done = __atomic_load_n(&comm->ext->done_seq, __ATOMIC_ACQUIRE);
+		if ((int)(done - seq) >= 0) {
+			return (DCLEDMatrixError)comm->ext->done_err;
+		}
+		if (timeout_ms == DCLMD_TIMEOUT_INFINITE) {
+			dclmdFutexWait(&comm->ext->done_seq, done, NULL);
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (dclmdCompareTime(&now, &until) >= 0) {
+			return DCLMD_COMMUNICATION_TIMEOUT;
+		}
+		rel.tv_sec = until.tv_sec - now.tv_sec;
+		rel.tv_nsec = until.tv_nsec - now.tv_nsec;
+		if (rel.tv_nsec < 0) {
+			rel.tv_sec--;
+			rel.tv_nsec += 1000000000L;
+		}
+		dclmdFutexWait(&comm->ext->done_seq, done, &rel);
+	}
+}
+
+/* copy the text into the work entry */
+static void
+dclmdCommCopyText(DCLMDWorkEntry *work, const char *str, size_t len)
+{
+	/* note: it is OK if work->text is not 0-terminated, dclmd takes care */
+	if (len) {
+		if (len >= sizeof(work->text)) {
+			len = sizeof(work->text) - 1;
+		}
+		memcpy(work->text, str, len);
+		work->text[len]=0;
+	} else {
+		strncpy(work->text, str, sizeof(work->text));
+	}
+}
+
+/* fill in the text command, comm must be locked */
+static void
+dclmdCommSetText(DCLMDComminucation *comm, const char *str, size_t len, int pos_x,  unsigned int additional_flags, unsigned int timeout_ms)
+{
+	DCLMDWorkEntry *work = comm->work;
+	dclmdCommCopyText(work, str, len);
+	work->timeout_ms = timeout_ms;
+	work->cmd_flags |= DCLMD_CMD_SHOW_TEXT | DCLMD_CMD_TIMEOUT | additional_flags;
+	work->text_pos_x = pos_x;
+}
+
+/* Full cycle: Show text
+ * if str is NULL: blank
+ * If len is 0: use strlen
+ * timeout_ms: 0 means infinite
+ */
+extern DCLEDMatrixError
+dclmdClientShowText(DCLMDComminucation *comm, const char *str, size_t len, int pos_x,  unsigned int additional_flags, unsigned int timeout_ms)
+{
+	DCLEDMatrixError err;
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		dclmdCommSetText(comm, str, len, pos_x, additional_flags, timeout_ms);
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Non-blocking: Show text
+ * Same as dclmdClientShowText(), but never waits for the lock.
+ * seq: receives the sequence number of the command, may be NULL
+ * RETURN: DCLMD_COMMUNICATION_BUSY if the interface is currently locked
+ */
+extern DCLEDMatrixError
+dclmdClientSubmitText(DCLMDComminucation *comm, const char *str, size_t len, int pos_x,  unsigned int additional_flags, unsigned int timeout_ms, unsigned int *seq)
+{
+	DCLEDMatrixError err;
+	if ( (err = dclmdClientTryLock(comm) ) == DCLM_OK ) {
+		dclmdCommSetText(comm, str, len, pos_x, additional_flags, timeout_ms);
+		err = dclmdClientSubmit(comm, seq);
+	}
+	return err;
+}
+
+/* Full cycle: Blank the screen
+ */
+extern DCLEDMatrixError
+dclmdClientBlank(DCLMDComminucation *comm, unsigned int additional_flags)
+{
+	DCLEDMatrixError err;
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		DCLMDWorkEntry *work = comm->work;
+		/* note: it is OK if work->text is not 0-terminated, dclmd takes care */
+		work->cmd_flags = DCLMD_CMD_CLEAR_SCREEN | additional_flags;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* find the place for an image in the shm
+ * RETURN: DCLM_OK or error code
+ */
+static DCLEDMatrixError
+dclmdCommImageTarget(DCLMDComminucation *comm, const DCLMImage *img, uint8_t **dst, unsigned int *slot_flag)
+{
+	if (img->dims[0] == comm->img.dims[0] && img->dims[1] == comm->img.dims[1]) {
+		*dst = comm->img.data;
+		*slot_flag = 0;
+	} else {
+		if (!dclmdCommHasCap(comm, DCLMD_CAP_IMAGE_SLOT)) {
+			return DCLMD_NOT_SUPPORTED;
+		}
+		if (!img->size || img->size > comm->slot.size) {
+			return DCLMD_IMAGE_TOO_LARGE;
+		}
+		*dst = comm->slot.data;
+		*slot_flag = DCLMD_CMD_IMAGE_SLOT;
+	}
+	return DCLM_OK;
+}
+
+/* copy the image to the place found by dclmdCommImageTarget(),
+ * comm must be locked */
+static void
+dclmdCommPutImage(DCLMDComminucation *comm, const DCLMImage *img, uint8_t *dst, unsigned int slot_flag)
+{
+	if (slot_flag) {
+		comm->ext->img_dims[0] = img->dims[0];
+		comm->ext->img_dims[1] = img->dims[1];
+	}
+	memcpy(dst, img->data, img->size);
+	comm->work->cmd_flags = (comm->work->cmd_flags & ~DCLMD_CMD_IMAGE_SLOT) | slot_flag;
+}
+
+/* Full cycle: Show an image
+ * The image may be of any size up to the capacity of the image slot,
+ * images which do not exactly fit the LED matrix are put into the slot.
+ * pos_x, pos_y: the image position shown at the top left LED
+ * timeout_ms: 0 means infinite
+ */
+extern DCLEDMatrixError
+dclmdClientShowImage(DCLMDComminucation *comm, const DCLMImage *img, int pos_x, int pos_y, unsigned int additional_flags, unsigned int timeout_ms)
+{
+	DCLEDMatrixError err;
+	unsigned int slot_flag;
+	uint8_t *dst;
+
+	if (!comm) {
+		return DCLMD_NOT_CONNECTED;
+	}
+
+	if ( (err = dclmdCommImageTarget(comm, img, &dst, &slot_flag)) != DCLM_OK) {
+		return err;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		DCLMDWorkEntry *work = comm->work;
+		dclmdCommPutImage(comm, img, dst, slot_flag);
+		work->img_pos_x = pos_x;
+		work->img_pos_y = pos_y;
+		work->timeout_ms = timeout_ms;
+		work->cmd_flags |= DCLMD_CMD_SHOW_IMAGE | DCLMD_CMD_TIMEOUT | additional_flags;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* lock comm and put the display list and the optional image into the shm
+ * RETURN: DCLM_OK: comm is locked
+ *         error code otherwise
+ */
+static DCLEDMatrixError
+dclmdCommLockDList(DCLMDComminucation *comm, const DCLMDisplayList *dl, const DCLMImage *img, unsigned int cap)
+{
+	DCLEDMatrixError err;
+	unsigned int slot_flag = 0;
+	uint8_t *dst = NULL;
+
+	if (!comm) {
+		return DCLMD_NOT_CONNECTED;
+	}
+	if (!dclmdCommHasCap(comm, cap)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+	if (dl->len > sizeof(comm->ext->dlist)) {
+		return DCLMD_IMAGE_TOO_LARGE;
+	}
+
+	if (img && (err = dclmdCommImageTarget(comm, img, &dst, &slot_flag)) != DCLM_OK) {
+		return err;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		if (img) {
+			dclmdCommPutImage(comm, img, dst, slot_flag);
+		}
+		memcpy(comm->ext->dlist, dl->data, dl->len);
+		comm->ext->dlist_len = dl->len;
+	}
+	return err;
+}
+
+/* Full cycle: Execute a display list
+ * All operations are carried out at once, and the result is sent
+ * as a single frame.
+ * img: image for the DCLM_DL_BLIT operations, may be NULL
+ *      (then the image currently in the shm is used)
+ * timeout_ms: 0 means infinite
+ */
+extern DCLEDMatrixError
+dclmdClientShowDList(DCLMDComminucation *comm, const DCLMDisplayList *dl, const DCLMImage *img, unsigned int additional_flags, unsigned int timeout_ms)
+{
+	DCLEDMatrixError err;
+
+	if ( (err = dclmdCommLockDList(comm, dl, img, DCLMD_CAP_DISPLAY_LIST)) == DCLM_OK ) {
+		DCLMDWorkEntry *work = comm->work;
+		work->timeout_ms = timeout_ms;
+		work->cmd_flags |= DCLMD_CMD_DISPLAY_LIST | DCLMD_CMD_TIMEOUT | additional_flags;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Put a display list on the daemon's timeline */
+extern DCLEDMatrixError
+dclmdClientSchedule(DCLMDComminucation *comm, unsigned int id, const DCLMDisplayList *dl, const DCLMImage *img,
+		    int priority, unsigned int start_ms, unsigned int duration_ms)
+{
+	DCLEDMatrixError err;
+
+	if ( (err = dclmdCommLockDList(comm, dl, img, DCLMD_CAP_DISPLAY_LIST | DCLMD_CAP_SCHEDULE)) == DCLM_OK ) {
+		DCLMDWorkExt *ext = comm->ext;
+		ext->sched_id = id;
+		ext->sched_priority = priority;
+		ext->sched_start_ms = start_ms;
+		ext->sched_duration_ms = duration_ms;
+		comm->work->cmd_flags |= DCLMD_CMD_SCHEDULE;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Remove an item from the daemon's timeline */
+extern DCLEDMatrixError
+dclmdClientUnschedule(DCLMDComminucation *comm, unsigned int id)
+{
+	DCLEDMatrixError err;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_SCHEDULE)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		comm->ext->sched_id = id;
+		comm->work->cmd_flags |= DCLMD_CMD_UNSCHEDULE;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Scroll text as marquee
+ */
+extern DCLEDMatrixError
+dclmdClientScrollText(DCLMDComminucation *comm, const char *str, size_t len, unsigned int pixels_per_sec,
+		      int direction, unsigned int loops, unsigned int additional_flags)
+{
+	DCLEDMatrixError err;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_SCROLL_TEXT)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		dclmdCommCopyText(comm->work, str, len);
+		comm->ext->scroll_pps = pixels_per_sec;
+		comm->ext->scroll_dir = direction;
+		comm->ext->scroll_loops = loops;
+		comm->work->cmd_flags |= DCLMD_CMD_SCROLL_TEXT | additional_flags;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Set the transition between screens
+ */
+extern DCLEDMatrixError
+dclmdClientSetTransition(DCLMDComminucation *comm, int effect, unsigned int duration_ms)
+{
+	DCLEDMatrixError err;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_TRANSITION)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		comm->ext->trans_effect = effect;
+		comm->ext->trans_duration_ms = duration_ms;
+		comm->work->cmd_flags |= DCLMD_CMD_TRANSITION;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Play an animation file
+ */
+extern DCLEDMatrixError
+dclmdClientPlayAnim(DCLMDComminucation *comm, const char *path, int mode, unsigned int loops, unsigned int additional_flags)
+{
+	DCLEDMatrixError err;
+	char *abs_path = NULL;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_ANIMATION)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+	if (path) {
+		abs_path = realpath(path, NULL);
+		if (!abs_path) {
+			return DCLM_INVALID_CONFIG;
+		}
+		if (strlen(abs_path) > DCLMD_COMM_MAX_TEXT_LENGTH) {
+			free(abs_path);
+			return DCLM_INVALID_CONFIG;
+		}
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		dclmdCommCopyText(comm->work, (abs_path)?abs_path:"", 0);
+		comm->ext->anim_mode = mode;
+		comm->ext->anim_loops = loops;
+		comm->work->cmd_flags |= DCLMD_CMD_PLAY_ANIM | additional_flags;
+		err = dclmdClientUnlock(comm);
+	}
+	free(abs_path);
+	return err;
+}
+
+/* set the key of the frame store entry, comm must be locked */
+static void
+dclmdCommSetStoreKey(DCLMDComminucation *comm, unsigned int id, const char *name)
+{
+	DCLMDWorkExt *ext = comm->ext;
+
+	ext->store_id = id;
+	memset(ext->store_name, 0, sizeof(ext->store_name));
+	if (name) {
+		strncpy(ext->store_name, name, sizeof(ext->store_name) - 1);
+	}
+}
+
+/* Full cycle: Put a display list into the daemon's frame store
+ */
+extern DCLEDMatrixError
+dclmdClientStoreDList(DCLMDComminucation *comm, unsigned int id, const char *name,
+		      const DCLMDisplayList *dl, const DCLMImage *img)
+{
+	DCLEDMatrixError err;
+
+	if ( (err = dclmdCommLockDList(comm, dl, img, DCLMD_CAP_DISPLAY_LIST | DCLMD_CAP_FRAME_STORE)) == DCLM_OK ) {
+		dclmdCommSetStoreKey(comm, id, name);
+		comm->work->cmd_flags |= DCLMD_CMD_STORE;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Put an image into the daemon's frame store
+ */
+extern DCLEDMatrixError
+dclmdClientStoreImage(DCLMDComminucation *comm, unsigned int id, const char *name, const DCLMImage *img)
+{
+	DCLMDisplayList dl;
+	uint8_t buf[32];
+
+	dclmDListInit(&dl, buf, sizeof(buf));
+	dclmDListClear(&dl, 0);
+	dclmDListBlit(&dl, 0, 0, 0, 0, (int)img->dims[0], (int)img->dims[1]);
+	return dclmdClientStoreDList(comm, id, name, &dl, img);
+}
+
+/* Full cycle: Show a screen from the daemon's frame store
+ */
+extern DCLEDMatrixError
+dclmdClientShowStored(DCLMDComminucation *comm, unsigned int id, const char *name,
+		      unsigned int additional_flags, unsigned int timeout_ms)
+{
+	DCLEDMatrixError err;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_FRAME_STORE)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		dclmdCommSetStoreKey(comm, id, name);
+		comm->work->timeout_ms = timeout_ms;
+		comm->work->cmd_flags |= DCLMD_CMD_SHOW_STORED | DCLMD_CMD_TIMEOUT | additional_flags;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Remove a screen from the daemon's frame store
+ */
+extern DCLEDMatrixError
+dclmdClientDropStored(DCLMDComminucation *comm, unsigned int id, const char *name)
+{
+	DCLEDMatrixError err;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_FRAME_STORE)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		dclmdCommSetStoreKey(comm, id, name);
+		comm->work->cmd_flags |= DCLMD_CMD_DROP_STORED;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Put a display list into a layer
+ */
+extern DCLEDMatrixError
+dclmdClientSetLayer(DCLMDComminucation *comm, unsigned int id, int z,
+		    int x, int y, int w, int h, unsigned int flags,
+		    const DCLMDisplayList *dl, const DCLMImage *img)
+{
+	DCLEDMatrixError err;
+
+	if ( (err = dclmdCommLockDList(comm, dl, img, DCLMD_CAP_DISPLAY_LIST | DCLMD_CAP_LAYERS)) == DCLM_OK ) {
+		DCLMDWorkExt *ext = comm->ext;
+		ext->layer_id = id;
+		ext->layer_z = z;
+		ext->layer_x = x;
+		ext->layer_y = y;
+		ext->layer_w = w;
+		ext->layer_h = h;
+		ext->layer_flags = flags;
+		if (dclmdCommHasCap(comm, DCLMD_CAP_LAYER_TTL)) {
+			ext->layer_ttl_ms = comm->layer_ttl_ms;
+		}
+		comm->work->cmd_flags |= DCLMD_CMD_SET_LAYER;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Set the time to live of the layers set from now on
+ */
+extern DCLEDMatrixError
+dclmdClientSetLayerTTL(DCLMDComminucation *comm, unsigned int ttl_ms)
+{
+	if (!comm) {
+		return DCLMD_NOT_CONNECTED;
+	}
+	if (!dclmdCommHasCap(comm, DCLMD_CAP_LAYER_TTL)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+	comm->layer_ttl_ms = ttl_ms;
+	return DCLM_OK;
+}
+
+/* Full cycle: Remove a layer
+ */
+extern DCLEDMatrixError
+dclmdClientRemoveLayer(DCLMDComminucation *comm, unsigned int id)
+{
+	DCLEDMatrixError err;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_LAYERS)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		comm->ext->layer_id = id;
+		comm->work->cmd_flags |= DCLMD_CMD_REMOVE_LAYER;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Create a widget
+ */
+extern DCLEDMatrixError
+dclmdClientSetWidget(DCLMDComminucation *comm, unsigned int id, int type,
+		     int x, int y, int w, int h, unsigned int flags,
+		     int value, int max, const char *text, const DCLMImage *icon)
+{
+	DCLEDMatrixError err;
+	unsigned int slot_flag = 0;
+	uint8_t *dst = NULL;
+
+	if (!comm) {
+		return DCLMD_NOT_CONNECTED;
+	}
+	if (!dclmdCommHasCap(comm, DCLMD_CAP_WIDGETS)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if (icon && (err = dclmdCommImageTarget(comm, icon, &dst, &slot_flag)) != DCLM_OK) {
+		return err;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		DCLMDWorkExt *ext = comm->ext;
+		if (icon) {
+			dclmdCommPutImage(comm, icon, dst, slot_flag);
+		}
+		dclmdCommCopyText(comm->work, (text)?text:"", 0);
+		ext->widget_id = id;
+		ext->widget_type = type;
+		ext->widget_x = x;
+		ext->widget_y = y;
+		ext->widget_w = w;
+		ext->widget_h = h;
+		ext->widget_flags = flags;
+		ext->widget_value = value;
+		ext->widget_max = max;
+		comm->work->cmd_flags |= DCLMD_CMD_SET_WIDGET;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Set new contents of a widget
+ */
+extern DCLEDMatrixError
+dclmdClientUpdateWidget(DCLMDComminucation *comm, unsigned int id, int value, const char *text)
+{
+	DCLEDMatrixError err;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_WIDGETS)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		dclmdCommCopyText(comm->work, (text)?text:"", 0);
+		comm->ext->widget_id = id;
+		comm->ext->widget_value = value;
+		comm->work->cmd_flags |= DCLMD_CMD_UPDATE_WIDGET;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
+}
+
+/* Full cycle: Remove a widget
+ */
+extern DCLEDMatrixError
+dclmdClientRemoveWidget(DCLMDComminucation *comm, unsigned int id)
 {
-	return dclmdCommunicationCreate(0,0,0);
+	DCLEDMatrixError err;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_WIDGETS)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		comm->ext->widget_id = id;
+		comm->work->cmd_flags |= DCLMD_CMD_REMOVE_WIDGET;
+		err = dclmdClientUnlock(comm);
+	}
+	return err;
 }
 
-/* Lock the communication interface as client.
- * If this returns successfully, you can write
- * to the work entry and MUST call
- * dclmdClientUnlock() afterwards as soon
- * as possible!
- * RETURN: DCLM_OK if successfull, error code otherwise
+/* Full cycle: Queue frames to be presented at given times
  */
 extern DCLEDMatrixError
-dclmdClientLock(DCLMDComminucation *comm)
+dclmdClientQueueFrames(DCLMDComminucation *comm, const DCLMImage *frames, const struct timespec *times,
+		       unsigned int count, unsigned int flags, unsigned int *seq)
 {
-	int res;
+	DCLEDMatrixError err;
+	unsigned int slot_flag;
+	uint8_t *dst;
+	unsigned int i;
 
 	if (!comm) {
 		return DCLMD_NOT_CONNECTED;
 	}
+	if (!dclmdCommHasCap(comm, DCLMD_CAP_FRAME_QUEUE)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+	if (!count || count > DCLMD_BATCH_MAX_FRAMES ||
+	    frames->dims[0] != comm->work->dims[0] ||
+	    frames->dims[1] != count * comm->work->dims[1]) {
+		return DCLM_INVALID_CONFIG;
+	}
 
-	res = dclmdSemTimedWaitMS(comm->sem_mutex, comm->clientTimeout);
-	if (res < 0) {
-		return DCLMD_COMMUNICATION_ERROR;
-	} else if (res > 0) {
-		return DCLMD_COMMUNICATION_TIMEOUT;
+	if ( (err = dclmdCommImageTarget(comm, frames, &dst, &slot_flag)) != DCLM_OK) {
+		return err;
 	}
 
-	return 0;
+	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
+		DCLMDWorkExt *ext = comm->ext;
+		dclmdCommPutImage(comm, frames, dst, slot_flag);
+		for (i = 0; i < count; i++) {
+			ext->batch_time_ns[i] = (uint64_t)times[i].tv_sec * 1000000000ULL + (uint64_t)times[i].tv_nsec;
+		}
+		ext->batch_count = count;
+		ext->batch_flags = flags;
+		comm->work->cmd_flags |= DCLMD_CMD_QUEUE_FRAMES;
+		err = dclmdClientSubmit(comm, seq);
+	}
+	return err;
 }
 
-/* Unlock the communication interface as client.
- * If this returns successfully, the daemon should
- * carry out the command. On error, the command
- * is most likely ignored.
+/* Get the statistics of the frame queue
  */
 extern DCLEDMatrixError
-dclmdClientUnlock(DCLMDComminucation *comm)
+dclmdClientGetFrameStats(const DCLMDComminucation *comm, unsigned int *presented,
+			 unsigned int *dropped, unsigned int *pending)
 {
-	int res;
-
 	if (!comm) {
 		return DCLMD_NOT_CONNECTED;
 	}
-
-	res = sem_post(comm->sem_mutex);
-	if (res) {
-		return DCLMD_COMMUNICATION_ERROR;
+	if (!dclmdCommHasCap(comm, DCLMD_CAP_FRAME_QUEUE)) {
+		return DCLMD_NOT_SUPPORTED;
 	}
-	res = sem_post(comm->sem_command);
-	if (res) {
-		return DCLMD_COMMUNICATION_ERROR;
+	if (presented) {
+		*presented = __atomic_load_n(&comm->ext->batch_presented, __ATOMIC_ACQUIRE);
+	}
+	if (dropped) {
+		*dropped = __atomic_load_n(&comm->ext->batch_dropped, __ATOMIC_ACQUIRE);
+	}
+	if (pending) {
+		*pending = __atomic_load_n(&comm->ext->batch_pending, __ATOMIC_ACQUIRE);
+	}
+	return DCLM_OK;
+}
+
+/* Read the screen the daemon currently shows, without locking
+ */
+extern int
+dclmdClientReadMirror(const DCLMDComminucation *comm, unsigned int *seq, DCLMImage *img)
+{
+	const DCLMDWorkExt *ext;
+	uint8_t mirror[DCLMD_MIRROR_SIZE];
+	unsigned int s1, s2;
+	size_t w, h, y;
+	int tries;
+
+	if (!comm || !dclmdCommHasCap(comm, DCLMD_CAP_MIRROR)) {
+		return -1;
 	}
+	ext = comm->ext;
+
+	for (tries = 0; tries < 4; tries++) {
+		s1 = __atomic_load_n(&ext->mirror_seq, __ATOMIC_ACQUIRE);
+		if (s1 == *seq) {
+			return 0;
+		}
+		if (s1 & 1) {
+			continue;
+		}
+		w = ext->mirror_dims[0];
+		h = ext->mirror_dims[1];
+		memcpy(mirror, ext->mirror, sizeof(mirror));
+		/* the copy is only valid if the daemon did not touch it meanwhile */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&ext->mirror_seq, __ATOMIC_RELAXED);
+		if (s1 != s2 || w * h > DCLMD_MIRROR_SIZE) {
+			continue;
+		}
 
+		memset(img->data, 0, img->size);
+		for (y = 0; y < h && y < img->dims[1]; y++) {
+			memcpy(DCLM_IMG_PIXEL(img, 0, y), mirror + y*w, (w < img->dims[0])?w:img->dims[0]);
+		}
+		*seq = s1;
+		return 1;
+	}
 	return 0;
 }
 
-/* Full cycle: Show text
- * if str is NULL: blank
- * If len is 0: use strlen
- * timeout_ms: 0 means infinite
+/* Check if the daemon of this connection is gone
  */
-extern DCLEDMatrixError
-dclmdClientShowText(DCLMDComminucation *comm, const char *str, size_t len, int pos_x,  unsigned int additional_flags, unsigned int timeout_ms)
+extern int
+dclmdClientDaemonGone(const DCLMDComminucation *comm)
 {
-	DCLEDMatrixError err;
-	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
-		DCLMDWorkEntry *work = comm->work;
-		/* note: it is OK if work->text is not 0-terminated, dclmd takes care */
-		if (len) {
-			if (len >= sizeof(work->text)) {
-				len = sizeof(work->text) - 1;
-			}
-			memcpy(work->text, str, len);
-			work->text[len]=0;
-		} else {
-			strncpy(work->text, str, sizeof(work->text));
+	struct pollfd p;
+	struct stat s;
+
+	if (!comm) {
+		return 1;
+	}
+	if (comm->flags & DCLMD_FLAG_PRIVATE) {
+		/* the daemon closes the socket when it exits or drops us */
+		p.fd = comm->sock_fd;
+		p.events = POLLRDHUP;
+		p.revents = 0;
+		if (poll(&p, 1, 0) < 0) {
+			return 0;
 		}
-		work->timeout_ms = timeout_ms;
-		work->cmd_flags |= DCLMD_CMD_SHOW_TEXT | DCLMD_CMD_TIMEOUT | additional_flags;
-		work->text_pos_x = pos_x;
-		err = dclmdClientUnlock(comm);
+		return (p.revents & (POLLRDHUP | POLLHUP | POLLERR))?1:0;
 	}
-	return err;
+	/* the daemon unlinks the shm when it exits, the next one creates
+	 * a new one: the mapping of this connection stays with the old one */
+	if (fstat(comm->shm_fd, &s)) {
+		return 0;
+	}
+	return (s.st_nlink == 0)?1:0;
 }
 
-/* Full cycle: Blank the screen
+/* Full cycle: Pan over the image the daemon currently shows
+ * The daemon moves the image position by step_x, step_y
+ * every step_ms milliseconds, wrapping around at the image borders.
+ * step_ms: 0 stops panning
  */
 extern DCLEDMatrixError
-dclmdClientBlank(DCLMDComminucation *comm, unsigned int additional_flags)
+dclmdClientPanImage(DCLMDComminucation *comm, int step_x, int step_y, unsigned int step_ms)
 {
 	DCLEDMatrixError err;
+
+	if (comm && !dclmdCommHasCap(comm, DCLMD_CAP_PAN_IMAGE)) {
+		return DCLMD_NOT_SUPPORTED;
+	}
+
 	if ( (err = dclmdClientLock(comm) ) == DCLM_OK ) {
-		DCLMDWorkEntry *work = comm->work;
-		/* note: it is OK if work->text is not 0-terminated, dclmd takes care */
-		work->cmd_flags = DCLMD_CMD_CLEAR_SCREEN | additional_flags;
+		comm->ext->img_step_x = step_x;
+		comm->ext->img_step_y = step_y;
+		comm->ext->img_step_ms = step_ms;
+		comm->work->cmd_flags |= DCLMD_CMD_PAN_IMAGE;
 		err = dclmdClientUnlock(comm);
 	}
 	return err;
@@ -579,6 +2163,29 @@ dclmdClientBlank(DCLMDComminucation *comm, unsigned int additional_flags)
  * EXTERNAL API: THE COMMUNICATION INTERFACE (daemon side)                  *
  ****************************************************************************/
 
+/* lock the mutex on the daemon side
+ * RETURN 1: mutex locked
+ *        0: client seems dead, mutex not locked
+ *       -1: error
+ */
+static int
+dclmdCommDaemonLock(DCLMDComminucation *comm, const struct timespec *until)
+{
+	int res = dclmdSemTimedWait(comm->sem_mutex, until);
+	if (res < 0) {
+		return -1;
+	}
+	if (res > 0) {
+		/* assume client is dead, unlock it again for the next client */
+		if (sem_post(comm->sem_mutex)) {
+			return -1;
+		}
+		return 0;
+	}
+
+	return 1;
+}
+
 /* Wait for a command from the client,
  * if reached, lock the mutex
  * wait_until: if not NULL: timeout, otherwise: infinite
@@ -608,21 +2215,87 @@ dclmdDaemonGetCommand(DCLMDComminucation *comm, const struct timespec *wait_unti
 	/* count down semaphore to be sure */
 	while(!dclmdSemTryWait(comm->sem_command));
 
-	/* lock the mutex */
 	dclmdCalcWaitTimeMS(&until, now, comm->clientTimeout);
-	res = dclmdSemTimedWait(comm->sem_mutex, &until);
-	if (res < 0) {
+	return dclmdCommDaemonLock(comm, &until);
+}
+
+/* forward the doorbell semaphore to the eventfd */
+static void *
+dclmdCommBridge(void *arg)
+{
+	DCLMDComminucation *comm = (DCLMDComminucation*)arg;
+	uint64_t one = 1;
+
+	while (__atomic_load_n(&comm->bridge_run, __ATOMIC_ACQUIRE)) {
+		if (dclmdSemWait(comm->sem_command)) {
+			break;
+		}
+		if (write(comm->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+/* Get a file descriptor for use with poll/epoll
+ * RETURN: the fd, -1 on error
+ */
+extern int
+dclmdDaemonGetFd(DCLMDComminucation *comm)
+{
+	sigset_t all, old;
+	unsigned int i;
+	int res;
+
+	if (comm->poll_fd >= 0) {
+		return comm->poll_fd;
+	}
+
+	comm->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+	comm->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (comm->poll_fd < 0 || comm->event_fd < 0 || dclmdCommPollAdd(comm, comm->event_fd)) {
 		return -1;
 	}
-	if (res > 0) {
-		/* assume client is dead, unlock it again for the next client */
-		if (sem_post(comm->sem_mutex)) {
+	if (comm->sock_fd >= 0 && dclmdCommPollAdd(comm, comm->sock_fd)) {
+		return -1;
+	}
+	for (i = 0; i < DCLMD_COMM_MAX_CLIENTS; i++) {
+		if (comm->clients[i] && dclmdCommPollAdd(comm, comm->clients[i]->sock_fd)) {
 			return -1;
 		}
-		return 0;
 	}
 
-	return 1;
+	/* signals are none of the bridge's business */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	comm->bridge_run = 1;
+	res = pthread_create(&comm->bridge, NULL, dclmdCommBridge, comm);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (res) {
+		comm->bridge_run = 0;
+		return -1;
+	}
+
+	return comm->poll_fd;
+}
+
+/* Non-blocking variant of dclmdDaemonGetCommand()
+ * RETURN 1: got client command, mutex locked
+ *        0: got no command, mutex not locked
+ *       -1: error
+ */
+extern int
+dclmdDaemonPollCommand(DCLMDComminucation *comm)
+{
+	struct timespec until;
+	uint64_t count;
+
+	if (read(comm->event_fd, &count, sizeof(count)) != (ssize_t)sizeof(count)) {
+		return (errno == EAGAIN || errno == EINTR)?0:-1;
+	}
+
+	dclmdCalcWaitTimeMS(&until, NULL, comm->clientTimeout);
+	return dclmdCommDaemonLock(comm, &until);
 }
 
 /* Unlock the mutex from the daemon side
@@ -633,9 +2306,198 @@ dclmdDaemonGetCommand(DCLMDComminucation *comm, const struct timespec *wait_unti
 extern int
 dclmdDaemonUnlock(DCLMDComminucation *comm)
 {
+	if (comm->ext) {
+		comm->fence = comm->ext->submit_seq;
+		comm->flags |= DCLMD_FLAG_FENCE;
+	}
+
 	/* count down semaphore to be sure */
 	while(!dclmdSemTryWait(comm->sem_mutex));
 
 	return sem_post(comm->sem_mutex);
 }
 
+/* Accept new private connections and drop closed ones
+ * RETURN: number of private connections
+ *         -1 on error
+ */
+extern int
+dclmdDaemonUpdateClients(DCLMDComminucation *comm)
+{
+	unsigned int i;
+	int res, count = 0;
+
+	for (i = 0; i < DCLMD_COMM_MAX_CLIENTS; i++) {
+		if (!comm->clients[i]) {
+			continue;
+		}
+		if (comm->clients[i]->flags & DCLMD_FLAG_HANDSHAKE) {
+			res = (dclmdCommHandshake(comm, comm->clients[i]) < 0);
+		} else {
+			res = dclmdCommClientClosed(comm->clients[i]);
+		}
+		if (res) {
+			dclmdDaemonDropClient(comm, comm->clients[i]);
+		}
+	}
+
+	if (comm->sock_fd >= 0) {
+		do {
+			res = dclmdCommAcceptClient(comm);
+		} while (res > 0);
+		if (res < 0) {
+			return -1;
+		}
+	}
+
+	for (i = 0; i < DCLMD_COMM_MAX_CLIENTS; i++) {
+		if (comm->clients[i]) {
+			count++;
+		}
+	}
+	return count;
+}
+
+/* Set the function called before a private connection is closed
+ */
+extern void
+dclmdDaemonOnClientClose(DCLMDComminucation *comm, DCLMDCloseHandler handler, void *data)
+{
+	comm->close_handler = handler;
+	comm->close_data = data;
+}
+
+/* Close a private connection
+ */
+extern void
+dclmdDaemonDropClient(DCLMDComminucation *comm, DCLMDComminucation *client)
+{
+	unsigned int i;
+
+	for (i = 0; i < DCLMD_COMM_MAX_CLIENTS; i++) {
+		if (comm->clients[i] == client) {
+			if (comm->close_handler && !(client->flags & DCLMD_FLAG_HANDSHAKE)) {
+				comm->close_handler(comm->close_data, client);
+			}
+			dclmdCommunicationDestroy(client);
+			comm->clients[i] = NULL;
+			return;
+		}
+	}
+}
+
+/* Check a private connection for a pending command,
+ * if there is one, lock its mutex. Never waits: the client
+ * can write to its mutex, so a client holding it just has to
+ * wait for the next round.
+ * RETURN 1: got client command, mutex locked
+ *        0: got no command, mutex not locked
+ *       -1: error, the connection should be dropped
+ */
+extern int
+dclmdDaemonGetClientCommand(DCLMDComminucation *client)
+{
+	int res;
+
+	if ((client->flags & DCLMD_FLAG_HANDSHAKE) || !client->work->cmd_flags) {
+		/* nothing to do, no need to lock */
+		return 0;
+	}
+
+	res = dclmdSemTryWait(client->sem_mutex);
+	if (res < 0) {
+		return -1;
+	}
+	if (res > 0) {
+		/* client holds its lock, try again next time */
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Signal the completion of all commands handled since the last call
+ * to the clients waiting for them (including private connections)
+ * err: result of sending the frame
+ */
+extern void
+dclmdDaemonSignal(DCLMDComminucation *comm, DCLEDMatrixError err)
+{
+	unsigned int i;
+
+	if (comm->flags & DCLMD_FLAG_FENCE) {
+		comm->ext->done_err = (int)err;
+		__atomic_store_n(&comm->ext->done_seq, comm->fence, __ATOMIC_RELEASE);
+		dclmdFutexWake(&comm->ext->done_seq);
+		comm->flags &= ~DCLMD_FLAG_FENCE;
+	}
+
+	for (i = 0; i < DCLMD_COMM_MAX_CLIENTS; i++) {
+		if (comm->clients[i]) {
+			dclmdDaemonSignal(comm->clients[i], err);
+		}
+	}
+}
+
+/* Publish the screen shown in the mirror of the shm
+ */
+extern void
+dclmdDaemonMirror(DCLMDComminucation *comm, const DCLMImage *img)
+{
+	DCLMDWorkExt *ext = comm->ext;
+	unsigned int seq;
+	unsigned int i;
+
+	if (ext && img->size <= DCLMD_MIRROR_SIZE) {
+		seq = ext->mirror_seq;
+		__atomic_store_n(&ext->mirror_seq, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		ext->mirror_dims[0] = img->dims[0];
+		ext->mirror_dims[1] = img->dims[1];
+		memcpy(ext->mirror, img->data, img->size);
+		/* never 0, that is "no screen" for the clients */
+		seq += 2;
+		if (!seq) {
+			seq = 2;
+		}
+		__atomic_store_n(&ext->mirror_seq, seq, __ATOMIC_RELEASE);
+	}
+
+	for (i = 0; i < DCLMD_COMM_MAX_CLIENTS; i++) {
+		if (comm->clients[i]) {
+			dclmdDaemonMirror(comm->clients[i], img);
+		}
+	}
+}
+
+/* Get the image the current command refers to
+ * Must only be called after dclmdDaemonGetCommand() returned 1
+ * RETURN 0: OK
+ *       -1: image is inconsistent with the shm
+ */
+extern int
+dclmdDaemonGetImage(DCLMDComminucation *comm, DCLMImage *img)
+{
+	size_t w,h;
+
+	if (!(comm->work->cmd_flags & DCLMD_CMD_IMAGE_SLOT)) {
+		*img = comm->img;
+		return 0;
+	}
+
+	if (!comm->ext) {
+		return -1;
+	}
+
+	w = comm->ext->img_dims[0];
+	h = comm->ext->img_dims[1];
+	if (w < 1 || h < 1 || w > comm->slot.size / h) {
+		return -1;
+	}
+
+	img->dims[0] = w;
+	img->dims[1] = h;
+	img->size = w * h;
+	img->data = comm->slot.data;
+	return 0;
+}
@@ -19,10 +19,24 @@
 
 #include "dclm_error.h"
 #include "dclm_image.h"
+#include "dclm_dlist.h"
 #include <semaphore.h>
+#include <pthread.h>
 
 #define DCLMD_COMM_MAX_TEXT_LENGTH	255
-#define DCLMD_COMM_VERSION		1
+#define DCLMD_COMM_VERSION		1 /* version of DCLMDWorkEntry, never changes */
+#define DCLMD_COMM_EXT_VERSION		14 /* protocol version of DCLMDWorkExt, see there */
+#define DCLMD_COMM_EXT_VERSION_MIN	5 /* oldest protocol version we still speak */
+#define DCLMD_COMM_ALIGN		64
+#define DCLMD_COMM_IMAGE_CAPACITY	(4096*8) /* default size of the image slot in bytes */
+#define DCLMD_COMM_MAX_IMAGE_CAPACITY	(1024*1024) /* maximum image slot for private connections */
+#define DCLMD_COMM_MAX_CLIENTS		16 /* maximum number of private connections */
+#define DCLMD_COMM_DLIST_SIZE		1024 /* size of the display list in bytes */
+#define DCLMD_COMM_MAX_INSTANCE_LEN	24 /* maximum length of an instance name */
+#define DCLMD_COMM_INSTANCE_ENV		"DCLMD_INSTANCE" /* environment variable selecting the instance */
+#define DCLMD_STORE_NAME_LEN		31 /* maximum length of a name in the frame store */
+#define DCLMD_BATCH_MAX_FRAMES		64 /* maximum number of frames per batch */
+#define DCLMD_MIRROR_SIZE		256 /* maximum size of the mirror in pixels */
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,6 +64,105 @@ typedef struct {
 	unsigned int timeout_ms;
 } DCLMDWorkEntry;
 
+/* Extension of the work entry.
+ * This is kept in the shm directly behind the legacy image (see
+ * dclmdCommExtOffset()), so that clients which only know about
+ * DCLMDWorkEntry can still talk to us. It is followed by the
+ * image slot of img_capacity bytes.
+ * The first four fields never change. New fields are only ever
+ * appended together with a new DCLMD_CAP_*, and a client only uses
+ * the first min(ext_size, sizeof(DCLMDWorkExt)) bytes, so appending
+ * does not change DCLMD_COMM_EXT_VERSION: it is only raised for
+ * incompatible changes, and client and daemon can talk as long as
+ * their ranges [DCLMD_COMM_EXT_VERSION_MIN, DCLMD_COMM_EXT_VERSION]
+ * and [version_min, version_max] overlap.
+ * Features are only used if announced in caps.
+ */
+typedef struct {
+	size_t ext_size;
+	unsigned int version_min; /* oldest protocol version the daemon speaks */
+	unsigned int version_max; /* protocol version of the daemon */
+	unsigned int caps;        /* DCLMD_CAP_* supported by the daemon */
+	sem_t lock; /* mutex of private connections */
+	size_t img_capacity; /* size of the image slot in bytes, client should only read this */
+	size_t img_dims[2]; /* dimensions of the image in the slot */
+	int img_step_x; /* pixels to move per pan step */
+	int img_step_y;
+	unsigned int img_step_ms; /* time between pan steps, 0 stops panning */
+	unsigned int submit_seq; /* sequence number of the last submitted command */
+	unsigned int done_seq; /* sequence number of the last command carried out, futex word */
+	int done_err; /* DCLEDMatrixError sending the frame of done_seq */
+	size_t dlist_len; /* bytes used in dlist */
+	uint8_t dlist[DCLMD_COMM_DLIST_SIZE]; /* display list, see dclm_dlist.h */
+	/* DCLMD_CAP_SCHEDULE */
+	unsigned int sched_id; /* timeline item to (un)schedule */
+	int sched_priority; /* the highest priority is shown */
+	unsigned int sched_start_ms; /* delay until the item is shown */
+	unsigned int sched_duration_ms; /* 0: until unscheduled */
+	/* DCLMD_CAP_SCROLL_TEXT */
+	unsigned int scroll_pps; /* marquee speed in pixels per second, 0 stops it */
+	int scroll_dir; /* DCLMD_SCROLL_* */
+	unsigned int scroll_loops; /* number of passes, 0: forever */
+	/* DCLMD_CAP_TRANSITION */
+	int trans_effect; /* DCLM_TRANS_*, see dclm.h */
+	unsigned int trans_duration_ms; /* 0: hard cuts */
+	/* DCLMD_CAP_ANIMATION */
+	int anim_mode; /* DCLMD_ANIM_* */
+	unsigned int anim_loops; /* number of passes, 0: forever */
+	/* DCLMD_CAP_FRAME_STORE */
+	unsigned int store_id; /* key of the frame store entry, together with store_name */
+	char store_name[DCLMD_STORE_NAME_LEN+1];
+	/* DCLMD_CAP_LAYERS */
+	unsigned int layer_id;
+	int layer_z; /* higher is on top */
+	int layer_x, layer_y; /* the region of the layer */
+	int layer_w, layer_h;
+	unsigned int layer_flags; /* DCLMD_LAYER_* */
+	/* DCLMD_CAP_WIDGETS */
+	unsigned int widget_id;
+	int widget_type; /* DCLMD_WIDGET_* */
+	int widget_x, widget_y; /* the region of the widget */
+	int widget_w, widget_h;
+	unsigned int widget_flags; /* DCLMD_WIDGET_* */
+	int widget_value;
+	int widget_max;
+	/* DCLMD_CAP_FRAME_QUEUE */
+	unsigned int batch_count; /* number of frames in the image */
+	unsigned int batch_flags; /* DCLMD_BATCH_* */
+	uint64_t batch_time_ns[DCLMD_BATCH_MAX_FRAMES]; /* presentation times on CLOCK_MONOTONIC */
+	unsigned int batch_presented; /* frames presented, written by the daemon */
+	unsigned int batch_dropped; /* frames dropped as too late, written by the daemon */
+	unsigned int batch_pending; /* frames still queued, written by the daemon */
+	/* DCLMD_CAP_MIRROR */
+	unsigned int mirror_seq; /* seqlock of the mirror: odd while the daemon writes it */
+	size_t mirror_dims[2]; /* dimensions of the screen in the mirror */
+	uint8_t mirror[DCLMD_MIRROR_SIZE]; /* the screen shown, as image */
+	/* DCLMD_CAP_LAYER_TTL */
+	unsigned int layer_ttl_ms; /* the layer set is removed if not set again in time, 0: never */
+} DCLMDWorkExt;
+
+#define DCLMD_BATCH_APPEND	0x1	/* add to the queued frames instead of replacing them */
+
+#define DCLMD_LAYER_ID_ALL	0xffffffffu /* remove all layers */
+#define DCLMD_LAYER_OPAQUE	0x1	/* the layer covers its whole region */
+
+/* widget types */
+#define DCLMD_WIDGET_TEXT	0	/* the text */
+#define DCLMD_WIDGET_CLOCK	1	/* the time of day, or the time elapsed */
+#define DCLMD_WIDGET_COUNTER	2	/* the value as decimal number */
+#define DCLMD_WIDGET_BAR	3	/* a bar of the length value/max */
+#define DCLMD_WIDGET_SPARKLINE	4	/* the history of the values up to max */
+#define DCLMD_WIDGET_ICON	5	/* an image */
+#define DCLMD_WIDGET_COUNT	6
+
+/* widget flags */
+#define DCLMD_WIDGET_ALIGN_RIGHT	0x1	/* text at the right side of the region */
+#define DCLMD_WIDGET_VERTICAL		0x2	/* bar grows upwards */
+#define DCLMD_WIDGET_SECONDS		0x4	/* clock shows seconds */
+#define DCLMD_WIDGET_ELAPSED		0x8	/* clock shows the time elapsed since value seconds ago */
+
+#define DCLMD_WIDGET_ID_ALL	0xffffffffu /* remove all widgets */
+
 /* commands to the deamon */
 #define DCLMD_CMD_CLEAR_SCREEN	0x1
 #define DCLMD_CMD_SHOW_IMAGE	0x2
@@ -58,21 +171,91 @@ typedef struct {
 #define DCLMD_CMD_STOP_REFRESH	0x10
 #define DCLMD_CMD_BRIGHTNESS	0x20		/* DOESN'T WORK! */
 #define DCLMD_CMD_TIMEOUT	0x40
+#define DCLMD_CMD_IMAGE_SLOT	0x100		/* image is in the slot, not the legacy image */
+#define DCLMD_CMD_PAN_IMAGE	0x200		/* pan over the current image */
+#define DCLMD_CMD_DISPLAY_LIST	0x400		/* execute the display list */
+#define DCLMD_CMD_SCHEDULE	0x800		/* put the display list on the timeline */
+#define DCLMD_CMD_UNSCHEDULE	0x1000		/* remove sched_id from the timeline */
+#define DCLMD_CMD_SCROLL_TEXT	0x2000		/* scroll the text as marquee */
+#define DCLMD_CMD_TRANSITION	0x4000		/* set the transition for content changes */
+#define DCLMD_CMD_PLAY_ANIM	0x8000		/* play the animation file named in text */
+#define DCLMD_CMD_STORE		0x10000		/* put the display list into the frame store */
+#define DCLMD_CMD_SHOW_STORED	0x20000		/* show a screen from the frame store */
+#define DCLMD_CMD_DROP_STORED	0x40000		/* remove a screen from the frame store */
+#define DCLMD_CMD_SET_LAYER	0x80000		/* put the display list into a layer */
+#define DCLMD_CMD_REMOVE_LAYER	0x100000	/* remove a layer */
+#define DCLMD_CMD_SET_WIDGET	0x200000	/* create a widget, text holds its text */
+#define DCLMD_CMD_UPDATE_WIDGET	0x400000	/* new contents of a widget */
+#define DCLMD_CMD_REMOVE_WIDGET	0x800000	/* remove a widget */
+#define DCLMD_CMD_QUEUE_FRAMES	0x1000000	/* queue the frames in the image */
 #define DCLMD_CMD_EXIT		0x80000000
 
-typedef struct {
+/* capabilities of the daemon */
+#define DCLMD_CAP_IMAGE_SLOT	0x1	/* variable size image slot */
+#define DCLMD_CAP_PAN_IMAGE	0x2	/* daemon-side panning */
+#define DCLMD_CAP_PRIVATE	0x4	/* private connections via the socket */
+#define DCLMD_CAP_FENCE		0x8	/* completion fences */
+#define DCLMD_CAP_DISPLAY_LIST	0x10	/* display lists */
+#define DCLMD_CAP_SCHEDULE	0x20	/* timeline */
+#define DCLMD_CAP_SCROLL_TEXT	0x40	/* daemon-side marquee */
+#define DCLMD_CAP_TRANSITION	0x80	/* daemon-side transitions */
+#define DCLMD_CAP_ANIMATION	0x100	/* animation files, see dclm_anim.h */
+#define DCLMD_CAP_FRAME_STORE	0x200	/* frame store */
+#define DCLMD_CAP_LAYERS	0x400	/* layers */
+#define DCLMD_CAP_WIDGETS	0x800	/* widgets */
+#define DCLMD_CAP_FRAME_QUEUE	0x1000	/* frame queue with presentation times */
+#define DCLMD_CAP_MIRROR	0x2000	/* the screen shown is mirrored in the shm */
+#define DCLMD_CAP_LAYER_TTL	0x4000	/* layers expire */
+#define DCLMD_CAP_ALL		0x7fff	/* everything this version knows about */
+
+/* sched_id removing all items of the timeline */
+#define DCLMD_SCHED_ID_ALL	0xffffffffU
+
+/* marquee directions */
+#define DCLMD_SCROLL_LEFT	0	/* text enters at the right */
+#define DCLMD_SCROLL_RIGHT	1	/* text enters at the left */
+#define DCLMD_SCROLL_MAX_PPS	1000	/* faster marquees are clamped to this */
+
+/* animation playback modes */
+#define DCLMD_ANIM_LOOP		0	/* start over after the last frame */
+#define DCLMD_ANIM_PINGPONG	1	/* play backwards after the last frame */
+
+struct DCLMDComminucation_s;
+
+/* daemon side: called before a private connection is closed */
+typedef void (*DCLMDCloseHandler)(void *data, struct DCLMDComminucation_s *client);
+
+typedef struct DCLMDComminucation_s {
 	sem_t *sem_mutex;
 	sem_t *sem_command;
 	int shm_fd;
+	int sock_fd;
+	int poll_fd;             /* daemon side: epoll set, see dclmdDaemonGetFd() */
+	int event_fd;            /* daemon side: the doorbell as eventfd */
+	pthread_t bridge;        /* daemon side: forwards sem_command to event_fd */
+	int bridge_run;
 	size_t shm_size;
 	unsigned flags;
 	unsigned clientTimeout;  /* in ms */
 	unsigned recreateTimeout; /* in ms */
+	unsigned fence;           /* daemon side: sequence number to signal */
+	unsigned caps;            /* negotiated DCLMD_CAP_*, 0 without ext */
+	struct timespec deadline; /* daemon side: end of the handshake of a private connection */
+	DCLMDCloseHandler close_handler; /* daemon side: see dclmdDaemonOnClientClose() */
+	void *close_data;
+	unsigned layer_ttl_ms;    /* client side: see dclmdClientSetLayerTTL() */
+	char instance[DCLMD_COMM_MAX_INSTANCE_LEN+1]; /* "" is the default instance */
 	DCLMDWorkEntry *work;  /* in shm */ 
+	DCLMDWorkExt *ext;     /* in shm, NULL if not supported by the daemon */
 	DCLMImage img;         /* pointer in shm */
+	DCLMImage slot;        /* pointer in shm: the image slot */
+	struct DCLMDComminucation_s *clients[DCLMD_COMM_MAX_CLIENTS]; /* daemon side: private connections */
 } DCLMDComminucation;
 
 #define DCLMD_FLAG_DAEMON	0x1	/* is daemon side */	
+#define DCLMD_FLAG_PRIVATE	0x2	/* private connection via memfd */
+#define DCLMD_FLAG_FENCE	0x4	/* daemon side: fence must be signaled */
+#define DCLMD_FLAG_HANDSHAKE	0x8	/* daemon side: private connection waiting for its request */
 
 /****************************************************************************
  * TIMING HELPERS                                                           *
@@ -105,6 +288,23 @@ dclmdSemTimedWaitMS(sem_t *sem, unsigned int ms);
  * FUNCTIONS FOR THE COMMUNICATION INTERFACE (client and daemon)            *
  ****************************************************************************/ 
 
+/* Get the offset of the DCLMDWorkExt in the shm,
+ * for a legacy image of img_size bytes.
+ */
+extern size_t
+dclmdCommExtOffset(size_t img_size);
+
+/* Get the name of a daemon instance.
+ * Every instance has its own shm, semaphores and socket,
+ * so that one daemon per LED matrix can be run.
+ * instance: NULL for the instance named in the environment
+ *           variable DCLMD_COMM_INSTANCE_ENV, "" for the default
+ * RETURN: the instance name, "" for the default instance,
+ *         NULL if the name is invalid
+ */
+extern const char *
+dclmdCommResolveInstance(const char *instance);
+
 /* Create the communication interface.
  * If daemon is true: create the deamon side,
  * in daemon mode, the size of the LED matrix must be specified!
@@ -115,6 +315,11 @@ dclmdSemTimedWaitMS(sem_t *sem, unsigned int ms);
 extern DCLMDComminucation *
 dclmdCommunicationCreate(int deamon, int dims_x, int dims_y);
 
+/* Same as dclmdCommunicationCreate(), for a daemon instance,
+ * see dclmdCommResolveInstance() for instance */
+extern DCLMDComminucation *
+dclmdCommunicationCreateInstance(const char *instance, int deamon, int dims_x, int dims_y);
+
 /* Destroy the communication interface */
 extern void
 dclmdCommunicationDestroy(DCLMDComminucation *comm);
@@ -130,6 +335,39 @@ dclmdCommunicationDestroy(DCLMDComminucation *comm);
 extern DCLMDComminucation *
 dclmdCommunicationClientCreate(void);
 
+/* Create the communication interface as client of a daemon instance.
+ * instance: see dclmdCommResolveInstance()
+ */
+extern DCLMDComminucation *
+dclmdCommunicationClientCreateInstance(const char *instance);
+
+/* Create a private connection to the daemon as client.
+ * The client gets its own shm (a memfd passed via a
+ * unix domain socket) and its own lock, so it is isolated
+ * from all other clients. The API is the same as for
+ * the shared interface.
+ * img_capacity: requested size of the image slot in bytes,
+ *               0 for the default
+ * RETURN: pointer to newly alloced structure,
+ *         NULL on error
+ */
+extern DCLMDComminucation *
+dclmdCommunicationClientCreatePrivate(size_t img_capacity);
+
+/* Create a private connection to a daemon instance as client.
+ * instance: see dclmdCommResolveInstance()
+ */
+extern DCLMDComminucation *
+dclmdCommunicationClientCreatePrivateInstance(const char *instance, size_t img_capacity);
+
+/* Get the capabilities negotiated with the daemon.
+ * Clients should check these before using a feature,
+ * the functions for unsupported features return DCLMD_NOT_SUPPORTED.
+ * RETURN: bitmask of DCLMD_CAP_*, 0 for a legacy daemon
+ */
+extern unsigned int
+dclmdClientGetCaps(const DCLMDComminucation *comm);
+
 /* Lock the communication interface as client.
  * If this returns successfully, you can write
  * to the work entry and MUST call
@@ -148,6 +386,40 @@ dclmdClientLock(DCLMDComminucation *comm);
 extern DCLEDMatrixError
 dclmdClientUnlock(DCLMDComminucation *comm);
 
+/* Try to lock the communication interface as client,
+ * without blocking. Same as dclmdClientLock() otherwise.
+ * RETURN: DCLM_OK if successfull,
+ *         DCLMD_COMMUNICATION_BUSY if currently locked
+ */
+extern DCLEDMatrixError
+dclmdClientTryLock(DCLMDComminucation *comm);
+
+/* Unlock the communication interface as client,
+ * same as dclmdClientUnlock(), but also get the
+ * sequence number of the submitted command, which can be
+ * used with dclmdClientSeqDone() and dclmdClientWaitSeq().
+ * seq is set to 0 if the daemon does not support this.
+ */
+extern DCLEDMatrixError
+dclmdClientSubmit(DCLMDComminucation *comm, unsigned int *seq);
+
+/* Check if the command with sequence number seq was carried out
+ * RETURN 1: done
+ *        0: still pending
+ *       -1: not supported by the daemon
+ */
+extern int
+dclmdClientSeqDone(const DCLMDComminucation *comm, unsigned int seq);
+
+/* Wait until the command with sequence number seq was carried out
+ * timeout_ms: DCLMD_TIMEOUT_INFINITE means infinite
+ * RETURN: DCLM_OK if the frame was sent,
+ *         the error sending the frame,
+ *         or DCLMD_COMMUNICATION_TIMEOUT
+ */
+extern DCLEDMatrixError
+dclmdClientWaitSeq(DCLMDComminucation *comm, unsigned int seq, unsigned int timeout_ms);
+
 /* Full cycle: Show text
  * if str is NULL: blank
  * If len is 0: use strlen
@@ -156,11 +428,254 @@ dclmdClientUnlock(DCLMDComminucation *comm);
 extern DCLEDMatrixError
 dclmdClientShowText(DCLMDComminucation *comm, const char *str, size_t len, int pos_x,  unsigned int additional_flags, unsigned int timeout_ms);
 
+/* Non-blocking: Show text
+ * Same as dclmdClientShowText(), but never waits for the lock.
+ * seq: receives the sequence number of the command, may be NULL
+ * RETURN: DCLMD_COMMUNICATION_BUSY if the interface is currently locked
+ */
+extern DCLEDMatrixError
+dclmdClientSubmitText(DCLMDComminucation *comm, const char *str, size_t len, int pos_x,  unsigned int additional_flags, unsigned int timeout_ms, unsigned int *seq);
+
 /* Full cycle: Blank the screen
  */
 extern DCLEDMatrixError
 dclmdClientBlank(DCLMDComminucation *comm, unsigned int additional_flags);
 
+/* Full cycle: Show an image
+ * The image may be of any size up to the capacity of the image slot,
+ * images which do not exactly fit the LED matrix are put into the slot.
+ * pos_x, pos_y: the image position shown at the top left LED
+ * timeout_ms: 0 means infinite
+ */
+extern DCLEDMatrixError
+dclmdClientShowImage(DCLMDComminucation *comm, const DCLMImage *img, int pos_x, int pos_y, unsigned int additional_flags, unsigned int timeout_ms);
+
+/* Full cycle: Execute a display list
+ * All operations are carried out at once, and the result is sent
+ * as a single frame.
+ * img: image for the DCLM_DL_BLIT operations, may be NULL
+ *      (then the image currently in the shm is used)
+ * timeout_ms: 0 means infinite
+ */
+extern DCLEDMatrixError
+dclmdClientShowDList(DCLMDComminucation *comm, const DCLMDisplayList *dl, const DCLMImage *img, unsigned int additional_flags, unsigned int timeout_ms);
+
+/* Full cycle: Put a display list on the daemon's timeline
+ * The list is rendered right away (onto a blank screen, blits use img),
+ * and shown from start_ms from now on for duration_ms instead of the
+ * regular contents, if there is no item with higher priority.
+ * When it expires, whatever was shown before comes back, so the
+ * client does not need to stay around.
+ * id: chosen by the client, replaces an item with the same id
+ * duration_ms: 0 means until unscheduled
+ */
+extern DCLEDMatrixError
+dclmdClientSchedule(DCLMDComminucation *comm, unsigned int id, const DCLMDisplayList *dl, const DCLMImage *img,
+		    int priority, unsigned int start_ms, unsigned int duration_ms);
+
+/* Full cycle: Remove an item from the daemon's timeline
+ * id: DCLMD_SCHED_ID_ALL removes all items
+ */
+extern DCLEDMatrixError
+dclmdClientUnschedule(DCLMDComminucation *comm, unsigned int id);
+
+/* Full cycle: Scroll text as marquee
+ * The text is sent once, the daemon moves it by itself at
+ * pixels_per_sec in direction (DCLMD_SCROLL_*). The position is
+ * derived from the time since the start, so the speed is exact
+ * no matter how fast frames can be sent.
+ * One loop is the text scrolling in and out completely.
+ * If len is 0: use strlen
+ * pixels_per_sec: 0 stops the marquee
+ * loops: 0 means forever, the screen is blanked after the last loop
+ */
+extern DCLEDMatrixError
+dclmdClientScrollText(DCLMDComminucation *comm, const char *str, size_t len, unsigned int pixels_per_sec,
+		      int direction, unsigned int loops, unsigned int additional_flags);
+
+/* Full cycle: Set the transition between screens
+ * All following content changes (text, images, display lists,
+ * blanking and the timeline) fade over from the screen shown
+ * before within duration_ms, the frames are computed by the daemon.
+ * effect: DCLM_TRANS_* (see dclm.h), DCLM_TRANS_CUT switches them off
+ */
+extern DCLEDMatrixError
+dclmdClientSetTransition(DCLMDComminucation *comm, int effect, unsigned int duration_ms);
+
+/* Full cycle: Play an animation file
+ * The daemon reads the whole file into memory (see dclm_anim.h) and
+ * plays it by itself, path is made absolute here, so it must be
+ * readable by the daemon. Only regular files of at most
+ * DCLM_ANIM_MAX_SIZE (4 MiB) are played, the daemon ignores others
+ * with a warning in its log.
+ * mode: DCLMD_ANIM_*
+ * loops: number of passes, 0 means forever, the last frame stays
+ *        on the screen afterwards. A pass of DCLMD_ANIM_PINGPONG is
+ *        one way only.
+ * path: NULL stops the animation
+ */
+extern DCLEDMatrixError
+dclmdClientPlayAnim(DCLMDComminucation *comm, const char *path, int mode, unsigned int loops, unsigned int additional_flags);
+
+/* Full cycle: Put a display list into the daemon's frame store
+ * The list is rendered right away (onto a blank screen, blits use img),
+ * and kept by the daemon until dropped, so showing it later by its key
+ * with dclmdClientShowStored() costs no rendering at all.
+ * An entry with the same key is replaced.
+ * id, name: the key of the entry, name may be NULL, so plain
+ *           numbers, plain names or both can be used
+ */
+extern DCLEDMatrixError
+dclmdClientStoreDList(DCLMDComminucation *comm, unsigned int id, const char *name,
+		      const DCLMDisplayList *dl, const DCLMImage *img);
+
+/* Full cycle: Put an image into the daemon's frame store,
+ * the top left part of the image is stored.
+ * see dclmdClientStoreDList()
+ */
+extern DCLEDMatrixError
+dclmdClientStoreImage(DCLMDComminucation *comm, unsigned int id, const char *name, const DCLMImage *img);
+
+/* Full cycle: Show a screen from the daemon's frame store
+ * timeout_ms: 0 means infinite
+ */
+extern DCLEDMatrixError
+dclmdClientShowStored(DCLMDComminucation *comm, unsigned int id, const char *name,
+		      unsigned int additional_flags, unsigned int timeout_ms);
+
+/* Full cycle: Remove a screen from the daemon's frame store */
+extern DCLEDMatrixError
+dclmdClientDropStored(DCLMDComminucation *comm, unsigned int id, const char *name);
+
+/* Full cycle: Put a display list into a layer
+ * Layers are composed on top of whatever the daemon shows otherwise,
+ * so several clients can share the screen without knowing of each
+ * other: each one just uses its own layer id.
+ * The list is rendered onto a blank screen (blits use img), and
+ * clipped to the region x, y, w, h.
+ * z: layers with higher z are on top, the newer one on equal z
+ * flags: DCLMD_LAYER_OPAQUE: the layer covers its whole region,
+ *        otherwise only its lit pixels
+ * A layer with the same id is replaced.
+ */
+extern DCLEDMatrixError
+dclmdClientSetLayer(DCLMDComminucation *comm, unsigned int id, int z,
+		    int x, int y, int w, int h, unsigned int flags,
+		    const DCLMDisplayList *dl, const DCLMImage *img);
+
+/* Let the layers set with dclmdClientSetLayer() from now on expire:
+ * the daemon removes a layer which was not set again within ttl_ms.
+ * This keeps a crashed producer from freezing the screen; layers of
+ * private connections are removed anyway once they are closed.
+ * ttl_ms: 0: never expire (the default)
+ */
+extern DCLEDMatrixError
+dclmdClientSetLayerTTL(DCLMDComminucation *comm, unsigned int ttl_ms);
+
+/* Full cycle: Remove a layer
+ * id: DCLMD_LAYER_ID_ALL removes all layers
+ */
+extern DCLEDMatrixError
+dclmdClientRemoveLayer(DCLMDComminucation *comm, unsigned int id);
+
+/* Full cycle: Create a widget
+ * Widgets are drawn by the daemon in fixed regions on top of everything
+ * else, and only drawn again when what they show changes.
+ * type: DCLMD_WIDGET_*
+ * x, y, w, h: the region of the widget, regions should not overlap
+ * flags: DCLMD_WIDGET_* flags
+ * value, text: the initial contents, see dclmdClientUpdateWidget()
+ * max: the value of a full bar or sparkline, 0 means 100
+ * icon: the image of a DCLMD_WIDGET_ICON, NULL otherwise
+ * A widget with the same id is replaced.
+ */
+extern DCLEDMatrixError
+dclmdClientSetWidget(DCLMDComminucation *comm, unsigned int id, int type,
+		     int x, int y, int w, int h, unsigned int flags,
+		     int value, int max, const char *text, const DCLMImage *icon);
+
+/* Full cycle: Set new contents of a widget
+ * text: for DCLMD_WIDGET_TEXT, may be NULL otherwise
+ * value: DCLMD_WIDGET_COUNTER, DCLMD_WIDGET_BAR: the value shown
+ *        DCLMD_WIDGET_SPARKLINE: the next sample
+ *        DCLMD_WIDGET_CLOCK with DCLMD_WIDGET_ELAPSED: the seconds
+ *        already elapsed, the clock restarts from there
+ * As with all commands, only the last of several updates the daemon
+ * did not pick up yet counts, use dclmdClientWaitSeq() if every
+ * sample of a sparkline matters.
+ */
+extern DCLEDMatrixError
+dclmdClientUpdateWidget(DCLMDComminucation *comm, unsigned int id, int value, const char *text);
+
+/* Full cycle: Remove a widget
+ * id: DCLMD_WIDGET_ID_ALL removes all widgets
+ */
+extern DCLEDMatrixError
+dclmdClientRemoveWidget(DCLMDComminucation *comm, unsigned int id);
+
+/* Full cycle: Queue frames to be presented at given times
+ * The daemon shows each frame at its time, frames it could only show
+ * late are dropped (see dclmdClientGetFrameStats()).
+ * frames: count images of the size of the LED matrix, one below the
+ *         other, so frames->dims[1] is count times the height
+ * times: count presentation times on CLOCK_MONOTONIC
+ * flags: DCLMD_BATCH_APPEND: keep the frames still queued by this
+ *        connection, otherwise they are replaced
+ * The batch is queued completely or not at all, the daemon ignores a
+ * batch which does not fit into its queue.
+ * seq: if not NULL, the sequence number, see dclmdClientSubmit()
+ */
+extern DCLEDMatrixError
+dclmdClientQueueFrames(DCLMDComminucation *comm, const DCLMImage *frames, const struct timespec *times,
+		       unsigned int count, unsigned int flags, unsigned int *seq);
+
+/* Get the statistics of the frame queue: the number of frames
+ * presented and dropped, and the number of frames still queued.
+ * Any pointer may be NULL.
+ * The numbers count the frames queued through this connection since
+ * its last batch without DCLMD_BATCH_APPEND. Frames which were late,
+ * overtaken, replaced by another batch or cleared by another command
+ * count as dropped. A batch of another connection starts over: the
+ * numbers then stay as they were when its frames were replaced.
+ * On the shared connection, the numbers are those of whichever
+ * client queued frames last, use a private connection to get your own.
+ */
+extern DCLEDMatrixError
+dclmdClientGetFrameStats(const DCLMDComminucation *comm, unsigned int *presented,
+			 unsigned int *dropped, unsigned int *pending);
+
+/* Read the screen the daemon currently shows, without locking
+ * anything, so this can be called as often as needed (for example
+ * once per rendered frame) without disturbing other clients.
+ * seq: in: the sequence number of the screen img has, 0 for none
+ *      out: the sequence number of the screen in img
+ * img: gets the screen, lit pixels are 0xff, the others 0,
+ *      parts outside of the screen are cleared
+ * RETURN 1: img has a new screen
+ *        0: the screen did not change since seq, or the daemon
+ *           is just writing it: try again later
+ *       -1: not supported by the daemon
+ */
+extern int
+dclmdClientReadMirror(const DCLMDComminucation *comm, unsigned int *seq, DCLMImage *img);
+
+/* Check without blocking if the daemon of this connection is gone.
+ * A daemon started later does not use this connection, so clients
+ * which only read (like the mirror) have to connect again.
+ * RETURN 1: the daemon exited, or closed the private connection
+ *        0: the daemon is still there
+ */
+extern int
+dclmdClientDaemonGone(const DCLMDComminucation *comm);
+
+/* Full cycle: Pan over the image the daemon currently shows
+ * The daemon moves the image position by step_x, step_y
+ * every step_ms milliseconds, wrapping around at the image borders.
+ * step_ms: 0 stops panning
+ */
+extern DCLEDMatrixError
+dclmdClientPanImage(DCLMDComminucation *comm, int step_x, int step_y, unsigned int step_ms);
+
 /****************************************************************************
  * EXTERNAL API: THE COMMUNICATION INTERFACE (daemon side)                  *
  ****************************************************************************/
@@ -175,16 +690,90 @@ dclmdClientBlank(DCLMDComminucation *comm, unsigned int additional_flags);
 extern int
 dclmdDaemonGetCommand(DCLMDComminucation *comm, const struct timespec *wait_until, const struct timespec *now);
 
+/* Get a file descriptor for use with poll/epoll, which becomes
+ * readable when there is something to do for the daemon:
+ * a command might be pending, or private connections want to be
+ * accepted or were closed. Call dclmdDaemonPollCommand() and
+ * dclmdDaemonUpdateClients() then.
+ * The doorbell semaphore of legacy clients is forwarded by an internal
+ * thread, so dclmdDaemonGetCommand() must not be used any more
+ * after this was called.
+ * RETURN: the fd, -1 on error
+ */
+extern int
+dclmdDaemonGetFd(DCLMDComminucation *comm);
+
+/* Non-blocking variant of dclmdDaemonGetCommand(),
+ * for use with dclmdDaemonGetFd()
+ * RETURN 1: got client command, mutex locked
+ *        0: got no command, mutex not locked
+ *       -1: error
+ */
+extern int
+dclmdDaemonPollCommand(DCLMDComminucation *comm);
+
 #define DCLMD_TIMEOUT_INFINITE ((unsigned int)-1)
 
 /* Unlock the mutex from the daemon side
  * Must only be called after dclmdDaemonGetCommand() returned 1
+ * The command is considered handled, and will be signaled
+ * with the next dclmdDaemonSignal()
  * RETURN 0: OK
  *       -1: error
  */
 extern int
 dclmdDaemonUnlock(DCLMDComminucation *comm);
 
+/* Accept new private connections and drop closed ones
+ * RETURN: number of private connections
+ *         -1 on error
+ */
+extern int
+dclmdDaemonUpdateClients(DCLMDComminucation *comm);
+
+/* Set the function called before a private connection is closed,
+ * so whatever belongs to it can be cleaned up
+ */
+extern void
+dclmdDaemonOnClientClose(DCLMDComminucation *comm, DCLMDCloseHandler handler, void *data);
+
+/* Close a private connection, e.g. after an error
+ */
+extern void
+dclmdDaemonDropClient(DCLMDComminucation *comm, DCLMDComminucation *client);
+
+/* Check a private connection for a pending command,
+ * if there is one, lock its mutex. Never waits, a client
+ * holding its mutex is checked again next time.
+ * RETURN 1: got client command, mutex locked
+ *        0: got no command, mutex not locked
+ *       -1: error, drop the connection
+ */
+extern int
+dclmdDaemonGetClientCommand(DCLMDComminucation *client);
+
+/* Signal the completion of all commands handled since the last call
+ * to the clients waiting for them (including private connections)
+ * err: result of sending the frame
+ */
+extern void
+dclmdDaemonSignal(DCLMDComminucation *comm, DCLEDMatrixError err);
+
+/* Publish the screen shown in the mirror of the shm
+ * (including private connections)
+ * img: the screen, as image
+ */
+extern void
+dclmdDaemonMirror(DCLMDComminucation *comm, const DCLMImage *img);
+
+/* Get the image the current command refers to
+ * Must only be called after dclmdDaemonGetCommand() returned 1
+ * RETURN 0: OK
+ *       -1: image is inconsistent with the shm
+ */
+extern int
+dclmdDaemonGetImage(DCLMDComminucation *comm, DCLMImage *img);
+
 #ifdef __cplusplus
 }	/* extern "C" */
 #endif
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* dclmanim: compile PBM images into an animation file for dclmd */
+
+#include "dclm_anim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define DCLMANIM_COLS 21
+#define DCLMANIM_ROWS 7
+#define DCLMANIM_DEFAULT_MS 100
+
+/****************************************************************************
+ * ERRORS and DIAGNOSTICS                                                   *
+ ****************************************************************************/
+
+static void
+dclmaWarning(const char *template, ...)
+{
+	va_list args;
+
+	fprintf(stderr,"dclmanim: warning: ");
+	va_start(args, template);
+	vfprintf(stderr, template, args);
+	va_end(args);
+	fputc('\n',stderr);
+}
+
+/****************************************************************************
+ * PBM FILES                                                                *
+ ****************************************************************************/
+
+/* add all images of a PBM file
+ * RETURN: number of images added, -1 on error
+ */
+static int
+add_pbm(DCLMAnimWriter *w, DCLMImage *img, const char *name, unsigned int duration_ms)
+{
+	FILE *file;
+	int count = 0;
+	int res;
+
+	file = (strcmp(name, "-"))?fopen(name, "rb"):stdin;
+	if (!file) {
+		dclmaWarning("can't open '%s'", name);
+		return -1;
+	}
+	while ( (res = dclmImageReadPBM(file, img)) > 0) {
+		if (dclmAnimWriterAddImage(w, img, duration_ms)) {
+			dclmaWarning("out of memory");
+			res = -1;
+			break;
+		}
+		count++;
+	}
+	if (res < 0) {
+		dclmaWarning("'%s' is not a valid PBM file", name);
+	}
+	if (file != stdin) {
+		fclose(file);
+	}
+	return (res < 0)?-1:count;
+}
+
+/****************************************************************************
+ * main                                                                     *
+ ****************************************************************************/
+
+static void
+print_help(void)
+{
+	printf("usage: dclmanim -o OUTPUT [-d MS] FILE [[-d MS] FILE ...]\n\n");
+	printf("compile PBM images (P1 or P4, several images per file are fine)\n");
+	printf("into an animation file for dclmd, '-' reads from stdin.\n\n");
+	printf("available options:\n");
+	printf(" -o, --output FILE   the animation file to write\n");
+	printf(" -d, --duration MS   duration of the frames of the following files,\n");
+	printf("                     default: %d\n", DCLMANIM_DEFAULT_MS);
+	printf(" -h, --help          print this help and exit\n");
+	printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	DCLMAnimWriter w;
+	DCLMImage *img;
+	const char *output = NULL;
+	unsigned int duration_ms = DCLMANIM_DEFAULT_MS;
+	int i;
+	int status = 0;
+
+	for (i=1; i<argc; i++) {
+		if ((!strcmp(argv[i],"-o") || !strcmp(argv[i], "--output")) && i+1 < argc) {
+			output = argv[++i];
+			continue;
+		}
+		if (!strcmp(argv[i],"-h") || !strcmp(argv[i], "--help") ) {
+			print_help();
+			return status;
+		}
+	}
+	if (!output) {
+		print_help();
+		return 1;
+	}
+
+	img = dclmImageCreate(DCLMANIM_COLS, DCLMANIM_ROWS, NULL);
+	if (!img) {
+		dclmaWarning("out of memory");
+		return 2;
+	}
+	dclmAnimWriterInit(&w);
+
+	for (i=1; i<argc && !status; i++) {
+		if (!strcmp(argv[i],"-o") || !strcmp(argv[i], "--output")) {
+			i++;
+			continue;
+		}
+		if ((!strcmp(argv[i],"-d") || !strcmp(argv[i], "--duration")) && i+1 < argc) {
+			duration_ms = (unsigned int)strtoul(argv[++i], NULL, 10);
+			continue;
+		}
+		if (add_pbm(&w, img, argv[i], duration_ms) < 0) {
+			status = 3;
+		}
+	}
+
+	if (!status) {
+		if (!w.frame_count) {
+			dclmaWarning("no frames");
+			status = 1;
+		} else if (dclmAnimWriterSave(&w, output)) {
+			dclmaWarning("failed to write '%s'", output);
+			status = 4;
+		} else {
+			printf("%s: %u frames, %u bytes of frame data\n", output, w.frame_count, (unsigned)w.data_size);
+		}
+	}
+
+	dclmAnimWriterCleanup(&w);
+	dclmImageDestroy(img);
+	return status;
+}
+
@@ -14,11 +14,64 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* dclmclient: send commands to dclmd, either a single one given on the
+ * command line, or a stream of them read line by line from stdin over
+ * one connection */
+
 #include "dclmd_comm.h"
+#include "dclm_resample.h"
+#include "dclm_dither.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+/* a line of the stream: the command and the longest text */
+#define DCLMC_LINE_LENGTH	(DCLMD_COMM_MAX_TEXT_LENGTH + 64)
+
+/* defaults of the raw video mode */
+#define DCLMC_VIDEO_FPS		25.0
+#define DCLMC_VIDEO_MAX_SIZE	(1u<<26) /* bytes per frame */
+
+/* results of a command */
+#define DCLMC_OK		0
+#define DCLMC_BAD_COMMAND	1
+#define DCLMC_FAILED		2
+
+typedef struct {
+	DCLMDComminucation *comm;
+	DCLMImage *img; /* the size of the LED matrix */
+	FILE *input; /* where "image -" reads from */
+	unsigned int timeout_ms; /* for text and images */
+} DCLMClient;
+
+/* the raw video mode: all buffers are allocated once */
+typedef struct {
+	size_t dims[2]; /* of the input frames */
+	size_t bpp; /* bytes per pixel, which is also the DCLM_RESAMPLE_* format */
+	size_t frame_size;
+	double fps;
+	uint8_t *frame;
+	DCLMResampler rs;
+	DCLMImage *gray; /* the frame resampled to the LED matrix */
+	int dither_mode; /* DCLM_DITHER_* */
+	DCLMDither dither;
+	DCLMImage *shown; /* the frame sent last */
+
+	/* statistics */
+	unsigned long frames;
+	unsigned long sent;
+	unsigned long late;
+	uint64_t convert_ns, convert_max_ns;
+	uint64_t send_ns, send_max_ns;
+} DCLMCVideo;
+
+static volatile sig_atomic_t dclmcStop = 0;
 
 /****************************************************************************
  * ERRORS and DIAGNOSTICS                                                   *
@@ -52,48 +105,554 @@ dclmcDebug(const char *template, ...)
 }
 #endif
 
+/****************************************************************************
+ * COMMANDS                                                                 *
+ ****************************************************************************/
+
+/* parse an unsigned number, the whole string must be used
+ * RETURN: 0 if OK, -1 otherwise
+ */
+static int
+parse_uint(const char *str, unsigned int *value)
+{
+	char *end;
+	unsigned long v;
+
+	if (!isdigit((unsigned char)*str)) {
+		return -1;
+	}
+	v = strtoul(str, &end, 10);
+	if (*end || v > (unsigned int)-1) {
+		return -1;
+	}
+	*value = (unsigned int)v;
+	return 0;
+}
+
+/* RETURN: DCLMC_* for the result of sending command cmd */
+static int
+cmd_result(const char *cmd, DCLEDMatrixError err)
+{
+	if (err != DCLM_OK) {
+		dclmcWarning("%s: failed to send the command: %d", cmd, (int)err);
+		return DCLMC_FAILED;
+	}
+	return DCLMC_OK;
+}
+
+static int
+cmd_image(DCLMClient *cl, const char *name)
+{
+	FILE *file;
+	int res;
+
+	file = (strcmp(name, "-"))?fopen(name, "rb"):cl->input;
+	if (!file) {
+		dclmcWarning("can't open '%s'", name);
+		return DCLMC_BAD_COMMAND;
+	}
+	res = dclmImageReadPBM(file, cl->img);
+	if (file != cl->input) {
+		fclose(file);
+	}
+	if (res <= 0) {
+		dclmcWarning("'%s' is not a valid PBM file", name);
+		return DCLMC_BAD_COMMAND;
+	}
+	return cmd_result("image", dclmdClientShowImage(cl->comm, cl->img, 0, 0, 0, cl->timeout_ms));
+}
+
+static int
+cmd_scroll(DCLMClient *cl, char *args)
+{
+	char *text = args;
+	int dir = DCLMD_SCROLL_LEFT;
+	unsigned int pps;
+
+	if (*text == '-') {
+		dir = DCLMD_SCROLL_RIGHT;
+		text++;
+	}
+	text += strcspn(text, " \t");
+	if (*text) {
+		*text++ = 0;
+	}
+	if (parse_uint(args + (dir == DCLMD_SCROLL_RIGHT), &pps)) {
+		dclmcWarning("scroll: invalid speed '%s'", args);
+		return DCLMC_BAD_COMMAND;
+	}
+	return cmd_result("scroll", dclmdClientScrollText(cl->comm, text, 0, pps, dir, 0, 0));
+}
+
+/* carry out one command: the first word of line is the command, the
+ * rest (after a single blank) its argument
+ * RETURN: DCLMC_OK, DCLMC_BAD_COMMAND if line makes no sense,
+ *         DCLMC_FAILED if the daemon could not be reached
+ */
+static int
+run_command(DCLMClient *cl, char *line)
+{
+	char *args;
+
+	args = line + strcspn(line, " \t");
+	if (*args) {
+		*args++ = 0;
+	}
+
+	if (!strcmp(line, "text")) {
+		return cmd_result(line, dclmdClientShowText(cl->comm, args, 0, 0, 0, cl->timeout_ms));
+	}
+	if (!strcmp(line, "clear")) {
+		return cmd_result(line, dclmdClientBlank(cl->comm, 0));
+	}
+	if (!strcmp(line, "image")) {
+		return cmd_image(cl, args);
+	}
+	if (!strcmp(line, "scroll")) {
+		return cmd_scroll(cl, args);
+	}
+	if (!strcmp(line, "timeout")) {
+		if (parse_uint(args, &cl->timeout_ms)) {
+			dclmcWarning("timeout: invalid value '%s'", args);
+			return DCLMC_BAD_COMMAND;
+		}
+		return DCLMC_OK;
+	}
+	dclmcWarning("unknown command '%s'", line);
+	return DCLMC_BAD_COMMAND;
+}
+
+/* read commands line by line, until the end of the input
+ * empty lines and lines starting with '#' are ignored
+ * RETURN: DCLMC_OK, or DCLMC_FAILED if the daemon could not be reached
+ */
+static int
+run_stream(DCLMClient *cl)
+{
+	char line[DCLMC_LINE_LENGTH];
+	unsigned long lineno = 0;
+	size_t len;
+	int c;
+
+	while (fgets(line, sizeof(line), cl->input)) {
+		lineno++;
+		len = strlen(line);
+		if (len && line[len-1] == '\n') {
+			line[--len] = 0;
+		} else if (!feof(cl->input)) {
+			dclmcWarning("line %lu: too long, ignored", lineno);
+			do {
+				c = fgetc(cl->input);
+			} while (c != EOF && c != '\n');
+			continue;
+		}
+		if (len && line[len-1] == '\r') {
+			line[--len] = 0;
+		}
+		if (!len || line[0] == '#') {
+			continue;
+		}
+		if (run_command(cl, line) == DCLMC_FAILED) {
+			return DCLMC_FAILED;
+		}
+	}
+	return DCLMC_OK;
+}
+
+/****************************************************************************
+ * RAW VIDEO                                                                *
+ ****************************************************************************/
+
+static void
+stop_handler(int sig)
+{
+	(void)sig;
+	dclmcStop = 1;
+}
+
+static uint64_t
+time_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000u + (uint64_t)ts->tv_nsec;
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return time_ns(&ts);
+}
+
+/* parse WIDTHxHEIGHT
+ * RETURN: 0 if OK, -1 otherwise
+ */
+static int
+parse_size(const char *str, size_t *dims)
+{
+	char *end;
+	unsigned long w, h;
+
+	w = strtoul(str, &end, 10);
+	if (*end != 'x') {
+		return -1;
+	}
+	h = strtoul(end + 1, &end, 10);
+	if (*end || !w || !h || w > 65535 || h > 65535) {
+		return -1;
+	}
+	dims[0] = (size_t)w;
+	dims[1] = (size_t)h;
+	return 0;
+}
+
+/* RETURN: the DCLM_DITHER_* mode of a name, -1 if unknown */
+static int
+parse_dither(const char *str)
+{
+	static const char *names[DCLM_DITHER_COUNT] = {
+		"threshold", "bayer", "floyd", "bluenoise", "temporal"
+	};
+	int i;
+
+	for (i = 0; i < DCLM_DITHER_COUNT; i++) {
+		if (!strcmp(str, names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* RETURN: the bytes per pixel of a pixel format, 0 if unknown */
+static size_t
+parse_format(const char *str)
+{
+	if (!strcmp(str, "gray")) {
+		return 1;
+	}
+	if (!strcmp(str, "rgb24")) {
+		return 3;
+	}
+	if (!strcmp(str, "rgba")) {
+		return 4;
+	}
+	return 0;
+}
+
+static void
+video_cleanup(DCLMCVideo *v)
+{
+	free(v->frame);
+	dclmResamplerCleanup(&v->rs);
+	dclmDitherCleanup(&v->dither);
+	dclmImageDestroy(v->gray);
+	dclmImageDestroy(v->shown);
+}
+
+/* allocate the buffers for frames of v->dims and a LED matrix of the
+ * size of img
+ * RETURN: 0 if OK, -1 otherwise
+ */
+static int
+video_init(DCLMCVideo *v, const DCLMImage *img)
+{
+	dclmResamplerInit(&v->rs);
+	dclmDitherInit(&v->dither, v->dither_mode);
+	v->frame_size = v->dims[0] * v->dims[1] * v->bpp;
+	v->frame = malloc(v->frame_size);
+	v->gray = dclmImageCreate(img->dims[0], img->dims[1], NULL);
+	v->shown = dclmImageCreate(img->dims[0], img->dims[1], NULL);
+	v->frames = v->sent = v->late = 0;
+	v->convert_ns = v->convert_max_ns = 0;
+	v->send_ns = v->send_max_ns = 0;
+	if (!v->frame || !v->gray || !v->shown) {
+		return -1;
+	}
+
+	/* set up the tables and the state of the dithering now,
+	 * so no frame has to */
+	memset(v->frame, 0, v->frame_size);
+	if (dclmResample(&v->rs, v->frame, v->dims[0], v->dims[1], v->dims[0] * v->bpp,
+			 (int)v->bpp, DCLM_RESAMPLE_BILINEAR, v->gray) ||
+	    dclmDither(&v->dither, v->gray, v->gray)) {
+		return -1;
+	}
+	dclmDitherReset(&v->dither);
+	return 0;
+}
+
+/* read the next frame from file
+ * RETURN: 1 if there is one, 0 otherwise
+ */
+static int
+video_read(DCLMCVideo *v, FILE *file)
+{
+	size_t got = 0;
+
+	while (got < v->frame_size && !dclmcStop) {
+		got += fread(v->frame + got, 1, v->frame_size - got, file);
+		if (feof(file) || (ferror(file) && errno != EINTR)) {
+			break;
+		}
+		clearerr(file);
+	}
+	return (got == v->frame_size);
+}
+
+/* resample the frame to the LED matrix and dither it to img */
+static void
+video_convert(DCLMCVideo *v, DCLMImage *img)
+{
+	/* video_init() did all the setup, so this can't fail */
+	dclmResample(&v->rs, v->frame, v->dims[0], v->dims[1], v->dims[0] * v->bpp,
+		     (int)v->bpp, DCLM_RESAMPLE_BILINEAR, v->gray);
+	dclmDither(&v->dither, v->gray, img);
+}
+
+static void
+video_report(const DCLMCVideo *v)
+{
+	unsigned long n = (v->frames)?v->frames:1;
+	unsigned long s = (v->sent)?v->sent:1;
+
+	fprintf(stderr, "%lu frames, %lu sent, %lu late\n", v->frames, v->sent, v->late);
+	fprintf(stderr, "convert: %.1f us average, %.1f us max\n",
+		v->convert_ns / 1000.0 / n, v->convert_max_ns / 1000.0);
+	fprintf(stderr, "send:    %.1f us average, %.1f us max\n",
+		v->send_ns / 1000.0 / s, v->send_max_ns / 1000.0);
+}
+
+/* stream raw frames from cl->input at v->fps, until the end of the input
+ * RETURN: DCLMC_OK, or DCLMC_FAILED if the daemon could not be reached
+ */
+static int
+run_video(DCLMClient *cl, DCLMCVideo *v)
+{
+	struct sigaction sa;
+	struct timespec ts;
+	uint64_t period = (uint64_t)(1000000000.0 / v->fps);
+	uint64_t next, t0, t1;
+	DCLEDMatrixError err;
+	int status = DCLMC_OK;
+
+	/* no SA_RESTART: a blocking read must return, so the report
+	 * is still printed when the pipe is interrupted */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	next = now_ns();
+	while (!dclmcStop && video_read(v, cl->input)) {
+		t0 = now_ns();
+		video_convert(v, cl->img);
+		t1 = now_ns();
+		v->frames++;
+		v->convert_ns += t1 - t0;
+		if (t1 - t0 > v->convert_max_ns) {
+			v->convert_max_ns = t1 - t0;
+		}
+
+		if (t1 < next) {
+			ts.tv_sec = (time_t)(next / 1000000000u);
+			ts.tv_nsec = (long)(next % 1000000000u);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !dclmcStop);
+		} else if (t1 - next > period) {
+			/* the input can't keep up, start over from now */
+			v->late++;
+			next = t1;
+		}
+		next += period;
+
+		if (!v->sent || memcmp(cl->img->data, v->shown->data, cl->img->size)) {
+			t0 = now_ns();
+			err = dclmdClientShowImage(cl->comm, cl->img, 0, 0, 0, 0);
+			t1 = now_ns();
+			if (err != DCLM_OK) {
+				dclmcWarning("failed to send the frame: %d", (int)err);
+				status = DCLMC_FAILED;
+				break;
+			}
+			memcpy(v->shown->data, cl->img->data, cl->img->size);
+			v->sent++;
+			v->send_ns += t1 - t0;
+			if (t1 - t0 > v->send_max_ns) {
+				v->send_max_ns = t1 - t0;
+			}
+		}
+	}
+	video_report(v);
+	return status;
+}
+
 /****************************************************************************
  * main                                                                     *
  ****************************************************************************/ 
 
+static void
+print_help(void)
+{
+	printf("usage: dclmclient [OPTIONS] COMMAND [ARGS]\n");
+	printf("       dclmclient [OPTIONS] -s\n");
+	printf("       dclmclient [OPTIONS] -r WIDTHxHEIGHT [-f FORMAT] [-R FPS] [-D MODE]\n\n");
+	printf("send a command to dclmd, or with -s, read one command per line\n");
+	printf("from stdin and send them all over the same connection.\n");
+	printf("With -r, read raw video frames from stdin (for example from\n");
+	printf("ffmpeg -f rawvideo) and show them, scaled to the LED matrix.\n\n");
+	printf("available options:\n");
+	printf(" -i, --instance NAME  talk to the daemon instance NAME\n");
+	printf(" -p, --private        use a private connection to the daemon\n");
+	printf(" -t, --timeout MS     timeout of text and images, default: 0 (infinite)\n");
+	printf(" -s, --stream         read the commands from stdin\n");
+	printf(" -r, --raw WxH        read raw video frames of that size from stdin\n");
+	printf(" -f, --format FORMAT  pixel format of the frames: gray, rgb24 or rgba,\n");
+	printf("                      default: gray\n");
+	printf(" -R, --rate FPS       frame rate of the video, default: %g\n", DCLMC_VIDEO_FPS);
+	printf(" -D, --dither MODE    threshold, bayer, floyd, bluenoise or temporal\n");
+	printf("                      (blue noise which does not flicker), default: temporal\n");
+	printf(" -h, --help           print this help and exit\n");
+	printf("\n");
+	printf("commands:\n");
+	printf(" text TEXT            show TEXT\n");
+	printf(" clear                blank the screen\n");
+	printf(" image FILE           show a PBM image (P1 or P4), '-' reads it from\n");
+	printf("                      stdin, in a stream right after the command line\n");
+	printf(" timeout MS           set the timeout of the following commands\n");
+	printf(" scroll PPS TEXT      scroll TEXT at PPS pixels per second, to the right\n");
+	printf("                      if PPS is negative, 0 stops scrolling\n");
+	printf("\n");
+}
+
 int main(int argc, char **argv)
 {
-	DCLMDComminucation *comm;
-	DCLEDMatrixError err;
+	DCLMClient cl;
+	DCLMCVideo video;
+	char line[DCLMC_LINE_LENGTH];
+	const char *instance = NULL;
+	int private_conn = 0;
+	int stream = 0;
+	int raw = 0;
 	int status = 0;
+	size_t len = 0;
+	int i;
 
-	/* TODO MH: parse arguments */
+	cl.comm = NULL;
+	cl.img = NULL;
+	cl.input = stdin;
+	cl.timeout_ms = 0;
+	line[0] = 0;
+	memset(&video, 0, sizeof(video));
+	video.bpp = 1;
+	video.fps = DCLMC_VIDEO_FPS;
+	video.dither_mode = DCLM_DITHER_TEMPORAL;
 
-	dclmcDebug("connecting to daemon SHM");
-	comm = dclmdCommunicationClientCreate();
-	if (comm) {
-		dclmcDebug("locking SHM");
-		err = dclmdClientLock(comm);
-		if (err == DCLM_OK) {
-			dclmcDebug("preparing command");
-			snprintf(comm->work->text,sizeof(comm->work->text),"Test.");
-			comm->work->text_pos_x=0;
-			comm->work->timeout_ms=3000;
-			comm->work->cmd_flags |= DCLMD_CMD_SHOW_TEXT | DCLMD_CMD_TIMEOUT;
-			dclmcDebug("sending command");
-			err = dclmdClientUnlock(comm);
-			if (err != DCLM_OK) {
-				dclmcWarning("failed to finish SHM communication: %d!",(int)err);
-				status= 3;
-			} else {
-				dclmcDebug("sent command!");
+	for (i=1; i<argc; i++) {
+		if ((!strcmp(argv[i],"-i") || !strcmp(argv[i], "--instance")) && i+1 < argc) {
+			instance = argv[++i];
+			continue;
+		}
+		if (!strcmp(argv[i],"-p") || !strcmp(argv[i], "--private") ) {
+			private_conn = 1;
+			continue;
+		}
+		if ((!strcmp(argv[i],"-t") || !strcmp(argv[i], "--timeout")) && i+1 < argc) {
+			if (parse_uint(argv[++i], &cl.timeout_ms)) {
+				dclmcWarning("invalid timeout '%s'", argv[i]);
+				return 3;
 			}
-		} else {
-			dclmcWarning("failed to lock SHM: %d!",(int)err);
+			continue;
+		}
+		if (!strcmp(argv[i],"-s") || !strcmp(argv[i], "--stream") ) {
+			stream = 1;
+			continue;
+		}
+		if ((!strcmp(argv[i],"-r") || !strcmp(argv[i], "--raw")) && i+1 < argc) {
+			if (parse_size(argv[++i], video.dims)) {
+				dclmcWarning("invalid frame size '%s'", argv[i]);
+				return 3;
+			}
+			raw = 1;
+			continue;
+		}
+		if ((!strcmp(argv[i],"-f") || !strcmp(argv[i], "--format")) && i+1 < argc) {
+			if ( !(video.bpp = parse_format(argv[++i])) ) {
+				dclmcWarning("unknown pixel format '%s'", argv[i]);
+				return 3;
+			}
+			continue;
+		}
+		if ((!strcmp(argv[i],"-D") || !strcmp(argv[i], "--dither")) && i+1 < argc) {
+			if ( (video.dither_mode = parse_dither(argv[++i])) < 0) {
+				dclmcWarning("unknown dithering '%s'", argv[i]);
+				return 3;
+			}
+			continue;
+		}
+		if ((!strcmp(argv[i],"-R") || !strcmp(argv[i], "--rate")) && i+1 < argc) {
+			video.fps = strtod(argv[++i], NULL);
+			if (!(video.fps > 0.0 && video.fps <= 1000.0)) {
+				dclmcWarning("invalid frame rate '%s'", argv[i]);
+				return 3;
+			}
+			continue;
+		}
+		if (!strcmp(argv[i],"-h") || !strcmp(argv[i], "--help") ) {
+			print_help();
+			return status;
+		}
+		break;
+	}
+
+	/* the command and its arguments, as a line of the stream */
+	for (; i<argc; i++) {
+		if (len + strlen(argv[i]) + 1 >= sizeof(line)) {
+			dclmcWarning("command too long");
+			return 3;
+		}
+		len += (size_t)sprintf(line + len, (len)?" %s":"%s", argv[i]);
+	}
+	if (stream + raw + !!len != 1) {
+		print_help();
+		return 3;
+	}
+
+	dclmcDebug("connecting to daemon SHM");
+	cl.comm = (private_conn)?dclmdCommunicationClientCreatePrivateInstance(instance, 0):
+				 dclmdCommunicationClientCreateInstance(instance);
+	if (!cl.comm) {
+		dclmcWarning("failed to connect to daemon via SHM!");
+		return 1;
+	}
+	cl.img = dclmImageCreate(cl.comm->work->dims[0], cl.comm->work->dims[1], NULL);
+	if (!cl.img) {
+		dclmcWarning("out of memory");
+		dclmdCommunicationDestroy(cl.comm);
+		return 2;
+	}
+
+	if (raw) {
+		if (video.dims[0] * video.dims[1] * video.bpp > DCLMC_VIDEO_MAX_SIZE || video_init(&video, cl.img)) {
+			dclmcWarning("failed to allocate the video buffers");
 			status = 2;
+		} else {
+			status = run_video(&cl, &video);
 		}
-		dclmcDebug("closing shm connection!");
-		dclmdCommunicationDestroy(comm);
+		video_cleanup(&video);
+	} else if (stream) {
+		status = run_stream(&cl);
 	} else {
-		dclmcWarning("failed to connect to daemon via SHM!");
-		status = 1;
+		status = run_command(&cl, line);
+		if (status == DCLMC_BAD_COMMAND) {
+			status = 3;
+		}
 	}
 
+	dclmcDebug("closing shm connection!");
+	dclmImageDestroy(cl.img);
+	dclmdCommunicationDestroy(cl.comm);
+
 	dclmcDebug("finished with code %d",status);
 	return status;
 }
@@ -14,11 +14,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "dclm.h"
+#define _GNU_SOURCE /* sched_setaffinity */
+
+#include "dclmd_internal.h"
 #include "dclm_font.h"
-#include "dclmd_comm.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <signal.h>
@@ -26,17 +28,21 @@
 #include <fcntl.h>
 #include <semaphore.h>
 #include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
 
 
-#define DCLMD_DEFAULT_REFRESH_MS 300 /* maximum time between LED matrix refresh */
-
 #define DCLMD_SEM "/dlcmd-daemon"
+#define DCLMD_SEM_NAME_LEN (32 + DCLMD_COMM_MAX_INSTANCE_LEN)
 
 /****************************************************************************
  * ERRORS and DIAGNOSTICS                                                   *
  ****************************************************************************/
 
-static void
+extern void
 dclmdWarning(const char *template, ...)
 {
 	va_list args;
@@ -49,10 +55,8 @@ dclmdWarning(const char *template, ...)
 	fflush(stderr);
 }
 
-#ifdef NDEBUG
-#define dclmdDebug(...) ((void)0)
-#else
-static void
+#ifndef NDEBUG
+extern void
 dclmdDebug(const char *template, ...)
 {
 	va_list args;
@@ -70,38 +74,77 @@ dclmdDebug(const char *template, ...)
  * DCLMDContext: just a DCLEDMatrix, a Screen and the comm interface        *
  ****************************************************************************/
 
-typedef struct {
-	DCLEDMatrix *dclm;
-	DCLEDMatrixScreen *scr;
-	DCLMDComminucation *comm;
-	unsigned refresh_ms;
-	sig_atomic_t run;
-	unsigned int refresh;
-	struct timespec loop_time;
-	struct timespec timeout;
-} DCLMDContext;
-
-#define DC_REFRESH		0x1
-#define DC_REFRESH_ONCE		0x2
-#define DC_REFRESH_UNTIL	0x4
-
 static void
 dctxInit(DCLMDContext *dc)
 {
 	dc->dclm=NULL;
 	dc->scr=NULL;
+	dc->scr_back=NULL;
 	dc->comm=NULL;
+	dc->instance="";
+	dc->img=NULL;
+	dc->img_capacity=0;
 	dc->refresh_ms=DCLMD_DEFAULT_REFRESH_MS;
 	dc->run=1;
 	dc->refresh=0;
+	dc->pan_x=0;
+	dc->pan_y=0;
+	dc->pan_step_x=0;
+	dc->pan_step_y=0;
+	dc->pan_ms=0;
+	dc->epoll_fd=-1;
+	dc->timer_fd=-1;
+	dc->signal_fd=-1;
+	dc->source_count=0;
+	dctxSchedInit(dc);
+	dc->scroll_img=NULL;
+	dctxTransInit(dc);
+	dc->anim=NULL;
+	dctxStoreInit(dc);
+	dctxLayerInit(dc);
+	dctxWidgetInit(dc);
+	dctxQueueInit(dc);
+	dc->queue_owner=NULL;
+	dc->mirror_img=NULL;
 }
 
 static void
 dctxCleanup(DCLMDContext *dc)
 {
+	dctxSchedCleanup(dc);
+	dctxScrollStop(dc);
+	dctxAnimStop(dc);
+	dctxTransCleanup(dc);
+	dctxLayerCleanup(dc);
+	dctxWidgetCleanup(dc);
+
+	if (dc->epoll_fd >= 0) {
+		close(dc->epoll_fd);
+		dc->epoll_fd=-1;
+	}
+	if (dc->timer_fd >= 0) {
+		close(dc->timer_fd);
+		dc->timer_fd=-1;
+	}
+	if (dc->signal_fd >= 0) {
+		close(dc->signal_fd);
+		dc->signal_fd=-1;
+	}
+	dc->source_count=0;
+
 	dclmScrDestroy(dc->scr);
 	dc->scr=NULL;
 
+	dclmScrDestroy(dc->scr_back);
+	dc->scr_back=NULL;
+
+	dclmImageDestroy(dc->img);
+	dc->img=NULL;
+	dc->img_capacity=0;
+
+	dclmImageDestroy(dc->mirror_img);
+	dc->mirror_img=NULL;
+
 	dclmClose(dc->dclm);
 	dc->dclm=NULL;
 
@@ -133,7 +176,8 @@ dctxOpen(DCLMDContext *dc, const char *options)
 	}
 
 	dc->scr=dclmScrCreate(dc->dclm);
-	if (!dc->scr) {
+	dc->scr_back=dclmScrCreate(dc->dclm);
+	if (!dc->scr || !dc->scr_back) {
 		dclmdWarning("out of memory creating LED matrix screen");
 		return DCLM_OUT_OF_MEMORY;
 	}
@@ -146,8 +190,8 @@ dctxOpen(DCLMDContext *dc, const char *options)
 	}
 	dclmdDebug("opened LED matrix device: %dx%d",cols,rows);
 
-	dclmdDebug("creating SHM interface");
-	dc->comm = dclmdCommunicationCreate(1, cols, rows);
+	dclmdDebug("creating SHM interface for instance '%s'", dc->instance);
+	dc->comm = dclmdCommunicationCreateInstance(dc->instance, 1, cols, rows);
 	if (!dc->comm) {
 		dclmdWarning("failed to create SHM interface");
 		return DCLMD_COMMUNICATION_ERROR;
@@ -157,38 +201,536 @@ dctxOpen(DCLMDContext *dc, const char *options)
 }
 
 /****************************************************************************
- * MAIN LOOP                                                                *
+ * IMAGES AND PANNING                                                       *
+ ****************************************************************************/
+
+/* copy the image into our private image, so that it stays
+ * available after the client re-uses the shm
+ * RETURN 0: OK
+ *       -1: out of memory
+ */
+static int
+dctxSetImage(DCLMDContext *dc, const DCLMImage *img)
+{
+	if (img->size > dc->img_capacity) {
+		dclmImageDestroy(dc->img);
+		dc->img_capacity=0;
+		dc->img=dclmImageCreate(img->dims[0], img->dims[1], NULL);
+		if (!dc->img) {
+			return -1;
+		}
+		dc->img_capacity=img->size;
+	}
+
+	dc->img->dims[0]=img->dims[0];
+	dc->img->dims[1]=img->dims[1];
+	dc->img->size=img->size;
+	memcpy(dc->img->data, img->data, img->size);
+	return 0;
+}
+
+/* wrap a (possibly negative) position into 0 ... dim-1 */
+static size_t
+dctxWrapPos(long pos, size_t dim)
+{
+	long res = pos % (long)dim;
+
+	if (res < 0) {
+		res += (long)dim;
+	}
+	return (size_t)res;
+}
+
+static void
+dctxShowImage(DCLMDContext *dc)
+{
+	dclmScrFromImgBlit(dc->scr, dc->img, dc->pan_x, dc->pan_y, 0, 0, (int)dc->img->dims[0], (int)dc->img->dims[1]);
+	dc->refresh |= DC_REFRESH | DC_REFRESH_ONCE;
+}
+
+/* advance the pan position if the next step is due */
+static void
+dctxPan(DCLMDContext *dc)
+{
+	const struct timespec *now = &dc->loop_time;
+
+	if (dclmdCompareTime(now, &dc->pan_next) < 0) {
+		return;
+	}
+
+	dc->pan_x = dctxWrapPos((long)dc->pan_x + dc->pan_step_x, dc->img->dims[0]);
+	dc->pan_y = dctxWrapPos((long)dc->pan_y + dc->pan_step_y, dc->img->dims[1]);
+	dctxShowImage(dc);
+
+	/* keep the step timing exact, unless we fell behind completely */
+	dclmdCalcWaitTimeMS(&dc->pan_next, &dc->pan_next, dc->pan_ms);
+	if (dclmdCompareTime(&dc->pan_next, now) < 0) {
+		dclmdCalcWaitTimeMS(&dc->pan_next, now, dc->pan_ms);
+	}
+}
+
+/****************************************************************************
+ * DISPLAY LISTS                                                            *
+ ****************************************************************************/
+
+/* execute the display list onto target via the off-screen, and
+ * change target only if the list was completely valid
+ * RETURN 0: OK
+ *       -1: malformed display list
+ */
+static int
+dctxExecDList(DCLMDContext *dc, DCLMDComminucation *comm, DCLEDMatrixScreen *target)
+{
+	DCLMDWorkExt *ext = comm->ext;
+	DCLEDMatrixScreen *scr = dc->scr_back;
+	DCLMDListOp op;
+	DCLMImage img;
+	int have_img;
+	size_t pos = 0;
+	size_t len = ext->dlist_len;
+	int res;
+
+	if (len > sizeof(ext->dlist)) {
+		return -1;
+	}
+
+	have_img = !dclmdDaemonGetImage(comm, &img);
+	dclmScrCopy(scr, target);
+
+	while ( (res = dclmDListNext(ext->dlist, len, &pos, &op)) > 0) {
+		switch (op.op) {
+			case DCLM_DL_CLEAR:
+				dclmScrClear(scr, (int)op.value);
+				break;
+			case DCLM_DL_TEXT:
+				if (op.len) {
+					dclmStringToScr(scr, op.x, op.text, op.len, dclmFontBase);
+				}
+				break;
+			case DCLM_DL_BLIT:
+				if (!have_img) {
+					return -1;
+				}
+				dclmScrFromImgBlit(scr, &img, dctxWrapPos(op.from_x, img.dims[0]), dctxWrapPos(op.from_y, img.dims[1]),
+						   op.x, op.y, op.w, op.h);
+				break;
+			case DCLM_DL_SPAN:
+			case DCLM_DL_RECT:
+				dclmScrFillRect(scr, op.x, op.y, op.w, op.h, (int)op.value);
+				break;
+			case DCLM_DL_PIXEL:
+				if (op.x >= 0 && op.y >= 0) {
+					dclmScrSetPixel(scr, (unsigned)op.x, (unsigned)op.y, (int)op.value);
+				}
+				break;
+		}
+	}
+	if (res < 0) {
+		return -1;
+	}
+
+	dclmScrCopy(target, scr);
+	return 0;
+}
+
+/****************************************************************************
+ * TIMELINE                                                                 *
+ ****************************************************************************/
+
+/* render the display list onto a blank screen and put it on the timeline
+ * RETURN 0: OK
+ *       -1: malformed display list or timeline full
+ */
+static int
+dctxSchedule(DCLMDContext *dc, DCLMDComminucation *comm)
+{
+	DCLMDWorkExt *ext = comm->ext;
+	DCLEDMatrixScreen *scr = dclmScrCreate(dc->dclm);
+	int res = -1;
+
+	if (scr) {
+		dclmScrClear(scr, 0);
+		if (!dctxExecDList(dc, comm, scr)) {
+			res = dctxSchedAdd(dc, ext->sched_id, ext->sched_priority,
+					   ext->sched_start_ms, ext->sched_duration_ms, scr);
+		}
+		dclmScrDestroy(scr);
+	}
+	return res;
+}
+
+/* the contents: the timeline overrides the regular screen */
+static DCLEDMatrixScreen *
+dctxContentScreen(const DCLMDContext *dc)
+{
+	DCLEDMatrixScreen *scr = dctxSchedScreen(dc);
+	return (scr)?scr:dc->scr;
+}
+
+/* the screen below the layers: a running transition overrides the contents */
+static DCLEDMatrixScreen *
+dctxBaseScreen(const DCLMDContext *dc)
+{
+	DCLEDMatrixScreen *scr = dctxTransScreen(dc);
+	return (scr)?scr:dctxContentScreen(dc);
+}
+
+/* the screen to send: the layers on top of everything else */
+static DCLEDMatrixScreen *
+dctxCurrentScreen(DCLMDContext *dc)
+{
+	return dctxLayerCompose(dc, dctxBaseScreen(dc));
+}
+
+/* publish the screen just sent to the device in the mirror of the shm,
+ * but only when it differs from the one published before */
+static void
+dctxMirror(DCLMDContext *dc, const DCLEDMatrixScreen *scr)
+{
+	uint8_t data[DCLM_SCR_DATA_SIZE];
+
+	dclmScrGetData(scr, data);
+	if (dc->mirror_img && !memcmp(data, dc->mirror_data, sizeof(data))) {
+		return;
+	}
+	if (!dc->mirror_img) {
+		dc->mirror_img = dclmImageCreateFit(dc->dclm);
+		if (!dc->mirror_img) {
+			return;
+		}
+	}
+	memcpy(dc->mirror_data, data, sizeof(data));
+	dclmScrToiImg(scr, dc->mirror_img);
+	dclmdDaemonMirror(dc->comm, dc->mirror_img);
+}
+
+/****************************************************************************
+ * FRAME STORE                                                              *
+ ****************************************************************************/
+
+/* get the key of the frame store entry the command refers to */
+static const char *
+dctxStoreName(DCLMDComminucation *comm)
+{
+	DCLMDWorkExt *ext = comm->ext;
+
+	ext->store_name[DCLMD_STORE_NAME_LEN]=0;
+	return ext->store_name;
+}
+
+/* render the display list onto a blank screen and put it into the store
+ * RETURN 0: OK
+ *       -1: malformed display list or store full
+ */
+static int
+dctxStore(DCLMDContext *dc, DCLMDComminucation *comm)
+{
+	DCLEDMatrixScreen *scr = dclmScrCreate(dc->dclm);
+	int res = -1;
+
+	if (scr) {
+		dclmScrClear(scr, 0);
+		if (!dctxExecDList(dc, comm, scr)) {
+			res = dctxStorePut(dc, comm->ext->store_id, dctxStoreName(comm), scr);
+		}
+		dclmScrDestroy(scr);
+	}
+	return res;
+}
+
+/****************************************************************************
+ * LAYERS                                                                   *
  ****************************************************************************/
 
+/* render the display list onto a blank screen and put it into its layer
+ * RETURN 0: OK
+ *       -1: malformed display list or too many layers
+ */
 static int
-handle_command(DCLMDContext *dc)
+dctxSetLayer(DCLMDContext *dc, DCLMDComminucation *comm)
+{
+	DCLMDWorkExt *ext = comm->ext;
+	DCLEDMatrixScreen *scr = dclmScrCreate(dc->dclm);
+	unsigned int ttl_ms = ext->layer_ttl_ms;
+	int res = -1;
+
+	/* clients not knowing about it must get no TTL of an earlier one */
+	ext->layer_ttl_ms = 0;
+	if (scr) {
+		dclmScrClear(scr, 0);
+		if (!dctxExecDList(dc, comm, scr)) {
+			res = dctxLayerSet(dc, ext->layer_id, ext->layer_z, ext->layer_x, ext->layer_y,
+					   ext->layer_w, ext->layer_h, ext->layer_flags, scr, comm, ttl_ms);
+		}
+		dclmScrDestroy(scr);
+	}
+	return res;
+}
+
+/****************************************************************************
+ * FRAME QUEUE                                                              *
+ ****************************************************************************/
+
+/* tell the connection which queued the frames how it went */
+static void
+dctxQueueReport(DCLMDContext *dc)
 {
-	DCLMDWorkEntry *work = dc->comm->work;
+	DCLMDComminucation *owner = dc->queue_owner;
+
+	/* reset by dctxClientClosed() if it disconnected in the meantime */
+	if (!owner) {
+		return;
+	}
+	__atomic_store_n(&owner->ext->batch_presented, dc->queue_presented, __ATOMIC_RELEASE);
+	__atomic_store_n(&owner->ext->batch_dropped, dc->queue_dropped, __ATOMIC_RELEASE);
+	__atomic_store_n(&owner->ext->batch_pending, dc->queue_count, __ATOMIC_RELEASE);
+}
+
+/****************************************************************************
+ * COMMANDS                                                                 *
+ ****************************************************************************/
+
+/* stop everything which changes the screen by itself */
+static void
+dctxStopMotion(DCLMDContext *dc)
+{
+	dc->pan_ms=0;
+	dctxScrollStop(dc);
+	dctxAnimStop(dc);
+	if (dc->queue_count) {
+		dctxQueueClear(dc);
+		dctxQueueReport(dc);
+	}
+}
+
+/* queue the frames of the command, all of them or none: without
+ * DCLMD_BATCH_APPEND, or from another connection, they replace the
+ * queued frames, and the statistics start over
+ * RETURN 0: OK
+ *       -1: inconsistent frames, or the queue is full
+ */
+static int
+dctxQueueFrames(DCLMDContext *dc, DCLMDComminucation *comm)
+{
+	DCLMDWorkExt *ext = comm->ext;
+	DCLMImage img, frame;
+	uint8_t data[DCLM_SCR_DATA_SIZE];
+	struct timespec when;
+	unsigned int i;
+	int append;
+
+	if (dclmdDaemonGetImage(comm, &img) || !ext->batch_count || ext->batch_count > DCLMD_BATCH_MAX_FRAMES) {
+		return -1;
+	}
+	frame = img;
+	frame.dims[1] = img.dims[1] / ext->batch_count;
+	frame.size = frame.dims[0] * frame.dims[1];
+	if (frame.dims[0] < (size_t)dclmGetInt(dc->dclm, DCLM_PARAM_COLUMNS) ||
+	    frame.dims[1] < (size_t)dclmGetInt(dc->dclm, DCLM_PARAM_ROWS)) {
+		return -1;
+	}
+	append = (ext->batch_flags & DCLMD_BATCH_APPEND) && dc->queue_count && dc->queue_owner == comm;
+	if ((append?dc->queue_count:0) + ext->batch_count > DCLMD_QUEUE_MAX_FRAMES) {
+		return -1;
+	}
+
+	if (!append) {
+		/* the frames replaced count as dropped for their owner, so
+		 * the new statistics start before or after replacing them */
+		if (dc->queue_owner == comm) {
+			dctxQueueResetStats(dc);
+			dctxStopMotion(dc);
+		} else {
+			dctxStopMotion(dc);
+			dctxQueueResetStats(dc);
+			dc->queue_owner = comm;
+		}
+	}
+	for (i = 0; i < ext->batch_count; i++) {
+		frame.data = img.data + i * frame.size;
+		dclmScrDataFromImg(data, &frame);
+		when.tv_sec = (time_t)(ext->batch_time_ns[i] / 1000000000ULL);
+		when.tv_nsec = (long)(ext->batch_time_ns[i] % 1000000000ULL);
+		dctxQueuePush(dc, &when, data);
+	}
+	dctxQueueReport(dc);
+	return 0;
+}
+
+/* the commands which change the contents in a way worth a transition */
+#define DCLMD_CMD_CONTENT (DCLMD_CMD_CLEAR_SCREEN | DCLMD_CMD_SHOW_IMAGE | DCLMD_CMD_SHOW_TEXT | DCLMD_CMD_DISPLAY_LIST | \
+			   DCLMD_CMD_SHOW_STORED)
+
+static int
+handle_command(DCLMDContext *dc, DCLMDComminucation *comm)
+{
+	DCLMDWorkEntry *work = comm->work;
+	int transition;
+
 	if (work->cmd_flags == 0) {
 		return 0;
 	}
 
+	if (work->cmd_flags & DCLMD_CMD_TRANSITION) {
+		if (dctxTransSet(dc, comm->ext->trans_effect, comm->ext->trans_duration_ms)) {
+			dclmdWarning("ignoring unknown transition %d", comm->ext->trans_effect);
+		}
+	}
+	transition = (work->cmd_flags & DCLMD_CMD_CONTENT) && dc->trans_effect != DCLM_TRANS_CUT;
+	if (transition) {
+		dctxTransSnapshot(dc, dctxBaseScreen(dc));
+	}
+
 	if (work->cmd_flags & DCLMD_CMD_BRIGHTNESS) {
 		dclmScrSetBrightness(dc->scr, work->brightness);
 		dc->refresh=DC_REFRESH_ONCE;
 	}
 	if (work->cmd_flags & DCLMD_CMD_CLEAR_SCREEN) {
-		dclmBlankScreen(dc->dclm);
+		if (!transition) {
+			dclmBlankScreen(dc->dclm);
+		}
+		dclmScrClear(dc->scr, 0);
 		dc->refresh=DC_REFRESH_ONCE;
+		dctxStopMotion(dc);
 	}
 	if (work->cmd_flags & DCLMD_CMD_SHOW_IMAGE) {
-		dclmScrFromImgBlit(dc->scr, &dc->comm->img, work->img_pos_x, work->img_pos_y,0,0,dc->comm->img.dims[0], dc->comm->img.dims[1]);
-		dc->refresh=DC_REFRESH | DC_REFRESH_ONCE;
+		DCLMImage img;
+		if (dclmdDaemonGetImage(comm, &img)) {
+			dclmdWarning("ignoring inconsistent image");
+		} else if (dctxSetImage(dc, &img)) {
+			dclmdWarning("out of memory copying %ux%u image", (unsigned)img.dims[0], (unsigned)img.dims[1]);
+		} else {
+			dc->pan_x=dctxWrapPos(work->img_pos_x, img.dims[0]);
+			dc->pan_y=dctxWrapPos(work->img_pos_y, img.dims[1]);
+			dctxStopMotion(dc);
+			dc->refresh=0;
+			dctxShowImage(dc);
+		}
 	}
 	if (work->cmd_flags & DCLMD_CMD_SHOW_TEXT) {
 		if (work->text[0]) {
 			work->text[DCLMD_COMM_MAX_TEXT_LENGTH]=0;
 			dclmTextToScr(dc->scr,work->text_pos_x, work->text, 0, dclmFontBase);
 			dc->refresh=DC_REFRESH | DC_REFRESH_ONCE;
+			dctxStopMotion(dc);
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_DISPLAY_LIST) {
+		if (dctxExecDList(dc, comm, dc->scr)) {
+			dclmdWarning("ignoring malformed display list");
+		} else {
+			dc->refresh=DC_REFRESH | DC_REFRESH_ONCE;
+			dctxStopMotion(dc);
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_STORE) {
+		if (dctxStore(dc, comm)) {
+			dclmdWarning("ignoring frame store entry %u '%s': malformed or store full",
+				     comm->ext->store_id, dctxStoreName(comm));
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_SHOW_STORED) {
+		const uint8_t *data = dctxStoreGet(dc, comm->ext->store_id, dctxStoreName(comm));
+		if (data) {
+			dclmScrSetData(dc->scr, data);
+			dc->refresh=DC_REFRESH | DC_REFRESH_ONCE;
+			dctxStopMotion(dc);
+		} else {
+			dclmdWarning("no frame store entry %u '%s'", comm->ext->store_id, dctxStoreName(comm));
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_DROP_STORED) {
+		dctxStoreDrop(dc, comm->ext->store_id, dctxStoreName(comm));
+	}
+	if (work->cmd_flags & DCLMD_CMD_REMOVE_LAYER) {
+		dctxLayerRemove(dc, comm->ext->layer_id);
+		dc->refresh |= DC_REFRESH_ONCE;
+	}
+	if (work->cmd_flags & DCLMD_CMD_SET_LAYER) {
+		if (dctxSetLayer(dc, comm)) {
+			dclmdWarning("ignoring layer %u: malformed or too many layers", comm->ext->layer_id);
+		} else {
+			dc->refresh |= DC_REFRESH | DC_REFRESH_ONCE;
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_REMOVE_WIDGET) {
+		dctxWidgetRemove(dc, comm->ext->widget_id);
+		dc->refresh |= DC_REFRESH_ONCE;
+	}
+	if (work->cmd_flags & DCLMD_CMD_SET_WIDGET) {
+		DCLMDWorkExt *ext = comm->ext;
+		DCLMImage img;
+		int have_img = (ext->widget_type == DCLMD_WIDGET_ICON) && !dclmdDaemonGetImage(comm, &img);
+		work->text[DCLMD_COMM_MAX_TEXT_LENGTH]=0;
+		if (dctxWidgetSet(dc, ext->widget_id, ext->widget_type, ext->widget_x, ext->widget_y,
+				  ext->widget_w, ext->widget_h, ext->widget_flags, ext->widget_value,
+				  ext->widget_max, work->text, (have_img)?&img:NULL)) {
+			dclmdWarning("ignoring widget %u: invalid or too many widgets", ext->widget_id);
+		} else {
+			dc->refresh |= DC_REFRESH | DC_REFRESH_ONCE;
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_UPDATE_WIDGET) {
+		work->text[DCLMD_COMM_MAX_TEXT_LENGTH]=0;
+		if (dctxWidgetUpdate(dc, comm->ext->widget_id, comm->ext->widget_value, work->text)) {
+			dclmdWarning("no widget %u", comm->ext->widget_id);
+		} else {
+			dc->refresh |= DC_REFRESH_ONCE;
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_UNSCHEDULE) {
+		dctxSchedRemove(dc, comm->ext->sched_id);
+	}
+	if (work->cmd_flags & DCLMD_CMD_SCHEDULE) {
+		if (dctxSchedule(dc, comm)) {
+			dclmdWarning("ignoring timeline item %u: malformed or timeline full", comm->ext->sched_id);
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_SCROLL_TEXT) {
+		DCLMDWorkExt *ext = comm->ext;
+		dctxStopMotion(dc);
+		if (ext->scroll_pps) {
+			work->text[DCLMD_COMM_MAX_TEXT_LENGTH]=0;
+			if (dctxScrollStart(dc, work->text, ext->scroll_pps, ext->scroll_dir, ext->scroll_loops)) {
+				dclmdWarning("out of memory starting the marquee");
+			} else {
+				dc->refresh |= DC_REFRESH | DC_REFRESH_ONCE;
+			}
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_PLAY_ANIM) {
+		DCLMDWorkExt *ext = comm->ext;
+		dctxStopMotion(dc);
+		if (work->text[0]) {
+			work->text[DCLMD_COMM_MAX_TEXT_LENGTH]=0;
+			if (dctxAnimStart(dc, work->text, ext->anim_mode, ext->anim_loops)) {
+				dclmdWarning("can't play animation '%s'", work->text);
+			} else {
+				dc->refresh |= DC_REFRESH | DC_REFRESH_ONCE;
+			}
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_QUEUE_FRAMES) {
+		if (dctxQueueFrames(dc, comm)) {
+			dclmdWarning("ignoring inconsistent frames, or frame queue full");
+		}
+	}
+	if (work->cmd_flags & DCLMD_CMD_PAN_IMAGE) {
+		DCLMDWorkExt *ext = comm->ext;
+		if (dc->img && ext->img_step_ms) {
+			dctxStopMotion(dc);
+			dc->pan_step_x=ext->img_step_x;
+			dc->pan_step_y=ext->img_step_y;
+			dc->pan_ms=ext->img_step_ms;
+			dclmdCalcWaitTimeMS(&dc->pan_next, &dc->loop_time, dc->pan_ms);
+			dc->refresh |= DC_REFRESH;
+		} else {
+			dc->pan_ms=0;
 		}
 	}
 	if (work->cmd_flags & DCLMD_CMD_STOP_REFRESH) {
 		dc->refresh &= ~(DC_REFRESH | DC_REFRESH_UNTIL);
+		dctxStopMotion(dc);
 	}
 	if (work->cmd_flags & DCLMD_CMD_START_REFRESH) {
 		dc->refresh |= DC_REFRESH;
@@ -196,7 +738,7 @@ handle_command(DCLMDContext *dc)
 	if (work->cmd_flags & DCLMD_CMD_TIMEOUT) {
 		if (work->timeout_ms) {
 			dc->refresh |= DC_REFRESH_UNTIL;
-			dclmdCalcWaitTimeMS(&dc->timeout, NULL, work->timeout_ms);
+			dclmdCalcWaitTimeMS(&dc->timeout, &dc->loop_time, work->timeout_ms);
 		} else {
 			dc->refresh &= ~DC_REFRESH_UNTIL;
 		}
@@ -204,11 +746,204 @@ handle_command(DCLMDContext *dc)
 	if (work->cmd_flags & DCLMD_CMD_EXIT) {
 		dc->run=0;
 	}
+	if (transition) {
+		if (dctxTransStart(dc, dctxContentScreen(dc))) {
+			dclmdWarning("out of memory computing the transition");
+		}
+		dc->refresh |= DC_REFRESH_ONCE;
+	}
 
 	work->cmd_flags = 0;
 	return 0;
 }
 
+/* clean up after a private connection, before it is closed */
+static void
+dctxClientClosed(void *data, DCLMDComminucation *client)
+{
+	DCLMDContext *dc = (DCLMDContext*)data;
+
+	if (dctxLayerDropOwner(dc, client)) {
+		dc->refresh |= DC_REFRESH_ONCE;
+	}
+	if (dc->queue_owner == client) {
+		dc->queue_owner = NULL;
+	}
+}
+
+/* handle the commands of all private connections */
+static int
+handle_clients(DCLMDContext *dc)
+{
+	unsigned int i;
+	int res;
+
+	if (dclmdDaemonUpdateClients(dc->comm) < 0) {
+		dclmdWarning("failed to accept private connections");
+	}
+
+	for (i=0; i<DCLMD_COMM_MAX_CLIENTS; i++) {
+		DCLMDComminucation *client = dc->comm->clients[i];
+		if (!client) {
+			continue;
+		}
+		/* whatever one client does to its shm, it only
+		 * affects its own connection */
+		res = dclmdDaemonGetClientCommand(client);
+		if (res > 0) {
+			res = handle_command(dc, client);
+			if (dclmdDaemonUnlock(client)) {
+				res = -1;
+			}
+		}
+		if (res < 0) {
+			dclmdWarning("dropping private connection %u after an error", i);
+			dclmdDaemonDropClient(dc->comm, client);
+		}
+	}
+	return 0;
+}
+
+/****************************************************************************
+ * EVENT SOURCES                                                            *
+ ****************************************************************************/
+
+/* add fd to the main loop, handler is called when it becomes readable
+ * RETURN 0: OK
+ *       -1: error
+ */
+static int
+dctxAddSource(DCLMDContext *dc, int fd, DCLMDSourceHandler handler)
+{
+	struct epoll_event ev;
+	DCLMDSource *src;
+
+	if (fd < 0 || dc->source_count >= DCLMD_MAX_SOURCES) {
+		return -1;
+	}
+
+	src = &dc->sources[dc->source_count];
+	src->fd = fd;
+	src->handler = handler;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = src;
+	if (epoll_ctl(dc->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+		return -1;
+	}
+	dc->source_count++;
+	return 0;
+}
+
+/* the command doorbell and private connections */
+static int
+source_command(DCLMDContext *dc, int fd, uint32_t events)
+{
+	int res, status;
+
+	(void)fd;
+	(void)events;
+
+	res = dclmdDaemonPollCommand(dc->comm);
+	if (res < 0) {
+		dclmdWarning("failed to get new command, giving up");
+		return 2;
+	} else if (res > 0) {
+		status = handle_command(dc, dc->comm);
+		if (dclmdDaemonUnlock(dc->comm)) {
+			dclmdWarning("failed to unlock the client side again, giving up");
+			status = 3;
+		}
+		if (status) {
+			dclmdWarning("failed to complete command cycle");
+		}
+		return status;
+	}
+	return 0;
+}
+
+/* the refresh / panning timer */
+static int
+source_timer(DCLMDContext *dc, int fd, uint32_t events)
+{
+	uint64_t expirations;
+
+	(void)dc;
+	(void)events;
+
+	if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+		dclmdWarning("failed to read timer");
+	}
+	return 0;
+}
+
+/* SIGTERM and SIGINT */
+static int
+source_signal(DCLMDContext *dc, int fd, uint32_t events)
+{
+	struct signalfd_siginfo info;
+
+	(void)events;
+
+	if (read(fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+		dclmdDebug("got signal %u", (unsigned)info.ssi_signo);
+		dc->run = -1;
+	}
+	return 0;
+}
+
+/* create the epoll set with all event sources
+ * RETURN 0: OK
+ *       -1: error
+ */
+static int
+dctxOpenEvents(DCLMDContext *dc)
+{
+	sigset_t mask;
+
+	dc->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (dc->epoll_fd < 0) {
+		return -1;
+	}
+
+	/* handle termination via the main loop in a way to gracefully exit */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL)) {
+		return -1;
+	}
+	dc->signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	dc->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+	dclmdDaemonOnClientClose(dc->comm, dctxClientClosed, dc);
+	if (dctxAddSource(dc, dclmdDaemonGetFd(dc->comm), source_command) ||
+	    dctxAddSource(dc, dc->timer_fd, source_timer) ||
+	    dctxAddSource(dc, dc->signal_fd, source_signal)) {
+		return -1;
+	}
+	return 0;
+}
+
+/* arm the timer for an absolute CLOCK_MONOTONIC time,
+ * or disarm it if wakeup is NULL */
+static int
+dctxArmTimer(DCLMDContext *dc, const struct timespec *wakeup)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (wakeup) {
+		its.it_value = *wakeup;
+	}
+	return timerfd_settime(dc->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/****************************************************************************
+ * MAIN LOOP                                                                *
+ ****************************************************************************/
+
 #if 0
 static double
 dtime(const struct timespec *a, const struct timespec *b)
@@ -222,16 +957,27 @@ dtime(const struct timespec *a, const struct timespec *b)
 static int
 main_loop(DCLMDContext* dc)
 {
+	struct epoll_event events[DCLMD_MAX_SOURCES];
 	struct timespec next_wakeup;
+	struct timespec sched_next;
+	struct timespec scroll_next;
+	struct timespec trans_next;
+	struct timespec anim_next;
+	struct timespec widget_next;
+	struct timespec queue_next;
+	struct timespec layer_next;
 	struct timespec *wakeup;
+	DCLEDMatrixError err;
+	DCLMDSource *src;
+	DCLEDMatrixScreen *scr;
 
 	int status = 0;
-	int res;
+	int i, n;
 
 	dclmdDebug("entering main loop");
 
 	while(dc->run > 0) {
-		if (clock_gettime(CLOCK_REALTIME,&dc->loop_time)) {
+		if (clock_gettime(CLOCK_MONOTONIC,&dc->loop_time)) {
 			dclmdWarning("failed to get time, giving up");
 			status = 1;
 			break;
@@ -245,6 +991,7 @@ main_loop(DCLMDContext* dc)
 				if (dclmdCompareTime(&next_wakeup, &dc->timeout) > 0) {
 					if (dclmdCompareTime(&dc->loop_time, &dc->timeout) > 0) {
 						dc->refresh &= ~(DC_REFRESH | DC_REFRESH_UNTIL);
+						dctxStopMotion(dc);
 						dclmdDebug("timeout reached");
 					} else {
 						dclmdDebug("waiting until timeout");
@@ -255,6 +1002,53 @@ main_loop(DCLMDContext* dc)
 		} else {
 			wakeup = NULL;
 		}
+		if (dc->pan_ms) {
+			if (!wakeup || dclmdCompareTime(&dc->pan_next, wakeup) < 0) {
+				wakeup = &dc->pan_next;
+			}
+		}
+		if (dctxSchedScreen(dc) && !(dc->refresh & DC_REFRESH)) {
+			/* timeline items are refreshed as long as they are shown */
+			dclmdCalcWaitTimeMS(&next_wakeup, &dc->loop_time, dc->refresh_ms);
+			if (!wakeup || dclmdCompareTime(&next_wakeup, wakeup) < 0) {
+				wakeup = &next_wakeup;
+			}
+		}
+		if (dctxScrollNext(dc, &scroll_next)) {
+			if (!wakeup || dclmdCompareTime(&scroll_next, wakeup) < 0) {
+				wakeup = &scroll_next;
+			}
+		}
+		if (dctxAnimNext(dc, &anim_next)) {
+			if (!wakeup || dclmdCompareTime(&anim_next, wakeup) < 0) {
+				wakeup = &anim_next;
+			}
+		}
+		if (dctxTransNext(dc, &trans_next)) {
+			if (!wakeup || dclmdCompareTime(&trans_next, wakeup) < 0) {
+				wakeup = &trans_next;
+			}
+		}
+		if (dctxSchedNext(dc, &sched_next)) {
+			if (!wakeup || dclmdCompareTime(&sched_next, wakeup) < 0) {
+				wakeup = &sched_next;
+			}
+		}
+		if (dctxQueueNext(dc, &queue_next)) {
+			if (!wakeup || dclmdCompareTime(&queue_next, wakeup) < 0) {
+				wakeup = &queue_next;
+			}
+		}
+		if (dctxWidgetNext(dc, &widget_next)) {
+			if (!wakeup || dclmdCompareTime(&widget_next, wakeup) < 0) {
+				wakeup = &widget_next;
+			}
+		}
+		if (dctxLayerNext(dc, &layer_next)) {
+			if (!wakeup || dclmdCompareTime(&layer_next, wakeup) < 0) {
+				wakeup = &layer_next;
+			}
+		}
 
 #if 0
 		if (wakeup) {
@@ -265,30 +1059,81 @@ main_loop(DCLMDContext* dc)
 				
 		}
 #endif
-		res = dclmdDaemonGetCommand(dc->comm, wakeup, &dc->loop_time);
-		dclmdDebug("wakeup from loop: %d",res);
-		if (dc->run < 1) {
+		/* no timer at all if there is nothing to refresh */
+		if (dctxArmTimer(dc, wakeup)) {
+			dclmdWarning("failed to set timer, giving up");
+			status = 1;
 			break;
 		}
-		if (res < 0) {
-			dclmdWarning("failed to get new command, giving up");
+		n = epoll_wait(dc->epoll_fd, events, DCLMD_MAX_SOURCES, -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			dclmdWarning("failed to wait for events, giving up");
 			status = 2;
 			break;
-		} else if (res > 0) {
-			status = handle_command(dc);
-			if (dclmdDaemonUnlock(dc->comm)) {
-				dclmdWarning("failed to unlock the client side again, giving up");
-				status = 3;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &dc->loop_time);
+		dclmdDebug("wakeup from loop: %d",n);
+
+		for (i=0; i<n && !status; i++) {
+			src = (DCLMDSource*)events[i].data.ptr;
+			status = src->handler(dc, src->fd, events[i].events);
+		}
+		if (status || dc->run < 0) {
+			break;
+		}
+		if (handle_clients(dc)) {
+			dclmdWarning("failed to complete command cycle for private connections");
+			status = 4;
+			break;
+		}
+		if (dc->pan_ms) {
+			dctxPan(dc);
+		}
+		if (dctxScrollUpdate(dc)) {
+			dc->refresh |= DC_REFRESH_ONCE;
+			if (!dc->scroll_img) {
+				/* marquee finished */
+				dc->refresh &= ~DC_REFRESH;
 			}
-			if (status) {
-				dclmdWarning("failed to complete command cycle");
-				break;
+		}
+		if (dctxAnimUpdate(dc)) {
+			dc->refresh |= DC_REFRESH_ONCE;
+		}
+		if (dc->queue_count) {
+			if (dctxQueueUpdate(dc)) {
+				dc->refresh |= DC_REFRESH | DC_REFRESH_ONCE;
 			}
+			dctxQueueReport(dc);
 		}
-		if (dc->refresh) {
-			dclmSendScreen(dc->scr);
+		if (dc->trans_effect != DCLM_TRANS_CUT) {
+			dctxTransSnapshot(dc, dctxBaseScreen(dc));
+		}
+		if (dctxSchedUpdate(dc)) {
+			dc->refresh |= DC_REFRESH_ONCE;
+			if (dc->trans_effect != DCLM_TRANS_CUT && dctxTransStart(dc, dctxContentScreen(dc))) {
+				dclmdWarning("out of memory computing the transition");
+			}
+		}
+		if (dctxTransUpdate(dc)) {
+			dc->refresh |= DC_REFRESH_ONCE;
+		}
+		if (dctxWidgetTick(dc)) {
+			dc->refresh |= DC_REFRESH_ONCE;
+		}
+		if (dctxLayerExpire(dc)) {
+			dc->refresh |= DC_REFRESH_ONCE;
+		}
+		err = DCLM_OK;
+		if (dc->refresh || dctxSchedScreen(dc)) {
+			scr = dctxCurrentScreen(dc);
+			err = dclmSendScreen(scr);
+			dctxMirror(dc, scr);
 			dc->refresh &= ~DC_REFRESH_ONCE;
 		}
+		dclmdDaemonSignal(dc->comm, err);
 	}
 
 	if (dc->run < 0) {
@@ -303,16 +1148,28 @@ main_loop(DCLMDContext* dc)
  ****************************************************************************/ 
 
 static DCLMDContext dclmdCtx;
+static char dclmdSemName[DCLMD_SEM_NAME_LEN]; /* DCLMD_SEM of our instance */
 
-static void sigterm_handler(int s)
+/* pin the daemon to a single CPU core, cpu < 0 means no pinning */
+static void
+pin_cpu(int cpu)
 {
-	(void)s;
-	dclmdCtx.run = -1;
-	sem_post(dclmdCtx.comm->sem_command);
+	cpu_set_t set;
+
+	if (cpu < 0) {
+		return;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		dclmdWarning("failed to pin daemon to CPU %d", cpu);
+	} else {
+		dclmdDebug("pinned daemon to CPU %d", cpu);
+	}
 }
 
 static int 
-main_run (const char *options, sem_t *sem)
+main_run (const char *options, int cpu, sem_t *sem)
 {
 	DCLEDMatrixError err;
 	int status = 1000;
@@ -321,22 +1178,28 @@ main_run (const char *options, sem_t *sem)
 		while (!dclmdSemTryWait(sem));
 	}
 
+	pin_cpu(cpu);
+
 	err =  dctxOpen(&dclmdCtx, options);
+	if (err == DCLM_OK && dctxOpenEvents(&dclmdCtx)) {
+		dclmdWarning("failed to set up the event loop");
+		err = DCLMD_COMMUNICATION_ERROR;
+	}
 	if (sem) {
 		dclmdDebug("informing parent about daemon progress");
 		sem_post(sem);
 	}
 
 	if (err == DCLM_OK) {
-		signal(SIGTERM, sigterm_handler); /* handle termination in a way to gracefully exit */
-		signal(SIGINT,  sigterm_handler); /* handle termination in a way to gracefully exit */
+		signal(SIGTERM, SIG_DFL); /* blocked, delivered via the signalfd */
+		signal(SIGINT,  SIG_DFL); /* blocked, delivered via the signalfd */
 		status = main_loop(&dclmdCtx);
 		signal(SIGTERM, SIG_IGN); /* ignore it, we want to terminate safely */
 		signal(SIGINT,  SIG_IGN); /* ignore it, we want to terminate safely */
 	}
 
 	if (sem) {
-		sem_unlink(DCLMD_SEM);
+		sem_unlink(dclmdSemName);
 		sem_close(sem);
 	}
 	dctxCleanup(&dclmdCtx);
@@ -344,19 +1207,19 @@ main_run (const char *options, sem_t *sem)
 }
 
 static int 
-daemon_run(const char *options)
+daemon_run(const char *options, int cpu)
 {
 	pid_t pid;
 	sem_t *sem;
 	int res;
 
 	dclmdDebug("checking if daemon is already running");
-	sem = sem_open(DCLMD_SEM, O_RDWR);
+	sem = sem_open(dclmdSemName, O_RDWR);
 	if (sem) {
 		res = dclmdSemTimedWaitMS(sem, 3000);
 		if (res) {
-			dclmdWarning("daemon semaphore %s seems stuck, recreating", DCLMD_SEM);
-			sem_unlink(DCLMD_SEM);
+			dclmdWarning("daemon semaphore %s seems stuck, recreating", dclmdSemName);
+			sem_unlink(dclmdSemName);
 			sem_close(sem);
 		} else {
 			sem_post(sem);
@@ -366,7 +1229,7 @@ daemon_run(const char *options)
 		}
 	}
 
-	sem = sem_open(DCLMD_SEM, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, 0);
+	sem = sem_open(dclmdSemName, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, 0);
 	if (!sem) {
 		dclmdWarning("existing daemon seems stuck, you have to kill it manually!");
 		return 1001;
@@ -385,7 +1248,7 @@ daemon_run(const char *options)
 		dclmdDebug("waiting for daemon to initialize");
 		res = dclmdSemTimedWaitMS(sem, 3000);
 		if (res) {
-			dclmdWarning("daemon did not react in time", DCLMD_SEM);
+			dclmdWarning("daemon did not react in time", dclmdSemName);
 		} else {
 			sem_post(sem);
 		}
@@ -408,7 +1271,7 @@ daemon_run(const char *options)
 
 	/* now we are a new child of init, detached from any tty */
 	dclmdDebug("running as daemon");
-	return main_run(options,sem);
+	return main_run(options,cpu,sem);
 }
 
 static void
@@ -418,11 +1281,18 @@ print_help(void)
 	printf("available options:\n");
 	printf(" -n, --no-daemon     do not run as daemon in the background\n");
 	printf(" -k, --kill-daemon   stop a running daemon\n");
+	printf(" -i, --instance NAME use daemon instance NAME, default: $%s or none\n", DCLMD_COMM_INSTANCE_ENV);
+	printf(" -d, --device OPTS   device options: path=<hidapi path>, serial=<serial number>,\n");
+	printf("                     virtual=1 (no device, e.g. for the mirror, see dclmd_comm.h)\n");
+	printf(" -c, --cpu N         pin the daemon to CPU core N\n");
 	printf(" -V, --version       print version and exit\n");
 	printf(" -h, --help          print this help and exit\n");
 	printf("\n");
 	printf("by default, dclmd will check if the daemon is already running, and start the\n");
 	printf("daemon on demand.\n");
+	printf("To drive several LED matrices, run one instance per device, e.g.\n");
+	printf("  dclmd -i left -d serial=A1 -c 1\n");
+	printf("  dclmd -i right -d serial=B2 -c 2\n");
 	printf("\n");
 }
 
@@ -453,6 +1323,8 @@ int
 main(int argc, char **argv)
 {
 	const char *options=NULL;
+	const char *instance=NULL;
+	int cpu = -1;
 	int no_daemon = 0;
 	int kill_daemon = 0;
 	int i;
@@ -471,6 +1343,18 @@ main(int argc, char **argv)
 			kill_daemon = 1;
 			continue;
 		}
+		if ((!strcmp(argv[i],"-i") || !strcmp(argv[i], "--instance")) && i+1 < argc) {
+			instance = argv[++i];
+			continue;
+		}
+		if ((!strcmp(argv[i],"-d") || !strcmp(argv[i], "--device")) && i+1 < argc) {
+			options = argv[++i];
+			continue;
+		}
+		if ((!strcmp(argv[i],"-c") || !strcmp(argv[i], "--cpu")) && i+1 < argc) {
+			cpu = atoi(argv[++i]);
+			continue;
+		}
 		if (!strcmp(argv[i],"-V") || !strcmp(argv[i], "--version") ) {
 			print_info();
 			return status;
@@ -481,10 +1365,17 @@ main(int argc, char **argv)
 		}
 	}
 
+	dclmdCtx.instance = dclmdCommResolveInstance(instance);
+	if (!dclmdCtx.instance) {
+		dclmdWarning("invalid instance name '%s'", instance);
+		return 3;
+	}
+	snprintf(dclmdSemName, sizeof(dclmdSemName), "%s%s%s", DCLMD_SEM, (dclmdCtx.instance[0])?".":"", dclmdCtx.instance);
+
 	if (kill_daemon) {
 		DCLMDComminucation *comm;
 		dclmdDebug("attempting to kill daemon");
-		comm = dclmdCommunicationClientCreate();
+		comm = dclmdCommunicationClientCreateInstance(dclmdCtx.instance);
 		if (comm) {
 			if (dclmdClientShowText(comm, "KILL", 0, 0, DCLMD_CMD_CLEAR_SCREEN | DCLMD_CMD_SHOW_TEXT | DCLMD_CMD_EXIT, 0) != DCLM_OK) {
 				dclmdWarning("daemon could not be reuested to kill");
@@ -499,9 +1390,9 @@ main(int argc, char **argv)
 	}
 
 	if (no_daemon) {
-		status = main_run(options, NULL);
+		status = main_run(options, cpu, NULL);
 	} else {
-		status = daemon_run(options);
+		status = daemon_run(options, cpu);
 	}
 
 	return status;
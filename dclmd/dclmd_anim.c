@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Playing animation files. The file is read at the start, and the frames are
+ * decoded one at a time straight into the screen when they are due.
+ */
+
+#include "dclmd_internal.h"
+
+#define DCLMD_ANIM_MAX_LAG_MS 1000 /* start over with the timing if we are this late */
+
+/****************************************************************************
+ * INTERNAL                                                                 *
+ ****************************************************************************/
+
+static unsigned int
+anim_duration(const DCLMDContext *dc)
+{
+	unsigned int ms = dclmAnimDuration(dc->anim, dc->anim->frame);
+	return (ms)?ms:1;
+}
+
+/* find the frame after the current one
+ * RETURN 0: OK
+ *        1: all loops done
+ */
+static int
+anim_step(DCLMDContext *dc, unsigned int *frame)
+{
+	unsigned int cur = dc->anim->frame;
+	unsigned int last = dc->anim->frame_count - 1;
+	int at_end = (dc->anim_dir > 0)?(cur == last):(cur == 0);
+
+	if (at_end) {
+		if (dc->anim_loops && ++dc->anim_pass >= dc->anim_loops) {
+			return 1;
+		}
+		if (dc->anim_mode == DCLMD_ANIM_PINGPONG) {
+			dc->anim_dir = -dc->anim_dir;
+		} else {
+			*frame = 0;
+			return 0;
+		}
+	}
+	if (dc->anim_dir > 0) {
+		*frame = (cur < last)?cur + 1:cur;
+	} else {
+		*frame = (cur > 0)?cur - 1:cur;
+	}
+	return 0;
+}
+
+/****************************************************************************
+ * ANIMATIONS                                                               *
+ ****************************************************************************/
+
+extern int
+dctxAnimStart(DCLMDContext *dc, const char *path, int mode, unsigned int loops)
+{
+	dctxAnimStop(dc);
+
+	dc->anim = dclmAnimOpen(path);
+	if (!dc->anim) {
+		return -1;
+	}
+	dc->anim_mode = mode;
+	dc->anim_dir = 1;
+	dc->anim_loops = loops;
+	dc->anim_pass = 0;
+	dclmScrSetData(dc->scr, dc->anim->screen);
+	dclmdCalcWaitTimeMS(&dc->anim_next, &dc->loop_time, anim_duration(dc));
+	dclmdDebug("animation: playing %u frames of '%s'", dc->anim->frame_count, path);
+	return 0;
+}
+
+extern void
+dctxAnimStop(DCLMDContext *dc)
+{
+	dclmAnimClose(dc->anim);
+	dc->anim = NULL;
+}
+
+extern int
+dctxAnimUpdate(DCLMDContext *dc)
+{
+	unsigned int frame;
+	int changed = 0;
+	int stop = 0;
+
+	if (!dc->anim) {
+		return 0;
+	}
+
+	while (dclmdCompareTime(&dc->loop_time, &dc->anim_next) >= 0) {
+		if (anim_step(dc, &frame)) {
+			dclmdDebug("animation: done after %u loops", dc->anim_loops);
+			stop = 1;
+			break;
+		}
+		if (dclmAnimSeek(dc->anim, frame)) {
+			dclmdWarning("animation: frame %u is malformed, stopping", frame);
+			stop = 1;
+			break;
+		}
+		changed = 1;
+
+		/* keep the timing exact, unless we fell behind completely */
+		dclmdCalcWaitTimeMS(&dc->anim_next, &dc->anim_next, anim_duration(dc));
+		if (dclmdCompareTime(&dc->anim_next, &dc->loop_time) < 0) {
+			struct timespec limit;
+			dclmdCalcWaitTimeMS(&limit, &dc->anim_next, DCLMD_ANIM_MAX_LAG_MS);
+			if (dclmdCompareTime(&limit, &dc->loop_time) < 0) {
+				dclmdCalcWaitTimeMS(&dc->anim_next, &dc->loop_time, anim_duration(dc));
+			}
+		}
+	}
+	if (changed) {
+		dclmScrSetData(dc->scr, dc->anim->screen);
+	}
+	if (stop) {
+		/* the last frame stays on the screen */
+		dctxAnimStop(dc);
+	}
+	return changed;
+}
+
+extern int
+dctxAnimNext(const DCLMDContext *dc, struct timespec *ts)
+{
+	if (!dc->anim) {
+		return 0;
+	}
+	*ts = dc->anim_next;
+	return 1;
+}
+
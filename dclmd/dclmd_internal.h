@@ -0,0 +1,538 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DCLMD_INTERNAL_H
+#define DCLMD_INTERNAL_H
+
+#include "dclm.h"
+#include "dclmd_comm.h"
+#include "dclm_anim.h"
+
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************
+ * CONFIGURATION DEFAULTS AND CONSTANTS                                     *
+ ****************************************************************************/
+
+#define DCLMD_DEFAULT_REFRESH_MS 300 /* maximum time between LED matrix refresh */
+#define DCLMD_MAX_SOURCES 8 /* maximum number of event sources in the main loop */
+#define DCLMD_SCHED_MAX_ITEMS 32 /* maximum number of scheduled items */
+#define DCLMD_TRANS_FRAME_MS 25 /* time per frame of a transition */
+#define DCLMD_TRANS_MAX_FRAMES 24 /* maximum number of frames of a transition */
+#define DCLMD_STORE_MAX_ITEMS 64 /* maximum number of screens in the frame store */
+#define DCLMD_LAYER_MAX_ITEMS 16 /* maximum number of layers */
+#define DCLMD_LAYER_WORDS (DCLM_SCR_DATA_SIZE / sizeof(uint64_t)) /* packed screen in words */
+#define DCLMD_WIDGET_MAX_ITEMS 16 /* maximum number of widgets */
+#define DCLMD_WIDGET_TEXT_LEN 31 /* maximum length of the text of a widget */
+#define DCLMD_WIDGET_HISTORY 32 /* number of samples of a sparkline */
+#define DCLMD_QUEUE_MAX_FRAMES 128 /* maximum number of frames in the frame queue */
+#define DCLMD_QUEUE_LATE_MS 20 /* a frame this late is dropped */
+
+/****************************************************************************
+ * ERRORS and DIAGNOSTICS                                                   *
+ ****************************************************************************/
+
+extern void
+dclmdWarning(const char *template, ...);
+
+#ifdef NDEBUG
+#define dclmdDebug(...) ((void)0)
+#else
+extern void
+dclmdDebug(const char *template, ...);
+#endif
+
+/****************************************************************************
+ * INTERNAL DATA TYPES                                                      *
+ ****************************************************************************/
+
+struct DCLMDContext_s;
+
+/* a screen in the frame store */
+typedef struct {
+	int used;
+	unsigned int id;
+	char name[DCLMD_STORE_NAME_LEN+1];
+	uint8_t data[DCLM_SCR_DATA_SIZE]; /* see dclmScrGetData() */
+} DCLMDStoreItem;
+
+/* a layer: packed screen data, and the mask of the bits it covers */
+typedef struct {
+	unsigned int id;
+	int z;
+	const DCLMDComminucation *owner; /* the connection which set it */
+	int expires; /* removed at expire_time */
+	struct timespec expire_time;
+	uint64_t data[DCLMD_LAYER_WORDS];
+	uint64_t mask[DCLMD_LAYER_WORDS];
+} DCLMDLayer;
+
+/* a widget, see dclmd_widget.c */
+typedef struct {
+	unsigned int id;
+	int type; /* DCLMD_WIDGET_* */
+	int x, y;
+	unsigned int flags;
+	int value;
+	int max;
+	int scaled; /* length of a bar in pixels */
+	char text[DCLMD_WIDGET_TEXT_LEN+1]; /* the text shown */
+	int hist[DCLMD_WIDGET_HISTORY]; /* ring buffer of a sparkline */
+	unsigned int hist_pos;
+	unsigned int hist_count;
+	struct timespec start; /* start of an elapsed time clock */
+	DCLMImage *img; /* the widget drawn, the size of its region */
+} DCLMDWidget;
+
+/* a frame in the frame queue */
+typedef struct {
+	struct timespec when; /* presentation time */
+	uint8_t data[DCLM_SCR_DATA_SIZE]; /* see dclmScrGetData() */
+} DCLMDQueuedFrame;
+
+/* handler for an event source of the main loop
+ * RETURN 0: OK
+ *        otherwise: give up, the value is the exit status
+ */
+typedef int (*DCLMDSourceHandler)(struct DCLMDContext_s *dc, int fd, uint32_t events);
+
+/* an event source: a file descriptor in the epoll set */
+typedef struct {
+	int fd;
+	DCLMDSourceHandler handler;
+} DCLMDSource;
+
+/* an item of the timeline */
+typedef struct {
+	unsigned int id;
+	int priority;
+	unsigned int seq;	/* order of arrival, the newer item wins on equal priority */
+	unsigned int flags;
+	int heap_pos;		/* position in the deadline heap, -1 if not in it */
+	struct timespec start;
+	struct timespec end;
+	DCLEDMatrixScreen *scr;
+} DCLMDSchedItem;
+
+#define DCLMD_SCHED_USED	0x1
+#define DCLMD_SCHED_STARTED	0x2
+#define DCLMD_SCHED_FOREVER	0x4	/* no end time */
+
+/* the timeline: all items, and a heap of the items
+ * with a pending deadline (start or end time) */
+typedef struct {
+	DCLMDSchedItem items[DCLMD_SCHED_MAX_ITEMS];
+	unsigned int heap[DCLMD_SCHED_MAX_ITEMS];
+	unsigned int heap_size;
+	unsigned int seq;
+	int active; /* index of the item shown, -1 if none */
+	int changed; /* the screen to show changed */
+} DCLMDSchedule;
+
+typedef struct DCLMDContext_s {
+	DCLEDMatrix *dclm;
+	DCLEDMatrixScreen *scr;
+	DCLEDMatrixScreen *scr_back; /* off-screen for display lists */
+	DCLMDComminucation *comm;
+	const char *instance; /* "" for the default instance */
+	DCLMImage *img; /* private copy of the image currently shown */
+	size_t img_capacity;
+	unsigned refresh_ms;
+	sig_atomic_t run;
+	unsigned int refresh;
+	struct timespec loop_time;
+	struct timespec timeout;
+	size_t pan_x, pan_y;
+	int pan_step_x, pan_step_y;
+	unsigned int pan_ms; /* 0: not panning */
+	struct timespec pan_next;
+	int epoll_fd;
+	int timer_fd;
+	int signal_fd;
+	DCLMDSource sources[DCLMD_MAX_SOURCES];
+	unsigned int source_count;
+	DCLMDSchedule sched;
+	DCLMImage *scroll_img; /* the marquee strip, NULL if not scrolling */
+	unsigned int scroll_pps;
+	int scroll_dir;
+	unsigned int scroll_loops; /* 0: forever */
+	uint64_t scroll_pos; /* pixels scrolled at the last update */
+	struct timespec scroll_start;
+	struct timespec scroll_next;
+	int trans_effect; /* DCLM_TRANS_CUT: no transitions */
+	unsigned int trans_ms;
+	DCLEDMatrixScreen *trans_from; /* the screen shown before the change */
+	DCLEDMatrixScreen *trans_frames[DCLMD_TRANS_MAX_FRAMES];
+	unsigned int trans_count; /* frames of the running transition, 0: none */
+	unsigned int trans_frame; /* frame currently shown */
+	struct timespec trans_start;
+	struct timespec trans_next;
+	DCLMAnim *anim; /* the animation played, NULL if none */
+	int anim_mode;
+	int anim_dir; /* 1: forward, -1: backward */
+	unsigned int anim_loops; /* 0: forever */
+	unsigned int anim_pass;
+	struct timespec anim_next;
+	DCLMDStoreItem store[DCLMD_STORE_MAX_ITEMS];
+	DCLMDLayer layers[DCLMD_LAYER_MAX_ITEMS]; /* sorted by z, bottom first */
+	unsigned int layer_count;
+	int layer_dirty; /* a layer changed since the last composition */
+	uint64_t layer_base[DCLMD_LAYER_WORDS]; /* the screen below at the last composition */
+	DCLEDMatrixScreen *layer_out; /* the last composition */
+	DCLMDWidget widgets[DCLMD_WIDGET_MAX_ITEMS];
+	unsigned int widget_count;
+	DCLEDMatrixScreen *widget_scr; /* all widgets drawn */
+	uint64_t widget_mask[DCLMD_LAYER_WORDS]; /* the regions of all widgets */
+	DCLMDQueuedFrame queue[DCLMD_QUEUE_MAX_FRAMES]; /* ring buffer, sorted by deadline */
+	unsigned int queue_head;
+	unsigned int queue_count;
+	unsigned int queue_presented; /* counters since the queue_owner replaced the queue */
+	unsigned int queue_dropped;
+	DCLMDComminucation *queue_owner; /* connection which queued the frames */
+	DCLMImage *mirror_img; /* the screen last published in the mirror */
+	uint8_t mirror_data[DCLM_SCR_DATA_SIZE]; /* the same, packed */
+} DCLMDContext;
+
+#define DC_REFRESH		0x1
+#define DC_REFRESH_ONCE		0x2
+#define DC_REFRESH_UNTIL	0x4
+
+/****************************************************************************
+ * TIMELINE (dclmd_sched.c)                                                 *
+ ****************************************************************************/
+
+extern void
+dctxSchedInit(DCLMDContext *dc);
+
+extern void
+dctxSchedCleanup(DCLMDContext *dc);
+
+/* Add an item showing scr, replaces any item with the same id.
+ * start_ms: delay from now, duration_ms: 0 means until removed
+ * RETURN 0: OK
+ *       -1: timeline full or out of memory
+ */
+extern int
+dctxSchedAdd(DCLMDContext *dc, unsigned int id, int priority,
+	     unsigned int start_ms, unsigned int duration_ms,
+	     const DCLEDMatrixScreen *scr);
+
+/* Remove the item id, DCLMD_SCHED_ID_ALL removes all items */
+extern void
+dctxSchedRemove(DCLMDContext *dc, unsigned int id);
+
+/* Start and expire all items which are due at dc->loop_time
+ * RETURN 1: the screen to show changed
+ *        0: nothing changed
+ */
+extern int
+dctxSchedUpdate(DCLMDContext *dc);
+
+/* Get the next deadline of the timeline
+ * RETURN 1: deadline in *ts
+ *        0: no deadline
+ */
+extern int
+dctxSchedNext(const DCLMDContext *dc, struct timespec *ts);
+
+/* Get the screen of the item currently shown
+ * RETURN: the screen, NULL if no item is active
+ */
+extern DCLEDMatrixScreen *
+dctxSchedScreen(const DCLMDContext *dc);
+
+/****************************************************************************
+ * MARQUEE (dclmd_scroll.c)                                                 *
+ ****************************************************************************/
+
+/* Start scrolling text over dc->scr, replaces a running marquee
+ * RETURN 0: OK
+ *       -1: out of memory
+ */
+extern int
+dctxScrollStart(DCLMDContext *dc, const char *text, unsigned int pps, int dir, unsigned int loops);
+
+extern void
+dctxScrollStop(DCLMDContext *dc);
+
+/* Move the marquee to its position at dc->loop_time
+ * RETURN 1: dc->scr changed
+ *        0: nothing changed
+ */
+extern int
+dctxScrollUpdate(DCLMDContext *dc);
+
+/* Get the time of the next pixel step
+ * RETURN 1: time in *ts
+ *        0: not scrolling
+ */
+extern int
+dctxScrollNext(const DCLMDContext *dc, struct timespec *ts);
+
+/****************************************************************************
+ * TRANSITIONS (dclmd_trans.c)                                              *
+ ****************************************************************************/
+
+extern void
+dctxTransInit(DCLMDContext *dc);
+
+extern void
+dctxTransCleanup(DCLMDContext *dc);
+
+/* Set the transition for the following content changes
+ * RETURN 0: OK
+ *       -1: unknown effect
+ */
+extern int
+dctxTransSet(DCLMDContext *dc, int effect, unsigned int duration_ms);
+
+/* Remember the screen shown before a content change */
+extern void
+dctxTransSnapshot(DCLMDContext *dc, const DCLEDMatrixScreen *shown);
+
+/* Start the transition from the snapshot to the new screen to,
+ * all frames are computed right here
+ * RETURN 0: OK (also if transitions are off)
+ *       -1: out of memory, the change is a hard cut
+ */
+extern int
+dctxTransStart(DCLMDContext *dc, const DCLEDMatrixScreen *to);
+
+/* Advance the transition to its frame at dc->loop_time
+ * RETURN 1: the frame to show changed
+ *        0: nothing changed
+ */
+extern int
+dctxTransUpdate(DCLMDContext *dc);
+
+/* Get the time of the next frame
+ * RETURN 1: time in *ts
+ *        0: no transition running
+ */
+extern int
+dctxTransNext(const DCLMDContext *dc, struct timespec *ts);
+
+/* Get the frame of the running transition
+ * RETURN: the frame, NULL if no transition is running
+ */
+extern DCLEDMatrixScreen *
+dctxTransScreen(const DCLMDContext *dc);
+
+/****************************************************************************
+ * ANIMATIONS (dclmd_anim.c)                                                *
+ ****************************************************************************/
+
+/* Start playing the animation file path on dc->scr,
+ * replaces a running animation
+ * RETURN 0: OK
+ *       -1: file can't be read or is malformed
+ */
+extern int
+dctxAnimStart(DCLMDContext *dc, const char *path, int mode, unsigned int loops);
+
+extern void
+dctxAnimStop(DCLMDContext *dc);
+
+/* Advance the animation to its frame at dc->loop_time
+ * RETURN 1: dc->scr changed
+ *        0: nothing changed
+ */
+extern int
+dctxAnimUpdate(DCLMDContext *dc);
+
+/* Get the time of the next frame
+ * RETURN 1: time in *ts
+ *        0: no animation running
+ */
+extern int
+dctxAnimNext(const DCLMDContext *dc, struct timespec *ts);
+
+/****************************************************************************
+ * FRAME STORE (dclmd_store.c)                                              *
+ ****************************************************************************/
+
+extern void
+dctxStoreInit(DCLMDContext *dc);
+
+/* Put scr into the store under the key id, name,
+ * replaces an entry with the same key
+ * RETURN 0: OK
+ *       -1: store full
+ */
+extern int
+dctxStorePut(DCLMDContext *dc, unsigned int id, const char *name, const DCLEDMatrixScreen *scr);
+
+/* Get the packed data of the entry id, name
+ * RETURN: the data, NULL if there is no such entry
+ */
+extern const uint8_t *
+dctxStoreGet(const DCLMDContext *dc, unsigned int id, const char *name);
+
+extern void
+dctxStoreDrop(DCLMDContext *dc, unsigned int id, const char *name);
+
+/****************************************************************************
+ * LAYERS (dclmd_layer.c)                                                   *
+ ****************************************************************************/
+
+extern void
+dctxLayerInit(DCLMDContext *dc);
+
+extern void
+dctxLayerCleanup(DCLMDContext *dc);
+
+/* Set the layer id to content, clipped to the region x, y, w, h,
+ * replaces a layer with the same id
+ * flags: DCLMD_LAYER_OPAQUE: cover the whole region,
+ *        otherwise only the lit pixels of content
+ * owner: the connection setting it, see dctxLayerDropOwner()
+ * ttl_ms: remove the layer after that time, 0: never
+ * RETURN 0: OK
+ *       -1: out of memory or too many layers
+ */
+extern int
+dctxLayerSet(DCLMDContext *dc, unsigned int id, int z, int x, int y, int w, int h,
+	     unsigned int flags, const DCLEDMatrixScreen *content,
+	     const DCLMDComminucation *owner, unsigned int ttl_ms);
+
+/* Remove the layer id, DCLMD_LAYER_ID_ALL removes all layers */
+extern void
+dctxLayerRemove(DCLMDContext *dc, unsigned int id);
+
+/* Remove all layers set by owner
+ * RETURN 1: a layer was removed
+ *        0: nothing changed
+ */
+extern int
+dctxLayerDropOwner(DCLMDContext *dc, const DCLMDComminucation *owner);
+
+/* Remove the layers expired at dc->loop_time
+ * RETURN 1: a layer was removed
+ *        0: nothing changed
+ */
+extern int
+dctxLayerExpire(DCLMDContext *dc);
+
+/* Get the time the next layer expires
+ * RETURN 1: time in *ts
+ *        0: no layer expires
+ */
+extern int
+dctxLayerNext(const DCLMDContext *dc, struct timespec *ts);
+
+/* Compose the layers and the widgets on top of base, this is only done
+ * if a layer or base changed since the last time
+ * RETURN: the composed screen, base itself if there is nothing on top
+ */
+extern DCLEDMatrixScreen *
+dctxLayerCompose(DCLMDContext *dc, const DCLEDMatrixScreen *base);
+
+/****************************************************************************
+ * WIDGETS (dclmd_widget.c)                                                 *
+ ****************************************************************************/
+
+extern void
+dctxWidgetInit(DCLMDContext *dc);
+
+extern void
+dctxWidgetCleanup(DCLMDContext *dc);
+
+/* Set the widget id of type in the region x, y, w, h,
+ * replaces a widget with the same id
+ * value, text: the initial contents, see dctxWidgetUpdate()
+ * icon: the image of a DCLMD_WIDGET_ICON
+ * RETURN 0: OK
+ *       -1: invalid widget, out of memory or too many widgets
+ */
+extern int
+dctxWidgetSet(DCLMDContext *dc, unsigned int id, int type, int x, int y, int w, int h,
+	      unsigned int flags, int value, int max, const char *text, const DCLMImage *icon);
+
+/* Set new contents of the widget id, it is only drawn again
+ * if what it shows changed
+ * RETURN 0: OK
+ *       -1: no such widget
+ */
+extern int
+dctxWidgetUpdate(DCLMDContext *dc, unsigned int id, int value, const char *text);
+
+/* Remove the widget id, DCLMD_WIDGET_ID_ALL removes all widgets */
+extern void
+dctxWidgetRemove(DCLMDContext *dc, unsigned int id);
+
+/* Let the clocks tick to dc->loop_time
+ * RETURN 1: a widget changed
+ *        0: nothing changed
+ */
+extern int
+dctxWidgetTick(DCLMDContext *dc);
+
+/* Get the time of the next tick of a clock
+ * RETURN 1: time in *ts
+ *        0: no clocks
+ */
+extern int
+dctxWidgetNext(const DCLMDContext *dc, struct timespec *ts);
+
+/****************************************************************************
+ * FRAME QUEUE (dclmd_queue.c)                                              *
+ ****************************************************************************/
+
+extern void
+dctxQueueInit(DCLMDContext *dc);
+
+/* Start the statistics over, for a new owner of the queue */
+extern void
+dctxQueueResetStats(DCLMDContext *dc);
+
+/* Drop all pending frames, they count as dropped */
+extern void
+dctxQueueClear(DCLMDContext *dc);
+
+/* Queue the packed screen data to be presented at when
+ * RETURN 0: OK
+ *       -1: queue full
+ */
+extern int
+dctxQueuePush(DCLMDContext *dc, const struct timespec *when, const uint8_t *data);
+
+/* Put the latest frame due at dc->loop_time onto dc->scr,
+ * dropping the ones which are too late
+ * RETURN 1: dc->scr changed
+ *        0: nothing changed
+ */
+extern int
+dctxQueueUpdate(DCLMDContext *dc);
+
+/* Get the deadline of the next frame
+ * RETURN 1: time in *ts
+ *        0: queue empty
+ */
+extern int
+dctxQueueNext(const DCLMDContext *dc, struct timespec *ts);
+
+#ifdef __cplusplus
+}	/* extern "C" */
+#endif
+
+#endif /* !DCLMD_INTERNAL_H */
+
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* The layer stack: screens of several producers composed on top of the
+ * regular contents. Each layer covers a region of the screen, either
+ * completely (opaque) or only with its lit pixels (transparent). Layers
+ * are kept in their packed form together with the mask of the pixels
+ * they cover, so composing is a few word-wide bit operations per layer,
+ * and it is only done when a layer or the screen below changed.
+ * The widgets go on top of all layers the same way.
+ */
+
+#include "dclmd_internal.h"
+
+#include <string.h>
+
+/****************************************************************************
+ * INTERNAL                                                                 *
+ ****************************************************************************/
+
+static int
+layer_find(const DCLMDContext *dc, unsigned int id)
+{
+	unsigned int i;
+
+	for (i = 0; i < dc->layer_count; i++) {
+		if (dc->layers[i].id == id) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+static void
+layer_remove_at(DCLMDContext *dc, unsigned int idx)
+{
+	memmove(&dc->layers[idx], &dc->layers[idx+1], (dc->layer_count - idx - 1) * sizeof(DCLMDLayer));
+	dc->layer_count--;
+	dc->layer_dirty = 1;
+}
+
+/****************************************************************************
+ * LAYERS                                                                   *
+ ****************************************************************************/
+
+extern void
+dctxLayerInit(DCLMDContext *dc)
+{
+	dc->layer_count = 0;
+	dc->layer_dirty = 1;
+	dc->layer_out = NULL;
+}
+
+extern void
+dctxLayerCleanup(DCLMDContext *dc)
+{
+	dclmScrDestroy(dc->layer_out);
+	dctxLayerInit(dc);
+}
+
+extern int
+dctxLayerSet(DCLMDContext *dc, unsigned int id, int z, int x, int y, int w, int h,
+	     unsigned int flags, const DCLEDMatrixScreen *content,
+	     const DCLMDComminucation *owner, unsigned int ttl_ms)
+{
+	DCLEDMatrixScreen *scr;
+	DCLMDLayer layer;
+	uint64_t blank[DCLMD_LAYER_WORDS];
+	uint64_t region[DCLMD_LAYER_WORDS];
+	unsigned int i;
+	int idx;
+
+	/* the masks are the bits which differ from a blank screen */
+	scr = dclmScrCreate(dc->dclm);
+	if (!scr) {
+		return -1;
+	}
+	dclmScrClear(scr, 0);
+	dclmScrGetData(scr, (uint8_t*)blank);
+	dclmScrFillRect(scr, x, y, w, h, 1);
+	dclmScrGetData(scr, (uint8_t*)region);
+	dclmScrDestroy(scr);
+
+	layer.id = id;
+	layer.z = z;
+	layer.owner = owner;
+	layer.expires = (ttl_ms > 0);
+	if (layer.expires) {
+		dclmdCalcWaitTimeMS(&layer.expire_time, &dc->loop_time, ttl_ms);
+	}
+	dclmScrGetData(content, (uint8_t*)layer.data);
+	for (i = 0; i < DCLMD_LAYER_WORDS; i++) {
+		layer.mask[i] = blank[i] ^ region[i];
+		if (!(flags & DCLMD_LAYER_OPAQUE)) {
+			layer.mask[i] &= blank[i] ^ layer.data[i];
+		}
+	}
+
+	if ( (idx = layer_find(dc, id)) >= 0) {
+		layer_remove_at(dc, (unsigned int)idx);
+	}
+	if (dc->layer_count >= DCLMD_LAYER_MAX_ITEMS) {
+		return -1;
+	}
+
+	/* keep the stack sorted by z, the newer layer goes on top on equal z */
+	for (i = dc->layer_count; i > 0 && dc->layers[i-1].z > z; i--) {
+		dc->layers[i] = dc->layers[i-1];
+	}
+	dc->layers[i] = layer;
+	dc->layer_count++;
+	dc->layer_dirty = 1;
+	return 0;
+}
+
+extern void
+dctxLayerRemove(DCLMDContext *dc, unsigned int id)
+{
+	unsigned int i = 0;
+
+	while (i < dc->layer_count) {
+		if (id == DCLMD_LAYER_ID_ALL || dc->layers[i].id == id) {
+			layer_remove_at(dc, i);
+		} else {
+			i++;
+		}
+	}
+}
+
+extern int
+dctxLayerDropOwner(DCLMDContext *dc, const DCLMDComminucation *owner)
+{
+	unsigned int i = 0;
+	int removed = 0;
+
+	while (i < dc->layer_count) {
+		if (dc->layers[i].owner == owner) {
+			layer_remove_at(dc, i);
+			removed = 1;
+		} else {
+			i++;
+		}
+	}
+	return removed;
+}
+
+extern int
+dctxLayerExpire(DCLMDContext *dc)
+{
+	unsigned int i = 0;
+	int removed = 0;
+
+	while (i < dc->layer_count) {
+		if (dc->layers[i].expires && dclmdCompareTime(&dc->layers[i].expire_time, &dc->loop_time) <= 0) {
+			layer_remove_at(dc, i);
+			removed = 1;
+		} else {
+			i++;
+		}
+	}
+	return removed;
+}
+
+extern int
+dctxLayerNext(const DCLMDContext *dc, struct timespec *ts)
+{
+	unsigned int i;
+	int found = 0;
+
+	for (i = 0; i < dc->layer_count; i++) {
+		const DCLMDLayer *layer = &dc->layers[i];
+		if (layer->expires && (!found || dclmdCompareTime(&layer->expire_time, ts) < 0)) {
+			*ts = layer->expire_time;
+			found = 1;
+		}
+	}
+	return found;
+}
+
+extern DCLEDMatrixScreen *
+dctxLayerCompose(DCLMDContext *dc, const DCLEDMatrixScreen *base)
+{
+	uint64_t data[DCLMD_LAYER_WORDS];
+	unsigned int i, j;
+
+	if (!dc->layer_count && !dc->widget_count) {
+		return (DCLEDMatrixScreen*)base;
+	}
+	if (!dc->layer_out) {
+		dc->layer_out = dclmScrCreate(dc->dclm);
+		if (!dc->layer_out) {
+			return (DCLEDMatrixScreen*)base;
+		}
+		dc->layer_dirty = 1;
+	}
+
+	dclmScrGetData(base, (uint8_t*)data);
+	if (!dc->layer_dirty && !memcmp(data, dc->layer_base, sizeof(data))) {
+		return dc->layer_out;
+	}
+	memcpy(dc->layer_base, data, sizeof(data));
+
+	for (i = 0; i < dc->layer_count; i++) {
+		const DCLMDLayer *layer = &dc->layers[i];
+		for (j = 0; j < DCLMD_LAYER_WORDS; j++) {
+			data[j] = (data[j] & ~layer->mask[j]) | (layer->data[j] & layer->mask[j]);
+		}
+	}
+	if (dc->widget_count) {
+		uint64_t widgets[DCLMD_LAYER_WORDS];
+		dclmScrGetData(dc->widget_scr, (uint8_t*)widgets);
+		for (j = 0; j < DCLMD_LAYER_WORDS; j++) {
+			data[j] = (data[j] & ~dc->widget_mask[j]) | (widgets[j] & dc->widget_mask[j]);
+		}
+	}
+	dclmScrCopy(dc->layer_out, base);
+	dclmScrSetData(dc->layer_out, (const uint8_t*)data);
+	dc->layer_dirty = 0;
+	return dc->layer_out;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* The frame queue: packed screens, each with the time it is to be
+ * presented at. A frame is shown at its deadline; frames overtaken by
+ * a later frame which is also due, or more than DCLMD_QUEUE_LATE_MS
+ * behind their deadline, are dropped instead of shown late.
+ */
+
+#include "dclmd_internal.h"
+
+#include <string.h>
+
+/****************************************************************************
+ * FRAME QUEUE                                                              *
+ ****************************************************************************/
+
+extern void
+dctxQueueInit(DCLMDContext *dc)
+{
+	dc->queue_head = 0;
+	dc->queue_count = 0;
+	dc->queue_presented = 0;
+	dc->queue_dropped = 0;
+}
+
+extern void
+dctxQueueResetStats(DCLMDContext *dc)
+{
+	dc->queue_presented = 0;
+	dc->queue_dropped = 0;
+}
+
+extern void
+dctxQueueClear(DCLMDContext *dc)
+{
+	dc->queue_dropped += dc->queue_count;
+	dc->queue_head = 0;
+	dc->queue_count = 0;
+}
+
+extern int
+dctxQueuePush(DCLMDContext *dc, const struct timespec *when, const uint8_t *data)
+{
+	DCLMDQueuedFrame *frame;
+	unsigned int i;
+
+	if (dc->queue_count >= DCLMD_QUEUE_MAX_FRAMES) {
+		return -1;
+	}
+
+	/* keep the queue sorted by deadline, usually this is an append */
+	i = dc->queue_count;
+	while (i > 0) {
+		const DCLMDQueuedFrame *prev = &dc->queue[(dc->queue_head + i - 1) % DCLMD_QUEUE_MAX_FRAMES];
+		if (dclmdCompareTime(&prev->when, when) <= 0) {
+			break;
+		}
+		dc->queue[(dc->queue_head + i) % DCLMD_QUEUE_MAX_FRAMES] = *prev;
+		i--;
+	}
+	frame = &dc->queue[(dc->queue_head + i) % DCLMD_QUEUE_MAX_FRAMES];
+	frame->when = *when;
+	memcpy(frame->data, data, DCLM_SCR_DATA_SIZE);
+	dc->queue_count++;
+	return 0;
+}
+
+extern int
+dctxQueueUpdate(DCLMDContext *dc)
+{
+	const DCLMDQueuedFrame *show = NULL;
+	struct timespec late;
+
+	while (dc->queue_count) {
+		const DCLMDQueuedFrame *frame = &dc->queue[dc->queue_head];
+		if (dclmdCompareTime(&frame->when, &dc->loop_time) > 0) {
+			break;
+		}
+		if (show) {
+			/* overtaken by this one */
+			dc->queue_dropped++;
+		}
+		show = frame;
+		dc->queue_head = (dc->queue_head + 1) % DCLMD_QUEUE_MAX_FRAMES;
+		dc->queue_count--;
+	}
+	if (!show) {
+		return 0;
+	}
+
+	dclmdCalcWaitTimeMS(&late, &show->when, DCLMD_QUEUE_LATE_MS);
+	if (dclmdCompareTime(&dc->loop_time, &late) > 0) {
+		dc->queue_dropped++;
+		return 0;
+	}
+	dclmScrSetData(dc->scr, show->data);
+	dc->queue_presented++;
+	return 1;
+}
+
+extern int
+dctxQueueNext(const DCLMDContext *dc, struct timespec *ts)
+{
+	if (!dc->queue_count) {
+		return 0;
+	}
+	*ts = dc->queue[dc->queue_head].when;
+	return 1;
+}
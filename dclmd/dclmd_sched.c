@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The timeline: items with a priority, a start time and a duration.
+ * The item with the highest priority among the started ones is shown
+ * instead of the regular screen. When it expires, whatever was shown
+ * before comes back. All items with a pending start or end time are
+ * kept in a heap keyed by that deadline, so the main loop only needs
+ * a single timer for the whole timeline.
+ */
+
+#include "dclmd_internal.h"
+
+/****************************************************************************
+ * INTERNAL: THE DEADLINE HEAP                                              *
+ ****************************************************************************/
+
+static const struct timespec *
+sched_deadline(const DCLMDSchedItem *item)
+{
+	return (item->flags & DCLMD_SCHED_STARTED)?&item->end:&item->start;
+}
+
+static int
+sched_less(const DCLMDSchedule *s, unsigned int a, unsigned int b)
+{
+	return dclmdCompareTime(sched_deadline(&s->items[s->heap[a]]),
+				sched_deadline(&s->items[s->heap[b]])) < 0;
+}
+
+static void
+sched_swap(DCLMDSchedule *s, unsigned int a, unsigned int b)
+{
+	unsigned int tmp = s->heap[a];
+
+	s->heap[a] = s->heap[b];
+	s->heap[b] = tmp;
+	s->items[s->heap[a]].heap_pos = (int)a;
+	s->items[s->heap[b]].heap_pos = (int)b;
+}
+
+static void
+sched_sift_up(DCLMDSchedule *s, unsigned int pos)
+{
+	while (pos > 0 && sched_less(s, pos, (pos-1)/2)) {
+		sched_swap(s, pos, (pos-1)/2);
+		pos = (pos-1)/2;
+	}
+}
+
+static void
+sched_sift_down(DCLMDSchedule *s, unsigned int pos)
+{
+	unsigned int child;
+
+	while ( (child = 2*pos+1) < s->heap_size) {
+		if (child + 1 < s->heap_size && sched_less(s, child+1, child)) {
+			child++;
+		}
+		if (!sched_less(s, child, pos)) {
+			break;
+		}
+		sched_swap(s, pos, child);
+		pos = child;
+	}
+}
+
+static void
+sched_heap_push(DCLMDSchedule *s, unsigned int idx)
+{
+	unsigned int pos = s->heap_size++;
+
+	s->heap[pos] = idx;
+	s->items[idx].heap_pos = (int)pos;
+	sched_sift_up(s, pos);
+}
+
+static void
+sched_heap_remove(DCLMDSchedule *s, unsigned int idx)
+{
+	int pos = s->items[idx].heap_pos;
+	unsigned int last;
+
+	if (pos < 0) {
+		return;
+	}
+
+	last = --s->heap_size;
+	if ((unsigned int)pos != last) {
+		sched_swap(s, (unsigned int)pos, last);
+		sched_sift_up(s, (unsigned int)pos);
+		sched_sift_down(s, (unsigned int)pos);
+	}
+	s->items[idx].heap_pos = -1;
+}
+
+/****************************************************************************
+ * INTERNAL: ITEMS                                                          *
+ ****************************************************************************/
+
+/* find the item with the highest priority among the started ones */
+static void
+sched_pick_active(DCLMDSchedule *s)
+{
+	int best = -1;
+	unsigned int i;
+
+	for (i = 0; i < DCLMD_SCHED_MAX_ITEMS; i++) {
+		const DCLMDSchedItem *item = &s->items[i];
+		if (!(item->flags & DCLMD_SCHED_STARTED)) {
+			continue;
+		}
+		if (best < 0 || item->priority > s->items[best].priority ||
+		    (item->priority == s->items[best].priority && (int)(item->seq - s->items[best].seq) > 0)) {
+			best = (int)i;
+		}
+	}
+
+	if (best != s->active) {
+		s->active = best;
+		s->changed = 1;
+	}
+}
+
+static void
+sched_free(DCLMDSchedule *s, unsigned int idx)
+{
+	if (s->items[idx].flags & DCLMD_SCHED_STARTED) {
+		s->changed = 1;
+	}
+	sched_heap_remove(s, idx);
+	s->items[idx].flags = 0;
+}
+
+/****************************************************************************
+ * TIMELINE                                                                 *
+ ****************************************************************************/
+
+extern void
+dctxSchedInit(DCLMDContext *dc)
+{
+	DCLMDSchedule *s = &dc->sched;
+	unsigned int i;
+
+	for (i = 0; i < DCLMD_SCHED_MAX_ITEMS; i++) {
+		s->items[i].flags = 0;
+		s->items[i].heap_pos = -1;
+		s->items[i].scr = NULL;
+	}
+	s->heap_size = 0;
+	s->seq = 0;
+	s->active = -1;
+	s->changed = 0;
+}
+
+extern void
+dctxSchedCleanup(DCLMDContext *dc)
+{
+	DCLMDSchedule *s = &dc->sched;
+	unsigned int i;
+
+	for (i = 0; i < DCLMD_SCHED_MAX_ITEMS; i++) {
+		dclmScrDestroy(s->items[i].scr);
+	}
+	dctxSchedInit(dc);
+}
+
+extern int
+dctxSchedAdd(DCLMDContext *dc, unsigned int id, int priority,
+	     unsigned int start_ms, unsigned int duration_ms,
+	     const DCLEDMatrixScreen *scr)
+{
+	DCLMDSchedule *s = &dc->sched;
+	DCLMDSchedItem *item;
+	unsigned int i;
+
+	dctxSchedRemove(dc, id);
+
+	for (i = 0; i < DCLMD_SCHED_MAX_ITEMS; i++) {
+		if (!(s->items[i].flags & DCLMD_SCHED_USED)) {
+			break;
+		}
+	}
+	if (i >= DCLMD_SCHED_MAX_ITEMS) {
+		return -1;
+	}
+
+	item = &s->items[i];
+	if (!item->scr) {
+		item->scr = dclmScrCreate(dc->dclm);
+		if (!item->scr) {
+			return -1;
+		}
+	}
+	dclmScrCopy(item->scr, scr);
+
+	item->id = id;
+	item->priority = priority;
+	item->seq = ++s->seq;
+	item->flags = DCLMD_SCHED_USED;
+	if (!duration_ms) {
+		item->flags |= DCLMD_SCHED_FOREVER;
+	}
+	dclmdCalcWaitTimeMS(&item->start, &dc->loop_time, start_ms);
+	dclmdCalcWaitTimeMS(&item->end, &item->start, duration_ms);
+
+	/* it is started by the next dctxSchedUpdate() if it is due already */
+	sched_heap_push(s, i);
+	return 0;
+}
+
+extern void
+dctxSchedRemove(DCLMDContext *dc, unsigned int id)
+{
+	DCLMDSchedule *s = &dc->sched;
+	unsigned int i;
+
+	for (i = 0; i < DCLMD_SCHED_MAX_ITEMS; i++) {
+		if ((s->items[i].flags & DCLMD_SCHED_USED) &&
+		    (id == DCLMD_SCHED_ID_ALL || s->items[i].id == id)) {
+			sched_free(s, i);
+		}
+	}
+	sched_pick_active(s);
+}
+
+extern int
+dctxSchedUpdate(DCLMDContext *dc)
+{
+	DCLMDSchedule *s = &dc->sched;
+	unsigned int idx;
+	int changed;
+
+	while (s->heap_size > 0) {
+		idx = s->heap[0];
+		if (dclmdCompareTime(sched_deadline(&s->items[idx]), &dc->loop_time) > 0) {
+			break;
+		}
+		sched_heap_remove(s, idx);
+		if (s->items[idx].flags & DCLMD_SCHED_STARTED) {
+			dclmdDebug("timeline: item %u expired", s->items[idx].id);
+			sched_free(s, idx);
+		} else {
+			dclmdDebug("timeline: item %u started", s->items[idx].id);
+			s->items[idx].flags |= DCLMD_SCHED_STARTED;
+			s->changed = 1;
+			if (!(s->items[idx].flags & DCLMD_SCHED_FOREVER)) {
+				sched_heap_push(s, idx);
+			}
+		}
+	}
+
+	sched_pick_active(s);
+	changed = s->changed;
+	s->changed = 0;
+	return changed;
+}
+
+extern int
+dctxSchedNext(const DCLMDContext *dc, struct timespec *ts)
+{
+	const DCLMDSchedule *s = &dc->sched;
+
+	if (!s->heap_size) {
+		return 0;
+	}
+	*ts = *sched_deadline(&s->items[s->heap[0]]);
+	return 1;
+}
+
+extern DCLEDMatrixScreen *
+dctxSchedScreen(const DCLMDContext *dc)
+{
+	const DCLMDSchedule *s = &dc->sched;
+
+	if (s->active < 0) {
+		return NULL;
+	}
+	return s->items[s->active].scr;
+}
+
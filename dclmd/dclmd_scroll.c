@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The marquee: the text is rendered once into a strip image of
+ * one screen width of blank space followed by the text, and the
+ * screen shows a window into that strip, wrapping around.
+ * The window position is computed from the time since the start,
+ * not by counting steps, so the speed stays exact even if sending
+ * a frame takes longer than a pixel step: we just skip pixels then.
+ */
+
+#include "dclmd_internal.h"
+#include "dclm_font.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/****************************************************************************
+ * INTERNAL: TIMING                                                         *
+ ****************************************************************************/
+
+/* pixels scrolled from the start until now */
+static uint64_t
+scroll_pos_at(const DCLMDContext *dc, const struct timespec *now)
+{
+	uint64_t sec;
+	uint64_t nsec;
+
+	if (dclmdCompareTime(now, &dc->scroll_start) <= 0) {
+		return 0;
+	}
+	sec = (uint64_t)(now->tv_sec - dc->scroll_start.tv_sec);
+	if (now->tv_nsec >= dc->scroll_start.tv_nsec) {
+		nsec = (uint64_t)(now->tv_nsec - dc->scroll_start.tv_nsec);
+	} else {
+		sec--;
+		nsec = (uint64_t)(now->tv_nsec + (long)NSEC_PER_SEC - dc->scroll_start.tv_nsec);
+	}
+	return sec * dc->scroll_pps + (nsec * dc->scroll_pps) / NSEC_PER_SEC;
+}
+
+/* the point in time where pos is reached */
+static void
+scroll_time_of(const DCLMDContext *dc, uint64_t pos, struct timespec *ts)
+{
+	uint64_t sec = pos / dc->scroll_pps;
+	uint64_t nsec = ((pos % dc->scroll_pps) * NSEC_PER_SEC + dc->scroll_pps - 1) / dc->scroll_pps;
+
+	ts->tv_sec = dc->scroll_start.tv_sec + (time_t)sec;
+	ts->tv_nsec = dc->scroll_start.tv_nsec + (long)nsec;
+	if (ts->tv_nsec >= (long)NSEC_PER_SEC) {
+		ts->tv_sec++;
+		ts->tv_nsec -= (long)NSEC_PER_SEC;
+	}
+}
+
+/****************************************************************************
+ * INTERNAL: RENDERING                                                      *
+ ****************************************************************************/
+
+static void
+scroll_draw(DCLMDContext *dc)
+{
+	const DCLMImage *img = dc->scroll_img;
+	size_t width = img->dims[0];
+	size_t x = (size_t)(dc->scroll_pos % width);
+
+	if (dc->scroll_dir == DCLMD_SCROLL_RIGHT && x) {
+		x = width - x;
+	}
+	dclmScrFromImgBlit(dc->scr, img, x, 0, 0, 0,
+			   dclmGetInt(dc->dclm, DCLM_PARAM_COLUMNS), dclmGetInt(dc->dclm, DCLM_PARAM_ROWS));
+}
+
+/****************************************************************************
+ * MARQUEE                                                                  *
+ ****************************************************************************/
+
+extern int
+dctxScrollStart(DCLMDContext *dc, const char *text, unsigned int pps, int dir, unsigned int loops)
+{
+	size_t cols = (size_t)dclmGetInt(dc->dclm, DCLM_PARAM_COLUMNS);
+
+	dctxScrollStop(dc);
+
+	dc->scroll_img = dclmImageCreate(cols + dclmStringWidth(text, 0), (size_t)dclmGetInt(dc->dclm, DCLM_PARAM_ROWS), NULL);
+	if (!dc->scroll_img) {
+		return -1;
+	}
+	dclmImageClear(dc->scroll_img);
+	dclmStringToImg(dc->scroll_img, (int)cols, text, 0, dclmFontBase);
+
+	if (pps > DCLMD_SCROLL_MAX_PPS) {
+		pps = DCLMD_SCROLL_MAX_PPS;
+	}
+	dc->scroll_pps = pps;
+	dc->scroll_dir = dir;
+	dc->scroll_loops = loops;
+	dc->scroll_pos = 0;
+	dc->scroll_start = dc->loop_time;
+	scroll_time_of(dc, 1, &dc->scroll_next);
+	scroll_draw(dc);
+	return 0;
+}
+
+extern void
+dctxScrollStop(DCLMDContext *dc)
+{
+	dclmImageDestroy(dc->scroll_img);
+	dc->scroll_img = NULL;
+}
+
+extern int
+dctxScrollUpdate(DCLMDContext *dc)
+{
+	uint64_t pos;
+
+	if (!dc->scroll_img || dclmdCompareTime(&dc->loop_time, &dc->scroll_next) < 0) {
+		return 0;
+	}
+
+	pos = scroll_pos_at(dc, &dc->loop_time);
+	if (dc->scroll_loops && pos >= (uint64_t)dc->scroll_loops * dc->scroll_img->dims[0]) {
+		dclmdDebug("marquee: done after %u loops", dc->scroll_loops);
+		dctxScrollStop(dc);
+		dclmScrClear(dc->scr, 0);
+		return 1;
+	}
+	if (pos == dc->scroll_pos) {
+		/* woken up early */
+		scroll_time_of(dc, pos + 1, &dc->scroll_next);
+		return 0;
+	}
+
+	dc->scroll_pos = pos;
+	scroll_time_of(dc, pos + 1, &dc->scroll_next);
+	scroll_draw(dc);
+	return 1;
+}
+
+extern int
+dctxScrollNext(const DCLMDContext *dc, struct timespec *ts)
+{
+	if (!dc->scroll_img) {
+		return 0;
+	}
+	*ts = dc->scroll_next;
+	return 1;
+}
+
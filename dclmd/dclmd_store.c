@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The frame store: screens rendered once and kept in their packed
+ * form, so that showing one is just a copy of its data.
+ */
+
+#include "dclmd_internal.h"
+
+#include <string.h>
+
+/****************************************************************************
+ * INTERNAL                                                                 *
+ ****************************************************************************/
+
+static int
+store_find(const DCLMDContext *dc, unsigned int id, const char *name)
+{
+	int i;
+
+	for (i = 0; i < DCLMD_STORE_MAX_ITEMS; i++) {
+		const DCLMDStoreItem *item = &dc->store[i];
+		if (item->used && item->id == id && !strcmp(item->name, name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/****************************************************************************
+ * FRAME STORE                                                              *
+ ****************************************************************************/
+
+extern void
+dctxStoreInit(DCLMDContext *dc)
+{
+	int i;
+
+	for (i = 0; i < DCLMD_STORE_MAX_ITEMS; i++) {
+		dc->store[i].used = 0;
+	}
+}
+
+extern int
+dctxStorePut(DCLMDContext *dc, unsigned int id, const char *name, const DCLEDMatrixScreen *scr)
+{
+	DCLMDStoreItem *item;
+	int i = store_find(dc, id, name);
+
+	if (i < 0) {
+		for (i = 0; i < DCLMD_STORE_MAX_ITEMS; i++) {
+			if (!dc->store[i].used) {
+				break;
+			}
+		}
+		if (i >= DCLMD_STORE_MAX_ITEMS) {
+			return -1;
+		}
+	}
+
+	item = &dc->store[i];
+	item->used = 1;
+	item->id = id;
+	strncpy(item->name, name, DCLMD_STORE_NAME_LEN);
+	item->name[DCLMD_STORE_NAME_LEN] = 0;
+	dclmScrGetData(scr, item->data);
+	return 0;
+}
+
+extern const uint8_t *
+dctxStoreGet(const DCLMDContext *dc, unsigned int id, const char *name)
+{
+	int i = store_find(dc, id, name);
+
+	return (i < 0)?NULL:dc->store[i].data;
+}
+
+extern void
+dctxStoreDrop(DCLMDContext *dc, unsigned int id, const char *name)
+{
+	int i = store_find(dc, id, name);
+
+	if (i >= 0) {
+		dc->store[i].used = 0;
+	}
+}
+
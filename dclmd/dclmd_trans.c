@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Transitions between screens. When the content changes, all frames
+ * of the transition are computed at once by dclmScrTransition()
+ * and kept until they are due, so the main loop only has to send
+ * a ready screen for every frame.
+ */
+
+#include "dclmd_internal.h"
+
+/****************************************************************************
+ * INTERNAL: TIMING                                                         *
+ ****************************************************************************/
+
+/* frame k is shown from (k-1)/count of the duration on,
+ * the last frame is the new screen itself */
+static void
+trans_time_of(const DCLMDContext *dc, unsigned int frame, struct timespec *ts)
+{
+	unsigned int ms = (frame - 1) * dc->trans_ms / dc->trans_count;
+
+	dclmdCalcWaitTimeMS(ts, &dc->trans_start, ms);
+}
+
+/****************************************************************************
+ * TRANSITIONS                                                              *
+ ****************************************************************************/
+
+extern void
+dctxTransInit(DCLMDContext *dc)
+{
+	unsigned int i;
+
+	dc->trans_effect = DCLM_TRANS_CUT;
+	dc->trans_ms = 0;
+	dc->trans_from = NULL;
+	for (i = 0; i < DCLMD_TRANS_MAX_FRAMES; i++) {
+		dc->trans_frames[i] = NULL;
+	}
+	dc->trans_count = 0;
+	dc->trans_frame = 0;
+}
+
+extern void
+dctxTransCleanup(DCLMDContext *dc)
+{
+	unsigned int i;
+
+	dclmScrDestroy(dc->trans_from);
+	for (i = 0; i < DCLMD_TRANS_MAX_FRAMES; i++) {
+		dclmScrDestroy(dc->trans_frames[i]);
+	}
+	dctxTransInit(dc);
+}
+
+extern int
+dctxTransSet(DCLMDContext *dc, int effect, unsigned int duration_ms)
+{
+	if (effect < DCLM_TRANS_CUT || effect >= DCLM_TRANS_COUNT) {
+		return -1;
+	}
+	if (!duration_ms) {
+		effect = DCLM_TRANS_CUT;
+	}
+	dc->trans_effect = effect;
+	dc->trans_ms = duration_ms;
+	return 0;
+}
+
+extern void
+dctxTransSnapshot(DCLMDContext *dc, const DCLEDMatrixScreen *shown)
+{
+	if (dc->trans_effect == DCLM_TRANS_CUT) {
+		return;
+	}
+	if (!dc->trans_from) {
+		dc->trans_from = dclmScrCreate(dc->dclm);
+		if (!dc->trans_from) {
+			return;
+		}
+	}
+	dclmScrCopy(dc->trans_from, shown);
+}
+
+extern int
+dctxTransStart(DCLMDContext *dc, const DCLEDMatrixScreen *to)
+{
+	unsigned int count, i;
+
+	dc->trans_count = 0;
+	if (dc->trans_effect == DCLM_TRANS_CUT) {
+		return 0;
+	}
+	if (!dc->trans_from) {
+		return -1;
+	}
+
+	count = dc->trans_ms / DCLMD_TRANS_FRAME_MS;
+	if (count < 2) {
+		count = 2;
+	} else if (count > DCLMD_TRANS_MAX_FRAMES) {
+		count = DCLMD_TRANS_MAX_FRAMES;
+	}
+
+	/* frames 1 ... count-1, frame count is the new screen */
+	for (i = 1; i < count; i++) {
+		if (!dc->trans_frames[i]) {
+			dc->trans_frames[i] = dclmScrCreate(dc->dclm);
+			if (!dc->trans_frames[i]) {
+				return -1;
+			}
+		}
+		dclmScrTransition(dc->trans_frames[i], dc->trans_from, to, dc->trans_effect, i, count);
+	}
+
+	dc->trans_count = count;
+	dc->trans_frame = 1;
+	dc->trans_start = dc->loop_time;
+	trans_time_of(dc, 2, &dc->trans_next);
+	return 0;
+}
+
+extern int
+dctxTransUpdate(DCLMDContext *dc)
+{
+	unsigned int frame;
+
+	if (!dc->trans_count || dclmdCompareTime(&dc->loop_time, &dc->trans_next) < 0) {
+		return 0;
+	}
+
+	/* skip frames we are too late for */
+	frame = dc->trans_frame + 1;
+	while (frame < dc->trans_count) {
+		trans_time_of(dc, frame + 1, &dc->trans_next);
+		if (dclmdCompareTime(&dc->loop_time, &dc->trans_next) < 0) {
+			break;
+		}
+		frame++;
+	}
+
+	if (frame >= dc->trans_count) {
+		dc->trans_count = 0;
+	} else {
+		dc->trans_frame = frame;
+	}
+	return 1;
+}
+
+extern int
+dctxTransNext(const DCLMDContext *dc, struct timespec *ts)
+{
+	if (!dc->trans_count) {
+		return 0;
+	}
+	*ts = dc->trans_next;
+	return 1;
+}
+
+extern DCLEDMatrixScreen *
+dctxTransScreen(const DCLMDContext *dc)
+{
+	if (!dc->trans_count) {
+		return NULL;
+	}
+	return dc->trans_frames[dc->trans_frame];
+}
+
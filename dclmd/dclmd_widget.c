@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Widgets: small pieces of dynamic content (text, clock, counter, bar,
+ * sparkline, icon) in fixed regions of the screen. Each widget is drawn
+ * into an image of the size of its region, and that image is blitted
+ * into its region of the widget screen only when what it shows changed.
+ * The widget screen is composed on top of the layers, see dclmd_layer.c.
+ */
+
+#include "dclmd_internal.h"
+#include "dclm_font.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/****************************************************************************
+ * INTERNAL                                                                 *
+ ****************************************************************************/
+
+static int
+widget_find(const DCLMDContext *dc, unsigned int id)
+{
+	unsigned int i;
+
+	for (i = 0; i < dc->widget_count; i++) {
+		if (dc->widgets[i].id == id) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+static int
+widget_is_timed(const DCLMDWidget *w)
+{
+	return (w->type == DCLMD_WIDGET_CLOCK);
+}
+
+/* the mask of all widget regions, see dctxLayerSet() */
+static int
+widget_update_mask(DCLMDContext *dc)
+{
+	DCLEDMatrixScreen *scr = dclmScrCreate(dc->dclm);
+	uint64_t blank[DCLMD_LAYER_WORDS];
+	unsigned int i;
+
+	if (!scr) {
+		return -1;
+	}
+	dclmScrClear(scr, 0);
+	dclmScrGetData(scr, (uint8_t*)blank);
+	for (i = 0; i < dc->widget_count; i++) {
+		const DCLMDWidget *w = &dc->widgets[i];
+		dclmScrFillRect(scr, w->x, w->y, (int)w->img->dims[0], (int)w->img->dims[1], 1);
+	}
+	dclmScrGetData(scr, (uint8_t*)dc->widget_mask);
+	dclmScrDestroy(scr);
+
+	for (i = 0; i < DCLMD_LAYER_WORDS; i++) {
+		dc->widget_mask[i] ^= blank[i];
+	}
+	dc->layer_dirty = 1;
+	return 0;
+}
+
+/* format the time a clock widget shows into buf */
+static void
+widget_format_time(const DCLMDContext *dc, const DCLMDWidget *w, char *buf, size_t size)
+{
+	unsigned int s;
+
+	if (w->flags & DCLMD_WIDGET_ELAPSED) {
+		s = (unsigned int)(dc->loop_time.tv_sec - w->start.tv_sec);
+		if (dc->loop_time.tv_nsec < w->start.tv_nsec) {
+			s--;
+		}
+		if (s >= 3600) {
+			snprintf(buf, size, "%u:%02u:%02u", s / 3600, (s / 60) % 60, s % 60);
+		} else {
+			snprintf(buf, size, "%u:%02u", s / 60, s % 60);
+		}
+	} else {
+		struct tm tm;
+		time_t now = time(NULL);
+
+		localtime_r(&now, &tm);
+		if (w->flags & DCLMD_WIDGET_SECONDS) {
+			snprintf(buf, size, "%02d:%02d:%02d", tm.tm_hour, tm.tm_min, tm.tm_sec);
+		} else {
+			snprintf(buf, size, "%02d:%02d", tm.tm_hour, tm.tm_min);
+		}
+	}
+}
+
+/* copy the top left part of icon into the image of the widget */
+static void
+widget_copy_icon(DCLMDWidget *w, const DCLMImage *icon)
+{
+	size_t width = (icon->dims[0] < w->img->dims[0])?icon->dims[0]:w->img->dims[0];
+	size_t y;
+
+	dclmImageClear(w->img);
+	for (y = 0; y < icon->dims[1] && y < w->img->dims[1]; y++) {
+		memcpy(DCLM_IMG_PIXEL(w->img, 0, y), DCLM_IMG_PIXEL(icon, 0, y), width);
+	}
+}
+
+/* the value clamped to 0 .. max, scaled to 0 .. range */
+static int
+widget_scale(const DCLMDWidget *w, int value, int range)
+{
+	int max = (w->max > 0)?w->max:100;
+
+	if (value <= 0) {
+		return 0;
+	}
+	if (value >= max) {
+		return range;
+	}
+	return (int)(((long)value * range + max/2) / max);
+}
+
+/* draw the widget into its image and blit it into the widget screen */
+static void
+widget_render(DCLMDContext *dc, DCLMDWidget *w)
+{
+	DCLMImage *img = w->img;
+	int width = (int)img->dims[0];
+	int height = (int)img->dims[1];
+	int x, y, n;
+	unsigned int i;
+
+	switch (w->type) {
+		case DCLMD_WIDGET_TEXT:
+		case DCLMD_WIDGET_CLOCK:
+		case DCLMD_WIDGET_COUNTER:
+			dclmImageClear(img);
+			x = 0;
+			if (w->flags & DCLMD_WIDGET_ALIGN_RIGHT) {
+				x = width - (int)dclmStringWidth(w->text, 0);
+			}
+			if (w->text[0]) {
+				dclmStringToImg(img, x, w->text, 0, dclmFontBase);
+			}
+			break;
+		case DCLMD_WIDGET_BAR:
+			dclmImageClear(img);
+			if (w->flags & DCLMD_WIDGET_VERTICAL) {
+				n = widget_scale(w, w->value, height);
+				for (y = height - n; y < height; y++) {
+					memset(DCLM_IMG_PIXEL(img, 0, y), 0xff, (size_t)width);
+				}
+			} else {
+				n = widget_scale(w, w->value, width);
+				for (y = 0; y < height; y++) {
+					memset(DCLM_IMG_PIXEL(img, 0, y), 0xff, (size_t)n);
+				}
+			}
+			break;
+		case DCLMD_WIDGET_SPARKLINE:
+			dclmImageClear(img);
+			/* the newest sample in the rightmost column */
+			for (i = 0; i < w->hist_count && (int)i < width; i++) {
+				x = width - 1 - (int)i;
+				n = widget_scale(w, w->hist[(w->hist_pos + DCLMD_WIDGET_HISTORY - 1 - i) % DCLMD_WIDGET_HISTORY], height);
+				for (y = height - n; y < height; y++) {
+					dclmImageSetPixel(img, (size_t)x, (size_t)y, 0xff);
+				}
+			}
+			break;
+		default:
+			/* DCLMD_WIDGET_ICON: the image is all there is */
+			break;
+	}
+
+	dclmScrFromImgBlit(dc->widget_scr, img, 0, 0, w->x, w->y, width, height);
+	dc->layer_dirty = 1;
+}
+
+/* apply a new value or text
+ * RETURN 1: the widget needs to be drawn again
+ *        0: nothing changed
+ */
+static int
+widget_set_value(DCLMDContext *dc, DCLMDWidget *w, int value, const char *text)
+{
+	char buf[DCLMD_WIDGET_TEXT_LEN+1];
+	int n;
+
+	switch (w->type) {
+		case DCLMD_WIDGET_TEXT:
+			if (!strncmp(w->text, text, DCLMD_WIDGET_TEXT_LEN)) {
+				return 0;
+			}
+			strncpy(w->text, text, DCLMD_WIDGET_TEXT_LEN);
+			w->text[DCLMD_WIDGET_TEXT_LEN] = 0;
+			return 1;
+		case DCLMD_WIDGET_COUNTER:
+			snprintf(buf, sizeof(buf), "%d", value);
+			if (!strcmp(w->text, buf)) {
+				return 0;
+			}
+			strcpy(w->text, buf);
+			return 1;
+		case DCLMD_WIDGET_BAR:
+			/* only a change of the length of the bar counts */
+			n = widget_scale(w, value, (int)w->img->dims[(w->flags & DCLMD_WIDGET_VERTICAL)?1:0]);
+			w->value = value;
+			if (n == w->scaled) {
+				return 0;
+			}
+			w->scaled = n;
+			return 1;
+		case DCLMD_WIDGET_SPARKLINE:
+			w->hist[w->hist_pos] = value;
+			w->hist_pos = (w->hist_pos + 1) % DCLMD_WIDGET_HISTORY;
+			if (w->hist_count < DCLMD_WIDGET_HISTORY) {
+				w->hist_count++;
+			}
+			return 1;
+		case DCLMD_WIDGET_CLOCK:
+			/* value: the seconds already elapsed */
+			w->start = dc->loop_time;
+			w->start.tv_sec -= (value > 0)?value:0;
+			widget_format_time(dc, w, w->text, sizeof(w->text));
+			return 1;
+		default:
+			break;
+	}
+	return 0;
+}
+
+/****************************************************************************
+ * WIDGETS                                                                  *
+ ****************************************************************************/
+
+extern void
+dctxWidgetInit(DCLMDContext *dc)
+{
+	dc->widget_count = 0;
+	dc->widget_scr = NULL;
+	memset(dc->widget_mask, 0, sizeof(dc->widget_mask));
+}
+
+extern void
+dctxWidgetCleanup(DCLMDContext *dc)
+{
+	unsigned int i;
+
+	for (i = 0; i < dc->widget_count; i++) {
+		dclmImageDestroy(dc->widgets[i].img);
+	}
+	dclmScrDestroy(dc->widget_scr);
+	dctxWidgetInit(dc);
+}
+
+extern int
+dctxWidgetSet(DCLMDContext *dc, unsigned int id, int type, int x, int y, int w, int h,
+	      unsigned int flags, int value, int max, const char *text, const DCLMImage *icon)
+{
+	DCLMDWidget *widget;
+	int cols = dclmGetInt(dc->dclm, DCLM_PARAM_COLUMNS);
+	int rows = dclmGetInt(dc->dclm, DCLM_PARAM_ROWS);
+
+	if (type < 0 || type >= DCLMD_WIDGET_COUNT || w < 1 || h < 1) {
+		return -1;
+	}
+	if (type == DCLMD_WIDGET_ICON && !icon) {
+		return -1;
+	}
+	if (w > cols) {
+		w = cols;
+	}
+	if (h > rows) {
+		h = rows;
+	}
+	if (!dc->widget_scr) {
+		dc->widget_scr = dclmScrCreate(dc->dclm);
+		if (!dc->widget_scr) {
+			return -1;
+		}
+		dclmScrClear(dc->widget_scr, 0);
+	}
+
+	dctxWidgetRemove(dc, id);
+	if (dc->widget_count >= DCLMD_WIDGET_MAX_ITEMS) {
+		return -1;
+	}
+	widget = &dc->widgets[dc->widget_count];
+	widget->img = dclmImageCreate((size_t)w, (size_t)h, NULL);
+	if (!widget->img) {
+		return -1;
+	}
+	dc->widget_count++;
+
+	widget->id = id;
+	widget->type = type;
+	widget->x = x;
+	widget->y = y;
+	widget->flags = flags;
+	widget->value = 0;
+	widget->max = max;
+	widget->scaled = -1;
+	widget->text[0] = 0;
+	widget->hist_pos = 0;
+	widget->hist_count = 0;
+	if (type == DCLMD_WIDGET_ICON) {
+		widget_copy_icon(widget, icon);
+	}
+	widget_set_value(dc, widget, value, text);
+
+	if (widget_update_mask(dc)) {
+		dctxWidgetRemove(dc, id);
+		return -1;
+	}
+	widget_render(dc, widget);
+	return 0;
+}
+
+extern int
+dctxWidgetUpdate(DCLMDContext *dc, unsigned int id, int value, const char *text)
+{
+	int idx = widget_find(dc, id);
+
+	if (idx < 0) {
+		return -1;
+	}
+	if (widget_set_value(dc, &dc->widgets[idx], value, text)) {
+		widget_render(dc, &dc->widgets[idx]);
+	}
+	return 0;
+}
+
+extern void
+dctxWidgetRemove(DCLMDContext *dc, unsigned int id)
+{
+	unsigned int i = 0;
+	int removed = 0;
+
+	while (i < dc->widget_count) {
+		DCLMDWidget *w = &dc->widgets[i];
+		if (id == DCLMD_WIDGET_ID_ALL || w->id == id) {
+			dclmScrFillRect(dc->widget_scr, w->x, w->y, (int)w->img->dims[0], (int)w->img->dims[1], 0);
+			dclmImageDestroy(w->img);
+			memmove(w, w + 1, (dc->widget_count - i - 1) * sizeof(DCLMDWidget));
+			dc->widget_count--;
+			removed = 1;
+		} else {
+			i++;
+		}
+	}
+	if (removed) {
+		widget_update_mask(dc);
+	}
+}
+
+extern int
+dctxWidgetTick(DCLMDContext *dc)
+{
+	char buf[DCLMD_WIDGET_TEXT_LEN+1];
+	unsigned int i;
+	int changed = 0;
+
+	for (i = 0; i < dc->widget_count; i++) {
+		DCLMDWidget *w = &dc->widgets[i];
+		if (!widget_is_timed(w)) {
+			continue;
+		}
+		widget_format_time(dc, w, buf, sizeof(buf));
+		if (strcmp(buf, w->text)) {
+			strcpy(w->text, buf);
+			widget_render(dc, w);
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+extern int
+dctxWidgetNext(const DCLMDContext *dc, struct timespec *ts)
+{
+	struct timespec next, now;
+	struct tm tm;
+	unsigned int i, ms;
+	int found = 0;
+
+	for (i = 0; i < dc->widget_count; i++) {
+		const DCLMDWidget *w = &dc->widgets[i];
+		if (!widget_is_timed(w)) {
+			continue;
+		}
+		next = dc->loop_time;
+		if (w->flags & DCLMD_WIDGET_ELAPSED) {
+			/* the next full second after start */
+			next.tv_nsec = w->start.tv_nsec;
+			if (dclmdCompareTime(&next, &dc->loop_time) <= 0) {
+				next.tv_sec++;
+			}
+		} else {
+			/* the next full second, or without seconds shown the
+			 * next full minute, of the wall clock */
+			clock_gettime(CLOCK_REALTIME, &now);
+			ms = 1000 - (unsigned int)(now.tv_nsec / 1000000);
+			if (!(w->flags & DCLMD_WIDGET_SECONDS)) {
+				localtime_r(&now.tv_sec, &tm);
+				if (tm.tm_sec < 59) {
+					ms += (unsigned int)(59 - tm.tm_sec) * 1000;
+				}
+			}
+			dclmdCalcWaitTimeMS(&next, &dc->loop_time, ms);
+		}
+		if (!found || dclmdCompareTime(&next, ts) < 0) {
+			*ts = next;
+			found = 1;
+		}
+	}
+	return found;
+}
@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * NOTE: This will use the API from obs-studio, which is GPL2 or later.
+ */
+
+/* The audio meter filter: shows the levels of the source it is put on
+ * as two bars on the LED matrix. The audio thread only adds each buffer
+ * to per channel accumulators with atomic operations, it never waits.
+ * A meter thread takes the accumulated levels at a fixed rate, so there
+ * is one command to dclmd per displayed frame, no matter how many audio
+ * buffers came in between.
+ */
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "dclmd_comm.h"
+#include "dclm_dlist.h"
+#include "dclm-plugin.h"
+
+#define METER_COLS		21
+#define METER_ROWS		7
+#define METER_BAR_ROWS		3 /* rows per channel, with an empty row between */
+#define METER_CHANNELS		2
+#define METER_IDLE_MS		500 /* remove the layer if no audio came for that long */
+#define METER_SQ_SCALE		16777216.0f /* fixed point scale of the squares */
+
+/* the levels of a channel since the meter thread took them last */
+typedef struct {
+	uint32_t peak; /* bits of the (non-negative) float peak, ordered like the value */
+	uint64_t sq_sum; /* sum of the squared samples, times METER_SQ_SCALE */
+	uint32_t frames;
+} meter_acc_t;
+
+typedef struct {
+	obs_source_t *source;
+
+	/* written by the audio thread, taken by the meter thread */
+	meter_acc_t acc[METER_CHANNELS];
+
+	/* the settings, set by the UI thread */
+	unsigned int interval_ms;
+	unsigned int range_db;
+
+	/* only used by the meter thread */
+	dclm_layer_t layer;
+	int peak_col[METER_CHANNELS]; /* the falling peak markers */
+	int shown[METER_CHANNELS][2]; /* rms and peak columns in the layer */
+	unsigned int idle_ms;
+
+	pthread_t meter;
+	int run;
+	unsigned int flags;
+} meter_t;
+
+#define METER_FLAG_THREAD	0x1
+
+/****************************************************************************
+ * AUDIO THREAD                                                             *
+ ****************************************************************************/
+
+static void
+meter_add(meter_acc_t *acc, const float *samples, uint32_t frames)
+{
+	float peak = 0.0f;
+	float sq = 0.0f;
+	uint32_t i, bits, old;
+
+	for (i = 0; i < frames; i++) {
+		float s = samples[i];
+		sq += s*s;
+		s = fabsf(s);
+		if (s > peak) {
+			peak = s;
+		}
+	}
+
+	memcpy(&bits, &peak, sizeof(bits));
+	old = __atomic_load_n(&acc->peak, __ATOMIC_RELAXED);
+	while (bits > old && !__atomic_compare_exchange_n(&acc->peak, &old, bits, 1,
+							  __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		/* the meter thread just took it, try again */
+	}
+	__atomic_fetch_add(&acc->sq_sum, (uint64_t)(sq * METER_SQ_SCALE), __ATOMIC_RELAXED);
+	__atomic_fetch_add(&acc->frames, frames, __ATOMIC_RELEASE);
+}
+
+static struct obs_audio_data *
+meter_filter_audio(void *data, struct obs_audio_data *audio)
+{
+	meter_t *m = (meter_t*)data;
+	size_t channels = audio_output_get_channels(obs_get_audio());
+	unsigned int i;
+
+	for (i = 0; i < METER_CHANNELS; i++) {
+		/* mono sources show the same level twice */
+		size_t ch = (i < channels)?i:0;
+		if (audio->data[ch]) {
+			meter_add(&m->acc[i], (const float*)audio->data[ch], audio->frames);
+		}
+	}
+	return audio;
+}
+
+/****************************************************************************
+ * METER THREAD                                                             *
+ ****************************************************************************/
+
+/* the number of lit columns for an amplitude */
+static int
+meter_columns(float amplitude, unsigned int range_db)
+{
+	float db;
+	int cols;
+
+	if (amplitude <= 0.0f) {
+		return 0;
+	}
+	db = 20.0f * log10f(amplitude);
+	cols = (int)((db + (float)range_db) * METER_COLS / (float)range_db + 0.5f);
+	if (cols < 0) {
+		return 0;
+	}
+	return (cols > METER_COLS)?METER_COLS:cols;
+}
+
+/* take the levels accumulated since the last call
+ * RETURN: 0: no audio came in the meantime
+ *         1: cols has the rms and peak columns of each channel
+ */
+static int
+meter_take(meter_t *m, int cols[METER_CHANNELS][2])
+{
+	unsigned int range_db = __atomic_load_n(&m->range_db, __ATOMIC_RELAXED);
+	int got = 0;
+	unsigned int i;
+
+	memset(cols, 0, sizeof(int) * METER_CHANNELS * 2);
+	for (i = 0; i < METER_CHANNELS; i++) {
+		meter_acc_t *acc = &m->acc[i];
+		uint32_t frames = __atomic_exchange_n(&acc->frames, 0, __ATOMIC_ACQUIRE);
+		uint32_t bits = __atomic_exchange_n(&acc->peak, 0, __ATOMIC_RELAXED);
+		uint64_t sq_sum = __atomic_exchange_n(&acc->sq_sum, 0, __ATOMIC_RELAXED);
+		float peak, rms;
+
+		if (!frames) {
+			continue;
+		}
+		got = 1;
+		memcpy(&peak, &bits, sizeof(peak));
+		rms = sqrtf((float)sq_sum / METER_SQ_SCALE / (float)frames);
+		cols[i][0] = meter_columns(rms, range_db);
+		cols[i][1] = meter_columns(peak, range_db);
+	}
+	return got;
+}
+
+/* draw the bars into the layer, unless they are there already,
+ * and were set recently enough to keep the layer alive */
+static void
+meter_show(meter_t *m, int cols[METER_CHANNELS][2])
+{
+	DCLMDisplayList dl;
+	uint8_t buf[64];
+	unsigned int i;
+	int y;
+	uint64_t now = os_gettime_ns();
+
+	if (!dclm_layer_due(&m->layer, memcmp(m->shown, cols, sizeof(m->shown)), now)) {
+		return;
+	}
+
+	dclmDListInit(&dl, buf, sizeof(buf));
+	dclmDListClear(&dl, 0);
+	for (i = 0; i < METER_CHANNELS; i++) {
+		y = (int)i * (METER_BAR_ROWS + 1);
+		if (cols[i][0] > 0) {
+			dclmDListRect(&dl, 0, y, cols[i][0], METER_BAR_ROWS, 1);
+		}
+		if (cols[i][1] > cols[i][0]) {
+			dclmDListRect(&dl, cols[i][1] - 1, y, 1, METER_BAR_ROWS, 1);
+		}
+	}
+	if (!dclm_layer_set(&m->layer, METER_COLS, METER_ROWS, &dl, NULL, now)) {
+		memcpy(m->shown, cols, sizeof(m->shown));
+	}
+}
+
+/* one displayed frame of the meter */
+static void
+meter_tick(meter_t *m, unsigned int interval_ms)
+{
+	int cols[METER_CHANNELS][2];
+	unsigned int i;
+
+	if (!meter_take(m, cols)) {
+		m->idle_ms += interval_ms;
+		if (m->idle_ms >= METER_IDLE_MS) {
+			/* the source does not play any more */
+			dclm_layer_hide(&m->layer);
+			m->idle_ms = METER_IDLE_MS;
+		}
+		return;
+	}
+	m->idle_ms = 0;
+
+	/* the peak marker falls by one column per frame */
+	for (i = 0; i < METER_CHANNELS; i++) {
+		if (cols[i][1] < m->peak_col[i] - 1) {
+			cols[i][1] = m->peak_col[i] - 1;
+		}
+		m->peak_col[i] = cols[i][1];
+	}
+	meter_show(m, cols);
+}
+
+static void *
+meter_thread(void *v_meter)
+{
+	meter_t *m = (meter_t*)v_meter;
+	struct timespec prev, next;
+	unsigned int interval_ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (__atomic_load_n(&m->run, __ATOMIC_ACQUIRE)) {
+		interval_ms = __atomic_load_n(&m->interval_ms, __ATOMIC_RELAXED);
+		prev = next;
+		dclmdCalcWaitTimeMS(&next, &prev, interval_ms);
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)) {
+			/* interrupted, or the next frame is due already */
+			clock_gettime(CLOCK_MONOTONIC, &next);
+		}
+		meter_tick(m, interval_ms);
+	}
+
+	dclm_layer_close(&m->layer);
+	return NULL;
+}
+
+/****************************************************************************
+ * THE FILTER                                                               *
+ ****************************************************************************/
+
+static const char *
+meter_get_name(void *type_data)
+{
+	(void)type_data;
+	return "DCLEDMatrix Audio Meter";
+}
+
+static void
+meter_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "fps", 25);
+	obs_data_set_default_int(settings, "range", 60);
+}
+
+static obs_properties_t *
+meter_properties(void *data)
+{
+	obs_properties_t *props = obs_properties_create();
+
+	(void)data;
+	obs_properties_add_int(props, "fps", "Frame rate", 5, 60, 1);
+	obs_properties_add_int(props, "range", "Range (dB)", 12, 96, 1);
+	return props;
+}
+
+static void
+meter_update(void *data, obs_data_t *settings)
+{
+	meter_t *m = (meter_t*)data;
+	long long fps = obs_data_get_int(settings, "fps");
+	long long range = obs_data_get_int(settings, "range");
+
+	if (fps < 5) {
+		fps = 5;
+	} else if (fps > 60) {
+		fps = 60;
+	}
+	if (range < 12) {
+		range = 12;
+	} else if (range > 96) {
+		range = 96;
+	}
+	__atomic_store_n(&m->interval_ms, (unsigned int)(1000 / fps), __ATOMIC_RELAXED);
+	__atomic_store_n(&m->range_db, (unsigned int)range, __ATOMIC_RELAXED);
+}
+
+static void
+meter_destroy(void *data)
+{
+	meter_t *m = (meter_t*)data;
+
+	if (!m) {
+		return;
+	}
+	if (m->flags & METER_FLAG_THREAD) {
+		__atomic_store_n(&m->run, 0, __ATOMIC_RELEASE);
+		pthread_join(m->meter, NULL);
+	}
+	free(m);
+}
+
+static void *
+meter_create(obs_data_t *settings, obs_source_t *source)
+{
+	meter_t *m = malloc(sizeof(*m));
+
+	if (!m) {
+		blog(LOG_WARNING,"dcledmatrix malloc failed");
+		return NULL;
+	}
+	memset(m->acc, 0, sizeof(m->acc));
+	memset(m->peak_col, 0, sizeof(m->peak_col));
+	m->source = source;
+	dclm_layer_init(&m->layer, DCLM_OBS_LAYER_AUDIO, DCLM_OBS_Z_AUDIO);
+	m->idle_ms = METER_IDLE_MS;
+	m->run = 1;
+	m->flags = 0;
+	meter_update(m, settings);
+
+	if (pthread_create(&m->meter, NULL, meter_thread, m)) {
+		blog(LOG_WARNING,"dcledmatrix failed to create meter thread");
+		meter_destroy(m);
+		return NULL;
+	}
+	m->flags |= METER_FLAG_THREAD;
+	return m;
+}
+
+static struct obs_source_info meter_filter_info = {
+	.id = "dclm_audio_meter_filter",
+	.type = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.get_name = meter_get_name,
+	.create = meter_create,
+	.destroy = meter_destroy,
+	.get_defaults = meter_defaults,
+	.get_properties = meter_properties,
+	.update = meter_update,
+	.filter_audio = meter_filter_audio
+};
+
+extern void
+dclm_audio_register(void)
+{
+	obs_register_source(&meter_filter_info);
+}
+
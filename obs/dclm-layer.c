@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * NOTE: This will use the API from obs-studio, which is GPL2 or later.
+ */
+
+/* The connection to dclmd of the plugin's threads, and the layers the
+ * filters show their output in: each filter thread owns one layer with
+ * its own connection, reconnecting whenever the daemon comes back.
+ */
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include "dclm-plugin.h"
+
+/****************************************************************************
+ * CONNECTION                                                               *
+ ****************************************************************************/
+
+extern int
+dclm_comm_check_error(DCLMDComminucation **comm, DCLEDMatrixError err)
+{
+	if (err == DCLMD_COMMUNICATION_ERROR) {
+		/* the daemon went away, reconnect later */
+		dclmdCommunicationDestroy(*comm);
+		*comm = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+/****************************************************************************
+ * LAYERS                                                                   *
+ ****************************************************************************/
+
+extern void
+dclm_layer_init(dclm_layer_t *l, unsigned int id, int z)
+{
+	l->comm = NULL;
+	l->id = id;
+	l->z = z;
+	l->shown_valid = 0;
+	l->shown_ns = 0;
+}
+
+extern DCLMDComminucation *
+dclm_layer_get_comm(dclm_layer_t *l)
+{
+	if (!l->comm) {
+		l->comm = dclmdCommunicationClientCreate();
+		l->shown_valid = 0;
+		/* not supported by old daemons, never mind */
+		dclmdClientSetLayerTTL(l->comm, DCLM_OBS_LAYER_TTL_MS);
+	}
+	return l->comm;
+}
+
+extern int
+dclm_layer_due(const dclm_layer_t *l, int changed, uint64_t now)
+{
+	return !l->shown_valid || changed || now - l->shown_ns >= DCLM_OBS_LAYER_KEEP_NS;
+}
+
+extern int
+dclm_layer_set(dclm_layer_t *l, int w, int h, const DCLMDisplayList *dl, const DCLMImage *img, uint64_t now)
+{
+	DCLMDComminucation *comm = dclm_layer_get_comm(l);
+	DCLEDMatrixError err;
+
+	if (!comm) {
+		return -1;
+	}
+	err = dclmdClientSetLayer(comm, l->id, l->z, 0, 0, w, h, DCLMD_LAYER_OPAQUE, dl, img);
+	if (err == DCLMD_NOT_SUPPORTED) {
+		/* old daemon without layers */
+		err = dclmdClientShowDList(comm, dl, img, 0, 0);
+		if (err == DCLMD_NOT_SUPPORTED && img) {
+			/* ... and without display lists */
+			err = dclmdClientShowImage(comm, img, 0, 0, 0, 0);
+		}
+	}
+	if (err != DCLM_OK) {
+		l->shown_valid = 0;
+		dclm_comm_check_error(&l->comm, err);
+		return -1;
+	}
+	l->shown_valid = 1;
+	l->shown_ns = now;
+	return 0;
+}
+
+extern void
+dclm_layer_hide(dclm_layer_t *l)
+{
+	DCLEDMatrixError err;
+
+	if (l->comm && l->shown_valid) {
+		err = dclmdClientRemoveLayer(l->comm, l->id);
+		dclm_comm_check_error(&l->comm, err);
+	}
+	l->shown_valid = 0;
+}
+
+extern void
+dclm_layer_close(dclm_layer_t *l)
+{
+	dclm_layer_hide(l);
+	dclmdCommunicationDestroy(l->comm);
+	l->comm = NULL;
+}
+
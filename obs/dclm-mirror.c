@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * NOTE: This will use the API from obs-studio, which is GPL2 or later.
+ */
+
+/* The mirror source: shows what the LED matrix currently shows, as a
+ * grid of round dots. The daemon publishes the screen in the shm
+ * whenever it changes, so every tick only compares a sequence number,
+ * and the texture is only uploaded again if it changed. Tick and render
+ * both run on the graphics thread, only the settings come from the UI.
+ * Connecting can wait for other clients, so a connector thread does it
+ * and hands the connection over to the graphics thread, which hands it
+ * back when the daemon is gone.
+ */
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <time.h>
+
+#include "dclmd_comm.h"
+#include "dclm-plugin.h"
+
+#define MIRROR_COLS		21
+#define MIRROR_ROWS		7
+#define MIRROR_CELL_MIN		4
+#define MIRROR_CELL_MAX		32
+#define MIRROR_CONNECT_MS	1000 /* retry to connect to dclmd that often */
+#define MIRROR_CHECK_NS		1000000000ull /* check that often if dclmd is still there */
+
+typedef struct {
+	obs_source_t *source;
+
+	/* the settings, set by the UI thread */
+	unsigned int cell; /* pixels per LED */
+	uint32_t color_on; /* 0xAABBGGRR, as obs stores colors */
+	uint32_t color_off;
+	unsigned int settings_gen; /* incremented on every change */
+
+	/* only used by the graphics thread */
+	unsigned int applied_gen;
+	unsigned int width, height;
+	uint32_t *pixels; /* width x height */
+	uint32_t *dots; /* the lit and the unlit dot, cell x cell each */
+	unsigned int dirty; /* pixels not uploaded yet */
+	gs_texture_t *tex;
+	unsigned int tex_w, tex_h;
+
+	DCLMDComminucation *comm;
+	uint64_t check_ns; /* time of the next check for a daemon restart */
+	unsigned int seq; /* of the screen in img */
+	DCLMImage *img;
+
+	/* handed over between the threads with atomic exchanges */
+	DCLMDComminucation *connected; /* new connection for the graphics thread */
+	DCLMDComminucation *gone; /* connection to a gone daemon, for the connector */
+
+	/* the connector thread */
+	unsigned int flags;
+	int exit; /* the connector thread must exit */
+	sem_t wakeup;
+	pthread_t connector;
+} mirror_t;
+
+#define MIRROR_FLAG_WAKEUP_SEM	0x1
+#define MIRROR_FLAG_CONNECTOR	0x2
+
+/****************************************************************************
+ * DRAWING THE DOTS                                                         *
+ ****************************************************************************/
+
+/* one dot of the given color on a transparent background, with
+ * antialiased borders */
+static void
+mirror_make_dot(uint32_t *dot, unsigned int cell, uint32_t color)
+{
+	float center = 0.5f * (float)cell;
+	float radius = 0.4f * (float)cell;
+	float alpha = (float)(color >> 24);
+	float dx, dy, cov;
+	unsigned int x, y;
+
+	for (y = 0; y < cell; y++) {
+		dy = (float)y + 0.5f - center;
+		for (x = 0; x < cell; x++) {
+			dx = (float)x + 0.5f - center;
+			cov = radius + 0.5f - sqrtf(dx*dx + dy*dy);
+			if (cov < 0.0f) {
+				cov = 0.0f;
+			} else if (cov > 1.0f) {
+				cov = 1.0f;
+			}
+			dot[y*cell + x] = (color & 0xffffffu) | ((uint32_t)(cov * alpha + 0.5f) << 24);
+		}
+	}
+}
+
+/* draw the whole matrix from m->img */
+static void
+mirror_draw(mirror_t *m)
+{
+	unsigned int cell = m->width / MIRROR_COLS;
+	const uint32_t *dot;
+	uint32_t *row;
+	unsigned int x, y, i;
+
+	for (y = 0; y < MIRROR_ROWS; y++) {
+		row = m->pixels + y * cell * m->width;
+		for (x = 0; x < MIRROR_COLS; x++) {
+			dot = m->dots + ((*DCLM_IMG_PIXEL(m->img, x, y))?0:cell*cell);
+			for (i = 0; i < cell; i++) {
+				memcpy(row + i*m->width + x*cell, dot + i*cell, cell * sizeof(*dot));
+			}
+		}
+	}
+	m->dirty = 1;
+}
+
+/* take over changed settings, and reallocate the buffers if needed
+ * RETURN: 0 if m->pixels can be used
+ */
+static int
+mirror_apply_settings(mirror_t *m)
+{
+	unsigned int gen = __atomic_load_n(&m->settings_gen, __ATOMIC_ACQUIRE);
+	unsigned int cell;
+
+	if (gen == m->applied_gen && m->pixels) {
+		return 0;
+	}
+	m->applied_gen = gen;
+	cell = __atomic_load_n(&m->cell, __ATOMIC_RELAXED);
+	if (cell != m->width / MIRROR_COLS || !m->pixels) {
+		free(m->pixels);
+		free(m->dots);
+		m->width = MIRROR_COLS * cell;
+		m->height = MIRROR_ROWS * cell;
+		m->pixels = malloc(m->width * m->height * sizeof(*m->pixels));
+		m->dots = malloc(2 * cell * cell * sizeof(*m->dots));
+		if (!m->pixels || !m->dots) {
+			blog(LOG_WARNING,"dcledmatrix malloc failed");
+			free(m->pixels);
+			free(m->dots);
+			m->pixels = NULL;
+			m->dots = NULL;
+			return -1;
+		}
+	}
+	mirror_make_dot(m->dots, cell, __atomic_load_n(&m->color_on, __ATOMIC_RELAXED));
+	mirror_make_dot(m->dots + cell*cell, cell, __atomic_load_n(&m->color_off, __ATOMIC_RELAXED));
+	mirror_draw(m);
+	return 0;
+}
+
+/****************************************************************************
+ * THE CONNECTOR THREAD                                                     *
+ ****************************************************************************/
+
+/* connects to the daemon, whenever it is there and the graphics
+ * thread has no connection, and closes the connections handed back */
+static void *
+mirror_connector(void *data)
+{
+	mirror_t *m = (mirror_t*)data;
+	DCLMDComminucation *comm;
+	struct timespec until;
+	int connected = 0; /* the graphics thread has a connection */
+	int res;
+
+	while (!__atomic_load_n(&m->exit, __ATOMIC_ACQUIRE)) {
+		comm = __atomic_exchange_n(&m->gone, NULL, __ATOMIC_ACQUIRE);
+		if (comm) {
+			dclmdCommunicationDestroy(comm);
+			connected = 0;
+		}
+		if (!connected) {
+			comm = dclmdCommunicationClientCreate();
+			if (comm) {
+				__atomic_store_n(&m->connected, comm, __ATOMIC_RELEASE);
+				connected = 1;
+			}
+		}
+		if (connected) {
+			res = sem_wait(&m->wakeup);
+		} else {
+			clock_gettime(CLOCK_REALTIME, &until);
+			until.tv_sec += MIRROR_CONNECT_MS / 1000;
+			until.tv_nsec += (long)(MIRROR_CONNECT_MS % 1000) * 1000000L;
+			if (until.tv_nsec >= 1000000000L) {
+				until.tv_sec++;
+				until.tv_nsec -= 1000000000L;
+			}
+			res = sem_timedwait(&m->wakeup, &until);
+		}
+		if (res && errno != ETIMEDOUT && errno != EINTR) {
+			blog(LOG_WARNING, "dcledmatrix: mirror connector failed to wait");
+			break;
+		}
+	}
+	return NULL;
+}
+
+/****************************************************************************
+ * THE SOURCE                                                               *
+ ****************************************************************************/
+
+/* hand the connection back to the connector thread, and go dark */
+static void
+mirror_disconnect(mirror_t *m)
+{
+	__atomic_store_n(&m->gone, m->comm, __ATOMIC_RELEASE);
+	m->comm = NULL;
+	sem_post(&m->wakeup);
+	memset(m->img->data, 0, m->img->size);
+	m->seq = 0;
+	mirror_draw(m);
+}
+
+static void
+mirror_tick(void *data, float seconds)
+{
+	mirror_t *m = (mirror_t*)data;
+	uint64_t now;
+
+	(void)seconds;
+	if (mirror_apply_settings(m)) {
+		return;
+	}
+	if (!m->comm) {
+		m->comm = __atomic_exchange_n(&m->connected, NULL, __ATOMIC_ACQUIRE);
+		if (!m->comm) {
+			return;
+		}
+		m->check_ns = 0;
+	}
+	now = os_gettime_ns();
+	if (now >= m->check_ns) {
+		m->check_ns = now + MIRROR_CHECK_NS;
+		if (dclmdClientDaemonGone(m->comm)) {
+			mirror_disconnect(m);
+			return;
+		}
+	}
+	if (dclmdClientReadMirror(m->comm, &m->seq, m->img) > 0) {
+		mirror_draw(m);
+	}
+}
+
+static void
+mirror_render(void *data, gs_effect_t *effect)
+{
+	mirror_t *m = (mirror_t*)data;
+
+	(void)effect;
+	if (!m->pixels) {
+		return;
+	}
+	if (m->tex && (m->tex_w != m->width || m->tex_h != m->height)) {
+		gs_texture_destroy(m->tex);
+		m->tex = NULL;
+	}
+	if (!m->tex) {
+		m->tex = gs_texture_create(m->width, m->height, GS_RGBA, 1, NULL, GS_DYNAMIC);
+		if (!m->tex) {
+			return;
+		}
+		m->tex_w = m->width;
+		m->tex_h = m->height;
+		m->dirty = 1;
+	}
+	if (m->dirty) {
+		gs_texture_set_image(m->tex, (const uint8_t*)m->pixels, m->width * sizeof(*m->pixels), false);
+		m->dirty = 0;
+	}
+	obs_source_draw(m->tex, 0, 0, 0, 0, false);
+}
+
+static uint32_t
+mirror_get_width(void *data)
+{
+	mirror_t *m = (mirror_t*)data;
+	return MIRROR_COLS * __atomic_load_n(&m->cell, __ATOMIC_RELAXED);
+}
+
+static uint32_t
+mirror_get_height(void *data)
+{
+	mirror_t *m = (mirror_t*)data;
+	return MIRROR_ROWS * __atomic_load_n(&m->cell, __ATOMIC_RELAXED);
+}
+
+static const char *
+mirror_get_name(void *type_data)
+{
+	(void)type_data;
+	return "DCLEDMatrix Mirror";
+}
+
+static void
+mirror_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "dot_size", 12);
+	obs_data_set_default_int(settings, "color_on", 0xff2020ff);
+	obs_data_set_default_int(settings, "color_off", 0xff202040);
+}
+
+static obs_properties_t *
+mirror_properties(void *data)
+{
+	obs_properties_t *props = obs_properties_create();
+
+	(void)data;
+	obs_properties_add_int(props, "dot_size", "Dot size", MIRROR_CELL_MIN, MIRROR_CELL_MAX, 1);
+	obs_properties_add_color(props, "color_on", "Lit LED");
+	obs_properties_add_color(props, "color_off", "Dark LED");
+	return props;
+}
+
+static void
+mirror_update(void *data, obs_data_t *settings)
+{
+	mirror_t *m = (mirror_t*)data;
+	long long cell = obs_data_get_int(settings, "dot_size");
+
+	if (cell < MIRROR_CELL_MIN) {
+		cell = MIRROR_CELL_MIN;
+	} else if (cell > MIRROR_CELL_MAX) {
+		cell = MIRROR_CELL_MAX;
+	}
+	__atomic_store_n(&m->cell, (unsigned int)cell, __ATOMIC_RELAXED);
+	__atomic_store_n(&m->color_on, (uint32_t)obs_data_get_int(settings, "color_on"), __ATOMIC_RELAXED);
+	__atomic_store_n(&m->color_off, (uint32_t)obs_data_get_int(settings, "color_off"), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&m->settings_gen, 1, __ATOMIC_RELEASE);
+}
+
+static void
+mirror_destroy(void *data)
+{
+	mirror_t *m = (mirror_t*)data;
+
+	if (!m) {
+		return;
+	}
+	if (m->flags & MIRROR_FLAG_CONNECTOR) {
+		__atomic_store_n(&m->exit, 1, __ATOMIC_RELEASE);
+		sem_post(&m->wakeup);
+		pthread_join(m->connector, NULL);
+	}
+	if (m->flags & MIRROR_FLAG_WAKEUP_SEM) {
+		sem_destroy(&m->wakeup);
+	}
+	if (m->tex) {
+		obs_enter_graphics();
+		gs_texture_destroy(m->tex);
+		obs_leave_graphics();
+	}
+	dclmdCommunicationDestroy(m->comm);
+	dclmdCommunicationDestroy(m->connected);
+	dclmdCommunicationDestroy(m->gone);
+	dclmImageDestroy(m->img);
+	free(m->pixels);
+	free(m->dots);
+	free(m);
+}
+
+static void *
+mirror_create(obs_data_t *settings, obs_source_t *source)
+{
+	mirror_t *m = malloc(sizeof(*m));
+
+	if (!m) {
+		blog(LOG_WARNING,"dcledmatrix malloc failed");
+		return NULL;
+	}
+	m->source = source;
+	m->settings_gen = 0;
+	m->applied_gen = 0;
+	m->width = 0;
+	m->height = 0;
+	m->pixels = NULL;
+	m->dots = NULL;
+	m->dirty = 0;
+	m->tex = NULL;
+	m->tex_w = 0;
+	m->tex_h = 0;
+	m->comm = NULL;
+	m->check_ns = 0;
+	m->seq = 0;
+	m->img = NULL;
+	m->connected = NULL;
+	m->gone = NULL;
+	m->flags = 0;
+	m->exit = 0;
+	mirror_update(m, settings);
+
+	/* all dark until the daemon tells otherwise */
+	m->img = dclmImageCreate(MIRROR_COLS, MIRROR_ROWS, NULL);
+	if (!m->img) {
+		blog(LOG_WARNING,"dcledmatrix failed to create the mirror image");
+		mirror_destroy(m);
+		return NULL;
+	}
+	memset(m->img->data, 0, m->img->size);
+
+	if (sem_init(&m->wakeup, 0, 0)) {
+		blog(LOG_WARNING,"dcledmatrix failed to create semaphore");
+		mirror_destroy(m);
+		return NULL;
+	}
+	m->flags |= MIRROR_FLAG_WAKEUP_SEM;
+	if (pthread_create(&m->connector, NULL, mirror_connector, m)) {
+		blog(LOG_WARNING,"dcledmatrix failed to create the mirror connector thread");
+		mirror_destroy(m);
+		return NULL;
+	}
+	m->flags |= MIRROR_FLAG_CONNECTOR;
+	return m;
+}
+
+static struct obs_source_info mirror_source_info = {
+	.id = "dclm_mirror_source",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_VIDEO,
+	.get_name = mirror_get_name,
+	.create = mirror_create,
+	.destroy = mirror_destroy,
+	.get_width = mirror_get_width,
+	.get_height = mirror_get_height,
+	.get_defaults = mirror_defaults,
+	.get_properties = mirror_properties,
+	.update = mirror_update,
+	.video_tick = mirror_tick,
+	.video_render = mirror_render
+};
+
+extern void
+dclm_mirror_register(void)
+{
+	obs_register_source(&mirror_source_info);
+}
+
@@ -20,8 +20,13 @@
 #include <obs-module.h>
 #include <util/base.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #include "dclmd_comm.h"
+#include "dclm-plugin.h"
 
 OBS_DECLARE_MODULE()
 
@@ -30,20 +35,107 @@ MODULE_EXPORT const char *obs_module_description(void)
         return "DCLEDMatrix status display";
 }
 
+/* positions in the status text */
+#define STATUS_STREAM		0
+#define STATUS_RECORD		1
+#define STATUS_SCENE		3
+#define STATUS_LEN		4
+
+/* events are collected until there was none for DEBOUNCE_MS,
+ * but at most for DEBOUNCE_MAX_MS, before the status is sent */
+#define DEBOUNCE_MS		30
+#define DEBOUNCE_MAX_MS		150
+
+/* while streaming or recording, the status is shown for
+ * TICKER_STATUS_MS, then the statistics scroll by once */
+#define STATS_INTERVAL_MS	1000
+#define TICKER_STATUS_MS	5000
+#define TICKER_PPS		20
+#define TICKER_COLS		21
+#define TICKER_CHAR_W		5 /* the daemon's font */
+
+#define TICKER_OFF		0
+#define TICKER_STATUS		1 /* the status is shown */
+#define TICKER_SCROLL		2 /* the statistics scroll */
+
 typedef struct {
-	DCLMDComminucation *comm;
+	DCLMDComminucation *comm; /* only used by the sender thread */
 	unsigned int flags;
 	char curScene[256];
-	char text[6];
+	char text[6]; /* the status, only used by the sender thread */
+	char sent[6]; /* the status last sent */
+	unsigned int sent_timeout_ms;
+	int sent_valid; /* sent is what the daemon shows */
+	dclm_stats_t stats; /* only used by the sender thread */
+	int ticker; /* TICKER_* */
+	struct timespec stats_next; /* the next sample */
+	struct timespec ticker_end; /* the end of the ticker phase */
+	/* The frontend thread hands over the state, never messages: the
+	 * sender thread takes whatever the state is when it wakes up, so
+	 * no wakeup can get lost, whatever the daemon does. */
+	char status[STATUS_LEN]; /* written by the frontend thread, one atomic char per slot */
+	unsigned int status_gen; /* incremented after every change of status */
+	unsigned int status_seen; /* status_gen taken over by the sender thread */
+	int exit; /* the sender thread must exit */
+	const char *exit_text; /* shown by the sender thread before it exits */
+	sem_t wakeup; /* doorbell of the sender thread */
+	pthread_t sender;
 } ctx_t;
 
 #define FLAG_FRONTEND_CALLBACK	0x1
 #define FLAG_RECORDING		0x2
 #define FLAG_STREAMING		0x4
+#define FLAG_SENDER_THREAD	0x8
+#define FLAG_WAKEUP_SEM		0x10
 #define FLAGS_DEFAULT		0
 
 static ctx_t *module_ctx=NULL;
 
+/****************************************************************************
+ * STATE OF THE SENDER THREAD                                               *
+ ****************************************************************************/
+
+/* set one character of the status, never blocks */
+static void
+ctx_set_status(ctx_t *ctx, unsigned int slot, char c)
+{
+	__atomic_store_n(&ctx->status[slot], c, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&ctx->status_gen, 1, __ATOMIC_RELEASE);
+	if (ctx->flags & FLAG_SENDER_THREAD) {
+		sem_post(&ctx->wakeup);
+	}
+}
+
+/* take over the status set by the frontend thread
+ * RETURN: 1: the status changed
+ *         0: nothing new
+ */
+static int
+sender_take_status(ctx_t *ctx)
+{
+	unsigned int gen = __atomic_load_n(&ctx->status_gen, __ATOMIC_ACQUIRE);
+	unsigned int i;
+	int changed = 0;
+	char c;
+
+	if (gen == ctx->status_seen) {
+		return 0;
+	}
+	ctx->status_seen = gen;
+	for (i = 0; i < STATUS_LEN; i++) {
+		c = __atomic_load_n(&ctx->status[i], __ATOMIC_RELAXED);
+		if (ctx->text[i] != c) {
+			ctx->text[i] = c;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+/****************************************************************************
+ * SENDER THREAD                                                            *
+ ****************************************************************************/
+
 static DCLMDComminucation*
 ctx_get_comm(ctx_t *ctx)
 {
@@ -52,11 +144,255 @@ ctx_get_comm(ctx_t *ctx)
 	}
 	ctx->comm = dclmdCommunicationClientCreate();
 	if (ctx->comm) {
+		blog(LOG_DEBUG, "dcledmatrix connected to the daemon");
 		dclmdClientBlank(ctx->comm, 0);
+		ctx->sent_valid = 0;
 	}
 	return ctx->comm;
 }
 
+/* RETURN: 0: OK
+ *         -1: failed
+ */
+static int
+sender_show_text(ctx_t *ctx, const char *text, size_t len, unsigned int timeout_ms)
+{
+	DCLMDComminucation *comm = ctx_get_comm(ctx);
+	DCLEDMatrixError err;
+
+	if (!comm) {
+		/* no daemon, try again with the next message */
+		return -1;
+	}
+	if ( (err=dclmdClientShowText(comm, text, len, 0, DCLMD_CMD_CLEAR_SCREEN, timeout_ms)) != DCLM_OK) {
+		blog(LOG_WARNING, "dcledmatrix: failed to show text: %d", (int)err);
+		dclm_comm_check_error(&ctx->comm, err);
+		return -1;
+	}
+	return 0;
+}
+
+/* compose the status and send it, unless it is what the daemon shows already */
+static void
+sender_flush(ctx_t *ctx)
+{
+	unsigned int timeout_ms;
+
+	if ( (ctx->text[STATUS_STREAM] == ' ') && (ctx->text[STATUS_RECORD] == ' ') ) {
+		timeout_ms = 5000;
+	} else {
+		timeout_ms = 0;
+	}
+
+	if (ctx->sent_valid && timeout_ms == ctx->sent_timeout_ms &&
+	    !memcmp(ctx->text, ctx->sent, STATUS_LEN)) {
+		return;
+	}
+	/*
+	blog(LOG_DEBUG,"dcledmatrix: TEXT:'%s'",ctx->text);*/
+	if (sender_show_text(ctx, ctx->text, STATUS_LEN, timeout_ms)) {
+		ctx->sent_valid = 0;
+		return;
+	}
+	memcpy(ctx->sent, ctx->text, STATUS_LEN);
+	ctx->sent_timeout_ms = timeout_ms;
+	ctx->sent_valid = 1;
+}
+
+static void
+add_ms(struct timespec *ts, unsigned int ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_nsec -= 1000000000L;
+		ts->tv_sec++;
+	}
+}
+
+static int
+is_due(const struct timespec *t, const struct timespec *now)
+{
+	return (t->tv_sec < now->tv_sec || (t->tv_sec == now->tv_sec && t->tv_nsec <= now->tv_nsec));
+}
+
+/* let the statistics scroll by once
+ * RETURN: the duration of the loop in ms, 0 on failure
+ */
+static unsigned int
+sender_scroll_ticker(ctx_t *ctx)
+{
+	DCLMDComminucation *comm = ctx_get_comm(ctx);
+	DCLEDMatrixError err;
+	char buf[96];
+	size_t len;
+
+	if (!comm) {
+		return 0;
+	}
+	len = dclm_stats_format(&ctx->stats, ctx->text, STATUS_LEN, buf, sizeof(buf));
+	ctx->sent_valid = 0;
+	if ( (err=dclmdClientScrollText(comm, buf, len, TICKER_PPS, DCLMD_SCROLL_LEFT, 1, 0)) != DCLM_OK) {
+		blog(LOG_WARNING, "dcledmatrix: failed to scroll the statistics: %d", (int)err);
+		if (err == DCLMD_COMMUNICATION_ERROR) {
+			dclmdCommunicationDestroy(ctx->comm);
+			ctx->comm = NULL;
+		}
+		return 0;
+	}
+	/* the daemon scrolls the text in and out completely */
+	return (unsigned int)((TICKER_COLS + TICKER_CHAR_W*len) * 1000 / TICKER_PPS);
+}
+
+/* sample the statistics once per second while streaming or recording,
+ * and switch between the status and the ticker */
+static void
+sender_ticker(ctx_t *ctx, const struct timespec *now)
+{
+	unsigned int ms;
+
+	if (ctx->text[STATUS_STREAM] == ' ' && ctx->text[STATUS_RECORD] == ' ') {
+		/* the status shown next replaces the ticker */
+		ctx->ticker = TICKER_OFF;
+		return;
+	}
+	if (ctx->ticker == TICKER_OFF) {
+		dclm_stats_reset(&ctx->stats);
+		ctx->ticker = TICKER_STATUS;
+		ctx->stats_next = *now;
+		ctx->ticker_end = *now;
+		add_ms(&ctx->ticker_end, TICKER_STATUS_MS);
+	}
+	if (is_due(&ctx->stats_next, now)) {
+		dclm_stats_sample(&ctx->stats);
+		ctx->stats_next = *now;
+		add_ms(&ctx->stats_next, STATS_INTERVAL_MS);
+	}
+	if (!is_due(&ctx->ticker_end, now)) {
+		return;
+	}
+	ms = 0;
+	if (ctx->ticker == TICKER_STATUS && ctx->stats.flags) {
+		ms = sender_scroll_ticker(ctx);
+	}
+	if (ms) {
+		ctx->ticker = TICKER_SCROLL;
+	} else {
+		/* the ticker is through, the status comes back */
+		ctx->ticker = TICKER_STATUS;
+		sender_flush(ctx);
+		ms = TICKER_STATUS_MS;
+	}
+	ctx->ticker_end = *now;
+	add_ms(&ctx->ticker_end, ms);
+}
+
+/* the time the sender thread has to wake up at next
+ * RETURN: 0: nothing to wait for but messages
+ *         1: until is set
+ */
+static int
+sender_deadline(const ctx_t *ctx, int pending, const struct timespec *window, struct timespec *until)
+{
+	if (pending) {
+		/* the ticker waits for the new status */
+		*until = *window;
+		return 1;
+	}
+	if (ctx->ticker != TICKER_OFF) {
+		*until = ctx->stats_next;
+		if (is_due(&ctx->ticker_end, until)) {
+			*until = ctx->ticker_end;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+/* the end of the debounce window, on CLOCK_REALTIME for sem_timedwait() */
+static void
+sender_window(const struct timespec *first, const struct timespec *last, struct timespec *until)
+{
+	struct timespec max = *first;
+
+	*until = *last;
+	add_ms(until, DEBOUNCE_MS);
+	add_ms(&max, DEBOUNCE_MAX_MS);
+	if (max.tv_sec < until->tv_sec || (max.tv_sec == until->tv_sec && max.tv_nsec < until->tv_nsec)) {
+		*until = max;
+	}
+}
+
+/* the sender thread: the only one talking to dclmd, so blocking
+ * in the communication never stalls OBS itself */
+static void *
+sender_thread(void *v_ctx)
+{
+	ctx_t *ctx = (ctx_t*)v_ctx;
+	struct timespec first, last, window, until, now;
+	int pending = 0; /* the status changed, but was not sent yet */
+	int res;
+
+	while (!__atomic_load_n(&ctx->exit, __ATOMIC_ACQUIRE)) {
+		if (pending) {
+			sender_window(&first, &last, &window);
+		}
+		if (sender_deadline(ctx, pending, &window, &until)) {
+			res = sem_timedwait(&ctx->wakeup, &until);
+		} else {
+			res = sem_wait(&ctx->wakeup);
+		}
+		if (res) {
+			if (errno == ETIMEDOUT) {
+				clock_gettime(CLOCK_REALTIME, &now);
+				if (pending && is_due(&window, &now)) {
+					/* the burst of events is over */
+					sender_flush(ctx);
+					pending = 0;
+					if (ctx->ticker == TICKER_SCROLL) {
+						/* the new status stopped the ticker */
+						ctx->ticker = TICKER_STATUS;
+						ctx->ticker_end = now;
+						add_ms(&ctx->ticker_end, TICKER_STATUS_MS);
+					}
+				}
+				if (!pending) {
+					sender_ticker(ctx, &now);
+				}
+			} else if (errno != EINTR) {
+				blog(LOG_WARNING, "dcledmatrix: sender thread failed to wait");
+				break;
+			}
+			continue;
+		}
+
+		if (sender_take_status(ctx)) {
+			clock_gettime(CLOCK_REALTIME, &last);
+			if (!pending) {
+				first = last;
+			}
+			pending = 1;
+		}
+	}
+
+	/* send everything set so far */
+	if (sender_take_status(ctx) || pending) {
+		sender_flush(ctx);
+	}
+	if (ctx->exit_text) {
+		sender_show_text(ctx, ctx->exit_text, 0, 5000);
+	}
+	if (ctx->comm) {
+		dclmdCommunicationDestroy(ctx->comm);
+		ctx->comm = NULL;
+	}
+	return NULL;
+}
+
+/****************************************************************************
+ * FRONTEND EVENTS                                                          *
+ ****************************************************************************/
+
 static void
 get_current_scene(ctx_t *ctx)
 {
@@ -74,8 +410,6 @@ static void
 frontend_event_callback(enum obs_frontend_event ev, void *v_ctx)
 {
 	ctx_t *ctx = (ctx_t*)v_ctx;
-	DCLEDMatrixError err = DCLM_OK;
-	unsigned int timeout_ms;
 
 	if (!ctx) {
 		return;
@@ -84,65 +418,50 @@ frontend_event_callback(enum obs_frontend_event ev, void *v_ctx)
 	/* the events we care about */
 	switch(ev) {
 		case OBS_FRONTEND_EVENT_STREAMING_STARTING:
-			ctx->text[0]='.';
+			ctx_set_status(ctx, STATUS_STREAM, '.');
 			break;
 		case OBS_FRONTEND_EVENT_STREAMING_STARTED:
-			ctx->text[0]='*';
+			ctx_set_status(ctx, STATUS_STREAM, '*');
 			break;
 		case OBS_FRONTEND_EVENT_STREAMING_STOPPED:
-			ctx->text[0]=' ';
+			ctx_set_status(ctx, STATUS_STREAM, ' ');
 			break;
 		case OBS_FRONTEND_EVENT_STREAMING_STOPPING:
-			ctx->text[0]=':';
+			ctx_set_status(ctx, STATUS_STREAM, ':');
 			break;
 		case OBS_FRONTEND_EVENT_RECORDING_STARTING:
-			ctx->text[1]='.';
+			ctx_set_status(ctx, STATUS_RECORD, '.');
 			break;
 		case OBS_FRONTEND_EVENT_RECORDING_STARTED:
-			ctx->text[1]='+';
+			ctx_set_status(ctx, STATUS_RECORD, '+');
 			break;
 		case OBS_FRONTEND_EVENT_RECORDING_STOPPING:
-			ctx->text[1]=':';
+			ctx_set_status(ctx, STATUS_RECORD, ':');
 			break;
 		case OBS_FRONTEND_EVENT_RECORDING_STOPPED:
-			ctx->text[1]=' ';
+			ctx_set_status(ctx, STATUS_RECORD, ' ');
 			break;
 		case OBS_FRONTEND_EVENT_RECORDING_PAUSED:
-			ctx->text[1]='P';
+			ctx_set_status(ctx, STATUS_RECORD, 'P');
 			break;
 		case OBS_FRONTEND_EVENT_RECORDING_UNPAUSED:
-			ctx->text[1]='+';
+			ctx_set_status(ctx, STATUS_RECORD, '+');
 			break;
 		case OBS_FRONTEND_EVENT_SCENE_CHANGED:
 		case OBS_FRONTEND_EVENT_FINISHED_LOADING:
 			get_current_scene(ctx);
+			ctx_set_status(ctx, STATUS_SCENE, ctx->curScene[0]);
 			break;
 		default:
 			/* event not relevant for us */
-			return;
-	}
-	if (!ctx->comm) {
-		return;
-	}
-
-	if ( (ctx->text[0] == ' ') && (ctx->text[1] == ' ') ) {
-		timeout_ms = 5000;
-	} else {
-		timeout_ms = 0;
-	}	
-
-	ctx->text[3]=ctx->curScene[0];
-	if ( (err=dclmdClientShowText(ctx->comm, ctx->text, 4, 0, DCLMD_CMD_CLEAR_SCREEN, timeout_ms)) != DCLM_OK) {
-		blog(LOG_WARNING, "dcledmatrix: failed to show text: %d", (int)err);
+			break;
 	}
-	/*
-	blog(LOG_DEBUG,"dcledmatrix: TEXT:'%s'",ctx->text);*/
-	/*
-	memcpy(ctx->text+1,ctx->curScene,sizeof(ctx->text)-2);
-	dclmdClientShowText(comm, ctx->text, 0, 0);
-	*/
 }
 
+/****************************************************************************
+ * CONTEXT                                                                  *
+ ****************************************************************************/
+
 static void
 ctx_init(ctx_t *ctx)
 {
@@ -155,6 +474,31 @@ ctx_init(ctx_t *ctx)
 	ctx->text[3]='_';
 	ctx->text[4]='0';
 	ctx->text[sizeof(ctx->text)-1]=0;
+	ctx->sent_timeout_ms=0;
+	ctx->sent_valid=0;
+	ctx->ticker=TICKER_OFF;
+	memcpy(ctx->status, ctx->text, STATUS_LEN);
+	ctx->status_gen=0;
+	ctx->status_seen=0;
+	ctx->exit=0;
+	ctx->exit_text=NULL;
+}
+
+/* stop the sender thread, after it sent the last status and the
+ * exit text: the flag can't get lost like a message */
+static void
+ctx_stop_sender(ctx_t *ctx)
+{
+	if (ctx->flags & FLAG_SENDER_THREAD) {
+		__atomic_store_n(&ctx->exit, 1, __ATOMIC_RELEASE);
+		sem_post(&ctx->wakeup);
+		pthread_join(ctx->sender, NULL);
+		ctx->flags &= ~FLAG_SENDER_THREAD;
+	}
+	if (ctx->flags & FLAG_WAKEUP_SEM) {
+		sem_destroy(&ctx->wakeup);
+		ctx->flags &= ~FLAG_WAKEUP_SEM;
+	}
 }
 
 static void
@@ -164,16 +508,13 @@ ctx_cleanup(ctx_t *ctx)
 		return;
 	}
 
-	if (ctx->comm) {
-		dclmdCommunicationDestroy(ctx->comm);
-		ctx->comm=NULL;
-	}
-
 	if (ctx->flags & FLAG_FRONTEND_CALLBACK) {
 		blog(LOG_DEBUG, "dcledmatrix removing frontend event callback");
 		obs_frontend_remove_event_callback(frontend_event_callback, ctx);
 		ctx->flags &= ~FLAG_FRONTEND_CALLBACK;
 	}
+
+	ctx_stop_sender(ctx);
 }
 
 static void
@@ -196,17 +537,27 @@ ctx_create()
 		return ctx;
 	}
 	ctx_init(ctx);
-	ctx_get_comm(ctx);
-	if (!ctx->comm) {
-		blog(LOG_WARNING,"dcledmatrix communication to daemon failed");
+	get_current_scene(ctx);
+	ctx->text[STATUS_SCENE]=ctx->curScene[0];
+	ctx->status[STATUS_SCENE]=ctx->curScene[0];
+
+	/* the sender thread connects to the daemon, whenever it is there */
+	if (sem_init(&ctx->wakeup, 0, 0)) {
+		blog(LOG_WARNING,"dcledmatrix failed to create semaphore");
+		ctx_destroy(ctx);
+		return NULL;
+	}
+	ctx->flags |= FLAG_WAKEUP_SEM;
+	if (pthread_create(&ctx->sender, NULL, sender_thread, ctx)) {
+		blog(LOG_WARNING,"dcledmatrix failed to create sender thread");
 		ctx_destroy(ctx);
 		return NULL;
 	}
+	ctx->flags |= FLAG_SENDER_THREAD;
 
 	blog(LOG_DEBUG, "dcledmatrix installing frontend event callback");
 	obs_frontend_add_event_callback(frontend_event_callback, ctx);
 	ctx->flags |= FLAG_FRONTEND_CALLBACK;
-	get_current_scene(ctx);
 	return ctx;
 }
 
@@ -218,6 +569,9 @@ obs_module_load(void)
 	}
 	module_ctx = ctx_create();
 	if (module_ctx) {
+		dclm_video_register();
+		dclm_audio_register();
+		dclm_mirror_register();
 		blog(LOG_INFO,"dcledmatrix loaded");
 		return true;
 	}
@@ -229,12 +583,7 @@ void
 obs_module_unload(void)
 {
 	if (module_ctx) {
-		if (module_ctx->comm) {
-			DCLEDMatrixError err;
-			if ( (err=dclmdClientShowText(module_ctx->comm, "FINI", 0, 0, DCLMD_CMD_CLEAR_SCREEN, 5000)) != DCLM_OK) {
-				blog(LOG_WARNING, "dcledmatrix: failed show finish text: %d", (int)err);
-			}
-		}
+		module_ctx->exit_text = "FINI";
 		ctx_destroy(module_ctx);
 	}
 	module_ctx = NULL;
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * NOTE: This will use the API from obs-studio, which is GPL2 or later.
+ */
+
+#ifndef DCLM_PLUGIN_H
+#define DCLM_PLUGIN_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "dclmd_comm.h"
+
+/* the dclmd layers of the plugin: the status text is the regular
+ * screen contents, everything else goes into its own layer, so the
+ * status comes back as soon as a layer is removed */
+#define DCLM_OBS_LAYER_VIDEO	0x0b500001u
+#define DCLM_OBS_LAYER_AUDIO	0x0b500002u
+#define DCLM_OBS_Z_VIDEO	0
+#define DCLM_OBS_Z_AUDIO	1
+
+/* the layers expire, so they vanish if OBS crashes, and are set again
+ * as keep-alive even if they did not change */
+#define DCLM_OBS_LAYER_TTL_MS	3000
+#define DCLM_OBS_LAYER_KEEP_NS	1000000000ull
+
+/****************************************************************************
+ * DAEMON CONNECTION AND LAYERS (dclm-layer.c)                              *
+ ****************************************************************************/
+
+/* close *comm if err says the daemon went away, so the next
+ * command connects again
+ * RETURN: 1 if *comm was closed
+ */
+extern int
+dclm_comm_check_error(DCLMDComminucation **comm, DCLEDMatrixError err);
+
+/* one layer with its own connection, only used by one thread */
+typedef struct {
+	DCLMDComminucation *comm;
+	unsigned int id; /* DCLM_OBS_LAYER_* */
+	int z;
+	int shown_valid; /* the layer is set */
+	uint64_t shown_ns; /* when the layer was set */
+} dclm_layer_t;
+
+extern void
+dclm_layer_init(dclm_layer_t *l, unsigned int id, int z);
+
+/* connect to the daemon, unless connected already
+ * RETURN: the connection, NULL if the daemon is not there
+ */
+extern DCLMDComminucation *
+dclm_layer_get_comm(dclm_layer_t *l);
+
+/* RETURN: 1 if the layer has to be set: it is not set, it changed,
+ *         or it has to be set again to keep it alive
+ */
+extern int
+dclm_layer_due(const dclm_layer_t *l, int changed, uint64_t now);
+
+/* set the layer to w x h pixels drawn by dl from img (which may be
+ * NULL), old daemons without layers show it directly instead
+ * RETURN: 0: OK
+ *         -1: failed, the layer counts as not set
+ */
+extern int
+dclm_layer_set(dclm_layer_t *l, int w, int h, const DCLMDisplayList *dl, const DCLMImage *img, uint64_t now);
+
+/* remove the layer, if it is set */
+extern void
+dclm_layer_hide(dclm_layer_t *l);
+
+/* remove the layer and disconnect */
+extern void
+dclm_layer_close(dclm_layer_t *l);
+
+/****************************************************************************
+ * VIDEO FILTER (dclm-video.c)                                              *
+ ****************************************************************************/
+
+/* register the "DCLEDMatrix Output" video filter */
+extern void
+dclm_video_register(void);
+
+/****************************************************************************
+ * AUDIO METER FILTER (dclm-audio.c)                                        *
+ ****************************************************************************/
+
+/* register the "DCLEDMatrix Audio Meter" audio filter */
+extern void
+dclm_audio_register(void);
+
+/****************************************************************************
+ * MIRROR SOURCE (dclm-mirror.c)                                            *
+ ****************************************************************************/
+
+/* register the "DCLEDMatrix Mirror" source */
+extern void
+dclm_mirror_register(void);
+
+/****************************************************************************
+ * OUTPUT STATISTICS (dclm-stats.c)                                         *
+ ****************************************************************************/
+
+typedef struct {
+	unsigned int flags; /* DCLM_STATS_*: the outputs active at the last sample */
+	uint64_t stream_bytes; /* sent until the last sample */
+	uint64_t sample_ns; /* time of the last sample */
+	unsigned int kbps; /* the bitrate since the sample before */
+	int dropped;
+	unsigned int rec_seconds; /* the length of the recording */
+} dclm_stats_t;
+
+#define DCLM_STATS_STREAMING	0x1
+#define DCLM_STATS_RECORDING	0x2
+
+extern void
+dclm_stats_reset(dclm_stats_t *st);
+
+/* read the counters of the streaming and the recording output
+ * RETURN: DCLM_STATS_* of the outputs which are active
+ */
+extern unsigned int
+dclm_stats_sample(dclm_stats_t *st);
+
+/* format the ticker text: the status, followed by the statistics
+ * of the active outputs
+ * RETURN: the length of the text in buf, which is always 0-terminated
+ */
+extern size_t
+dclm_stats_format(const dclm_stats_t *st, const char *status, size_t status_len, char *buf, size_t size);
+
+#endif /* !DCLM_PLUGIN_H */
+
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * NOTE: This will use the API from obs-studio, which is GPL2 or later.
+ */
+
+/* The output statistics for the ticker: sampled once per second by
+ * the sender thread, which only needs a few counters of the streaming
+ * and the recording output for that.
+ */
+
+#include <obs-frontend-api.h>
+#include <obs-module.h>
+#include <util/platform.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dclm-plugin.h"
+
+/****************************************************************************
+ * STATISTICS                                                               *
+ ****************************************************************************/
+
+extern void
+dclm_stats_reset(dclm_stats_t *st)
+{
+	st->flags = 0;
+	st->stream_bytes = 0;
+	st->sample_ns = 0;
+	st->kbps = 0;
+	st->dropped = 0;
+	st->rec_seconds = 0;
+}
+
+static void
+stats_sample_stream(dclm_stats_t *st, obs_output_t *out, uint64_t now)
+{
+	uint64_t bytes = obs_output_get_total_bytes(out);
+
+	if ((st->flags & DCLM_STATS_STREAMING) && now > st->sample_ns && bytes >= st->stream_bytes) {
+		/* bits per ms are kbit/s */
+		st->kbps = (unsigned int)((bytes - st->stream_bytes) * 8u * 1000000u / (now - st->sample_ns));
+	} else {
+		st->kbps = 0;
+	}
+	st->stream_bytes = bytes;
+	st->dropped = obs_output_get_frames_dropped(out);
+	st->flags |= DCLM_STATS_STREAMING;
+}
+
+static void
+stats_sample_record(dclm_stats_t *st, obs_output_t *out)
+{
+	double fps = video_output_get_frame_rate(obs_get_video());
+	int frames = obs_output_get_total_frames(out);
+
+	/* the frames recorded, so pauses do not count */
+	st->rec_seconds = (fps > 0.0 && frames > 0)?(unsigned int)((double)frames / fps):0;
+	st->flags |= DCLM_STATS_RECORDING;
+}
+
+extern unsigned int
+dclm_stats_sample(dclm_stats_t *st)
+{
+	uint64_t now = os_gettime_ns();
+	unsigned int flags = 0;
+	obs_output_t *out;
+
+	if ( (out = obs_frontend_get_streaming_output()) ) {
+		if (obs_output_active(out)) {
+			stats_sample_stream(st, out, now);
+			flags |= DCLM_STATS_STREAMING;
+		}
+		obs_output_release(out);
+	}
+	if ( (out = obs_frontend_get_recording_output()) ) {
+		if (obs_output_active(out)) {
+			stats_sample_record(st, out);
+			flags |= DCLM_STATS_RECORDING;
+		}
+		obs_output_release(out);
+	}
+	st->flags = flags;
+	st->sample_ns = now;
+	return flags;
+}
+
+/* append to the string of len characters in buf, as far as it fits
+ * RETURN: the new length
+ */
+static size_t
+stats_append(char *buf, size_t size, size_t len, const char *fmt, ...)
+{
+	va_list args;
+	int res;
+
+	/* nothing but the terminator fits anymore */
+	if (len + 1 >= size) {
+		return len;
+	}
+	va_start(args, fmt);
+	res = vsnprintf(buf + len, size - len, fmt, args);
+	va_end(args);
+	if (res < 0) {
+		buf[len] = 0;
+		return len;
+	}
+	return ((size_t)res < size - len)?len + (size_t)res:size - 1;
+}
+
+extern size_t
+dclm_stats_format(const dclm_stats_t *st, const char *status, size_t status_len, char *buf, size_t size)
+{
+	size_t len;
+
+	if (!size) {
+		return 0;
+	}
+	buf[0] = 0;
+	len = stats_append(buf, size, 0, "%.*s", (int)status_len, status);
+	if (st->flags & DCLM_STATS_STREAMING) {
+		len = stats_append(buf, size, len, "  %ukbps  %d drop",
+				   st->kbps, st->dropped);
+	}
+	if (st->flags & DCLM_STATS_RECORDING) {
+		len = stats_append(buf, size, len, "  REC %u:%02u:%02u",
+				   st->rec_seconds / 3600, (st->rec_seconds / 60) % 60, st->rec_seconds % 60);
+	}
+	return len;
+}
+
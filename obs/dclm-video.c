@@ -0,0 +1,461 @@
+/*
+ * Copyright (C) 2011 - 2020 by derhass <derhass@arcor.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * NOTE: This will use the API from obs-studio, which is GPL2 or later.
+ */
+
+/* The video filter: shows the video of the source it is put on on the
+ * LED matrix. The render thread only renders the source into a small
+ * texture at the configured frame rate, and copies the staged pixels
+ * one frame later into a triple buffer, so it never waits for the GPU.
+ * Averaging down to the matrix, dithering and talking to dclmd is done
+ * by a worker thread. All buffers are allocated with the filter, only
+ * the dithering allocates its few bytes of state on first use.
+ */
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "dclmd_comm.h"
+#include "dclm_dlist.h"
+#include "dclm_dither.h"
+#include "dclm-plugin.h"
+
+#define VIDEO_COLS		21
+#define VIDEO_ROWS		7
+#define VIDEO_OVERSAMPLE	16 /* captured pixels per LED in each direction */
+#define VIDEO_CAP_W		(VIDEO_COLS*VIDEO_OVERSAMPLE)
+#define VIDEO_CAP_H		(VIDEO_ROWS*VIDEO_OVERSAMPLE)
+#define VIDEO_FRAME_SIZE	(VIDEO_CAP_W*VIDEO_CAP_H*4)
+/* remove the layer if no frame came for two frame intervals plus
+ * VIDEO_IDLE_MARGIN_MS, but not before VIDEO_IDLE_MS */
+#define VIDEO_IDLE_MS		500
+#define VIDEO_IDLE_MARGIN_MS	250
+
+/* the triple buffer: mid holds the index of the buffer between the
+ * render thread and the worker, plus TB_FRESH if the worker did not
+ * take it yet */
+#define TB_FRESH		0x4
+#define TB_INDEX		0x3
+
+typedef struct {
+	obs_source_t *source;
+	gs_texrender_t *texrender;
+	gs_stagesurf_t *stage;
+
+	/* only used by the render thread */
+	int staged; /* stage holds a capture not copied yet */
+	uint64_t next_ns; /* time of the next capture */
+	unsigned int back;
+
+	/* the settings, set by the UI thread */
+	unsigned int interval_ms;
+	unsigned int mode; /* DCLM_DITHER_* */
+	unsigned int threshold;
+	unsigned int invert;
+
+	uint8_t frames[3][VIDEO_FRAME_SIZE];
+	unsigned int mid;
+
+	/* only used by the worker thread */
+	unsigned int front;
+	dclm_layer_t layer;
+	DCLMImage *gray; /* the frame averaged down to the matrix */
+	DCLMImage *img; /* ... and dithered */
+	DCLMDither dither;
+	uint8_t shown[VIDEO_COLS*VIDEO_ROWS]; /* the image in the layer */
+	unsigned int sums[VIDEO_COLS*VIDEO_ROWS];
+
+	sem_t wakeup; /* posted for every frame, and to exit */
+	pthread_t worker;
+	int run;
+	unsigned int flags;
+} vfilter_t;
+
+#define VIDEO_FLAG_WAKEUP_SEM	0x1
+#define VIDEO_FLAG_WORKER	0x2
+
+/****************************************************************************
+ * DOWNSCALING AND DITHERING                                                *
+ ****************************************************************************/
+
+/* average the luma of each VIDEO_OVERSAMPLE^2 block of the RGBA frame
+ * and dither it to v->img */
+static void
+video_convert(vfilter_t *v, const uint8_t *frame)
+{
+	unsigned int mode = __atomic_load_n(&v->mode, __ATOMIC_RELAXED);
+	int invert = (int)__atomic_load_n(&v->invert, __ATOMIC_RELAXED);
+	unsigned int x, y, i;
+	int value;
+
+	memset(v->sums, 0, sizeof(v->sums));
+	for (y = 0; y < VIDEO_CAP_H; y++) {
+		unsigned int *sum = v->sums + (y / VIDEO_OVERSAMPLE) * VIDEO_COLS;
+		for (x = 0; x < VIDEO_COLS; x++) {
+			unsigned int acc = 0;
+			for (i = 0; i < VIDEO_OVERSAMPLE; i++) {
+				/* luma * 256, BT.601 */
+				acc += 77u*frame[0] + 150u*frame[1] + 29u*frame[2];
+				frame += 4;
+			}
+			sum[x] += acc;
+		}
+	}
+
+	for (i = 0; i < VIDEO_COLS*VIDEO_ROWS; i++) {
+		value = (int)(v->sums[i] / (VIDEO_OVERSAMPLE*VIDEO_OVERSAMPLE*256));
+		v->gray->data[i] = (uint8_t)((invert)?(255 - value):value);
+	}
+
+	if (v->dither.mode != (int)mode) {
+		dclmDitherCleanup(&v->dither);
+		dclmDitherInit(&v->dither, (int)mode);
+	}
+	v->dither.threshold = (int)__atomic_load_n(&v->threshold, __ATOMIC_RELAXED);
+	if (dclmDither(&v->dither, v->gray, v->img)) {
+		/* out of memory, show the plain threshold */
+		for (i = 0; i < VIDEO_COLS*VIDEO_ROWS; i++) {
+			v->img->data[i] = (v->gray->data[i] >= v->dither.threshold)?0xff:0;
+		}
+	}
+}
+
+/****************************************************************************
+ * WORKER THREAD                                                            *
+ ****************************************************************************/
+
+/* put v->img into the layer, unless it is there already,
+ * and was set recently enough to keep the layer alive */
+static void
+video_show(vfilter_t *v)
+{
+	DCLMDisplayList dl;
+	uint8_t buf[32];
+	uint64_t now = os_gettime_ns();
+
+	if (!dclm_layer_due(&v->layer, memcmp(v->shown, v->img->data, sizeof(v->shown)), now)) {
+		return;
+	}
+	dclmDListInit(&dl, buf, sizeof(buf));
+	dclmDListBlit(&dl, 0, 0, 0, 0, VIDEO_COLS, VIDEO_ROWS);
+	if (!dclm_layer_set(&v->layer, VIDEO_COLS, VIDEO_ROWS, &dl, v->img, now)) {
+		memcpy(v->shown, v->img->data, sizeof(v->shown));
+	}
+}
+
+/* RETURN: the time without frames after which the source counts
+ *         as not rendered any more
+ */
+static unsigned int
+video_idle_ms(vfilter_t *v)
+{
+	unsigned int ms = 2 * __atomic_load_n(&v->interval_ms, __ATOMIC_RELAXED) + VIDEO_IDLE_MARGIN_MS;
+
+	return (ms > VIDEO_IDLE_MS)?ms:VIDEO_IDLE_MS;
+}
+
+static void *
+video_worker(void *v_video)
+{
+	vfilter_t *v = (vfilter_t*)v_video;
+	struct timespec until;
+	unsigned int mid;
+	int res;
+
+	while (__atomic_load_n(&v->run, __ATOMIC_ACQUIRE)) {
+		if (v->layer.shown_valid) {
+			dclmdCalcWaitTimeMS(&until, NULL, video_idle_ms(v));
+			res = sem_timedwait(&v->wakeup, &until);
+		} else {
+			res = sem_wait(&v->wakeup);
+		}
+		if (res) {
+			if (errno == ETIMEDOUT) {
+				/* the source is not rendered any more */
+				dclm_layer_hide(&v->layer);
+			} else if (errno != EINTR) {
+				blog(LOG_WARNING, "dcledmatrix: video worker failed to wait");
+				break;
+			}
+			continue;
+		}
+
+		if (!(__atomic_load_n(&v->mid, __ATOMIC_ACQUIRE) & TB_FRESH)) {
+			/* frames coming faster than we can send, the
+			 * previous wakeup took this one already */
+			continue;
+		}
+		mid = __atomic_exchange_n(&v->mid, v->front, __ATOMIC_ACQ_REL);
+		v->front = mid & TB_INDEX;
+		video_convert(v, v->frames[v->front]);
+		video_show(v);
+	}
+
+	dclm_layer_close(&v->layer);
+	return NULL;
+}
+
+/****************************************************************************
+ * RENDER THREAD                                                            *
+ ****************************************************************************/
+
+/* render what the filter gets into the texrender, and stage it */
+static void
+video_capture(vfilter_t *v)
+{
+	obs_source_t *target = obs_filter_get_target(v->source);
+	uint32_t w, h;
+	struct vec4 clear;
+
+	if (!target) {
+		return;
+	}
+	w = obs_source_get_base_width(target);
+	h = obs_source_get_base_height(target);
+	if (!w || !h) {
+		return;
+	}
+
+	gs_texrender_reset(v->texrender);
+	if (!gs_texrender_begin(v->texrender, VIDEO_CAP_W, VIDEO_CAP_H)) {
+		return;
+	}
+	vec4_zero(&clear);
+	gs_clear(GS_CLEAR_COLOR, &clear, 0.0f, 0);
+	gs_ortho(0.0f, (float)w, 0.0f, (float)h, -100.0f, 100.0f);
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	obs_source_skip_video_filter(v->source);
+	gs_blend_state_pop();
+	gs_texrender_end(v->texrender);
+
+	gs_stage_texture(v->stage, gs_texrender_get_texture(v->texrender));
+	v->staged = 1;
+}
+
+/* copy the staged capture into the back buffer and hand it to the
+ * worker, the GPU had a frame's time to finish it */
+static void
+video_readback(vfilter_t *v)
+{
+	uint8_t *dst = v->frames[v->back];
+	uint8_t *data;
+	uint32_t linesize;
+	unsigned int y;
+
+	v->staged = 0;
+	if (!gs_stagesurface_map(v->stage, &data, &linesize)) {
+		return;
+	}
+	for (y = 0; y < VIDEO_CAP_H; y++) {
+		memcpy(dst + y*VIDEO_CAP_W*4, data + y*linesize, VIDEO_CAP_W*4);
+	}
+	gs_stagesurface_unmap(v->stage);
+
+	v->back = __atomic_exchange_n(&v->mid, v->back | TB_FRESH, __ATOMIC_ACQ_REL) & TB_INDEX;
+	sem_post(&v->wakeup);
+}
+
+static void
+video_render(void *data, gs_effect_t *effect)
+{
+	vfilter_t *v = (vfilter_t*)data;
+	uint64_t now;
+	uint64_t interval;
+
+	(void)effect;
+	if (v->staged) {
+		video_readback(v);
+	} else {
+		now = os_gettime_ns();
+		if (now >= v->next_ns) {
+			interval = (uint64_t)__atomic_load_n(&v->interval_ms, __ATOMIC_RELAXED) * 1000000u;
+			/* keep the rate, but do not catch up after a pause */
+			v->next_ns = (now - v->next_ns < interval)?(v->next_ns + interval):(now + interval);
+			video_capture(v);
+		}
+	}
+	obs_source_skip_video_filter(v->source);
+}
+
+/****************************************************************************
+ * THE FILTER                                                               *
+ ****************************************************************************/
+
+static const char *
+video_get_name(void *type_data)
+{
+	(void)type_data;
+	return "DCLEDMatrix Output";
+}
+
+static void
+video_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "fps", 20);
+	obs_data_set_default_int(settings, "mode", DCLM_DITHER_TEMPORAL);
+	obs_data_set_default_int(settings, "threshold", 128);
+	obs_data_set_default_bool(settings, "invert", false);
+}
+
+static obs_properties_t *
+video_properties(void *data)
+{
+	obs_properties_t *props = obs_properties_create();
+	obs_property_t *p;
+
+	(void)data;
+	obs_properties_add_int(props, "fps", "Frame rate", 1, 60, 1);
+	p = obs_properties_add_list(props, "mode", "Mode", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, "Threshold", DCLM_DITHER_THRESHOLD);
+	obs_property_list_add_int(p, "Ordered dither", DCLM_DITHER_BAYER);
+	obs_property_list_add_int(p, "Floyd-Steinberg", DCLM_DITHER_FLOYD);
+	obs_property_list_add_int(p, "Blue noise", DCLM_DITHER_BLUE_NOISE);
+	obs_property_list_add_int(p, "Blue noise, steady", DCLM_DITHER_TEMPORAL);
+	obs_properties_add_int_slider(props, "threshold", "Threshold", 0, 255, 1);
+	obs_properties_add_bool(props, "invert", "Invert");
+	return props;
+}
+
+static void
+video_update(void *data, obs_data_t *settings)
+{
+	vfilter_t *v = (vfilter_t*)data;
+	long long fps = obs_data_get_int(settings, "fps");
+	long long threshold = obs_data_get_int(settings, "threshold");
+	long long mode = obs_data_get_int(settings, "mode");
+
+	if (fps < 1) {
+		fps = 1;
+	} else if (fps > 60) {
+		fps = 60;
+	}
+	if (threshold < 0) {
+		threshold = 0;
+	} else if (threshold > 255) {
+		threshold = 255;
+	}
+	__atomic_store_n(&v->interval_ms, (unsigned int)(1000 / fps), __ATOMIC_RELAXED);
+	if (mode < 0 || mode >= DCLM_DITHER_COUNT) {
+		mode = DCLM_DITHER_TEMPORAL;
+	}
+	__atomic_store_n(&v->mode, (unsigned int)mode, __ATOMIC_RELAXED);
+	__atomic_store_n(&v->threshold, (unsigned int)threshold, __ATOMIC_RELAXED);
+	__atomic_store_n(&v->invert, obs_data_get_bool(settings, "invert")?1u:0u, __ATOMIC_RELAXED);
+}
+
+static void
+video_destroy(void *data)
+{
+	vfilter_t *v = (vfilter_t*)data;
+
+	if (!v) {
+		return;
+	}
+	if (v->flags & VIDEO_FLAG_WORKER) {
+		__atomic_store_n(&v->run, 0, __ATOMIC_RELEASE);
+		sem_post(&v->wakeup);
+		pthread_join(v->worker, NULL);
+	}
+	if (v->flags & VIDEO_FLAG_WAKEUP_SEM) {
+		sem_destroy(&v->wakeup);
+	}
+	obs_enter_graphics();
+	if (v->stage) {
+		gs_stagesurface_destroy(v->stage);
+	}
+	if (v->texrender) {
+		gs_texrender_destroy(v->texrender);
+	}
+	obs_leave_graphics();
+	dclmDitherCleanup(&v->dither);
+	dclmImageDestroy(v->gray);
+	dclmImageDestroy(v->img);
+	free(v);
+}
+
+static void *
+video_create(obs_data_t *settings, obs_source_t *source)
+{
+	vfilter_t *v = malloc(sizeof(*v));
+
+	if (!v) {
+		blog(LOG_WARNING,"dcledmatrix malloc failed");
+		return NULL;
+	}
+	v->source = source;
+	v->staged = 0;
+	v->next_ns = 0;
+	v->back = 0;
+	v->mid = 1;
+	v->front = 2;
+	dclm_layer_init(&v->layer, DCLM_OBS_LAYER_VIDEO, DCLM_OBS_Z_VIDEO);
+	v->run = 1;
+	v->flags = 0;
+	dclmDitherInit(&v->dither, DCLM_DITHER_TEMPORAL);
+	video_update(v, settings);
+
+	obs_enter_graphics();
+	v->texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+	v->stage = gs_stagesurface_create(VIDEO_CAP_W, VIDEO_CAP_H, GS_RGBA);
+	obs_leave_graphics();
+	v->gray = dclmImageCreate(VIDEO_COLS, VIDEO_ROWS, NULL);
+	v->img = dclmImageCreate(VIDEO_COLS, VIDEO_ROWS, NULL);
+	if (!v->texrender || !v->stage || !v->gray || !v->img) {
+		blog(LOG_WARNING,"dcledmatrix failed to create the video buffers");
+		video_destroy(v);
+		return NULL;
+	}
+
+	if (sem_init(&v->wakeup, 0, 0)) {
+		blog(LOG_WARNING,"dcledmatrix failed to create semaphore");
+		video_destroy(v);
+		return NULL;
+	}
+	v->flags |= VIDEO_FLAG_WAKEUP_SEM;
+	if (pthread_create(&v->worker, NULL, video_worker, v)) {
+		blog(LOG_WARNING,"dcledmatrix failed to create video worker thread");
+		video_destroy(v);
+		return NULL;
+	}
+	v->flags |= VIDEO_FLAG_WORKER;
+	return v;
+}
+
+static struct obs_source_info video_filter_info = {
+	.id = "dclm_video_filter",
+	.type = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_VIDEO,
+	.get_name = video_get_name,
+	.create = video_create,
+	.destroy = video_destroy,
+	.get_defaults = video_defaults,
+	.get_properties = video_properties,
+	.update = video_update,
+	.video_render = video_render
+};
+
+extern void
+dclm_video_register(void)
+{
+	obs_register_source(&video_filter_info);
+}
+